@@ -0,0 +1,438 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+//
+// Micro benchmarks of the learn module. Each scenario prints one
+// "scenario key value" line per measurement.
+//
+//   topology:   convert, map and install a random topology of nDevices
+//   contention: nDevices saturating the channel with carrier sense on, with
+//               the heap allocations per delivered packet, --wheel=1 holds
+//               the pending receptions in the channel's arrival wheel
+//   qos:        head-of-line latency of high priority packets sent behind a
+//               saturated bulk queue, with nQueues tx queues and scheduler
+//   memory:     resident bytes per device of nDevices full or compact devices
+//   fanout:     time per receiver of the channel's fan-out to nDevices compact
+//               receivers, specialized for the configuration and generic
+//   batch:      time per packet to hand nPackets bursts of nBurst 64 byte
+//               packets to a device, with Send and with SendBatch
+//
+// --profile=file writes the folded stacks of the learn handlers to file, for
+// flamegraph.pl or speedscope, and prints a per handler summary.
+//
+// ./waf --run "learn-bench --scenario=topology --nDevices=1000000"
+// ./waf --run "learn-bench --scenario=contention --nDevices=100"
+// ./waf --run "learn-bench --scenario=contention --nDevices=1000"
+// ./waf --run "learn-bench --scenario=contention --nDevices=1000 --wheel=1"
+// ./waf --run "learn-bench --scenario=qos --nPackets=1000 --nQueues=1"
+// ./waf --run "learn-bench --scenario=qos --nPackets=1000 --nQueues=3 --scheduler=sp"
+// ./waf --run "learn-bench --scenario=qos --nPackets=1000 --nQueues=3 --scheduler=drr"
+// ./waf --run "learn-bench --scenario=memory --nDevices=10000 --compact=0"
+// ./waf --run "learn-bench --scenario=memory --nDevices=10000 --compact=1"
+// ./waf --run "learn-bench --scenario=memory --nDevices=1000000 --compact=1"
+// ./waf --run "learn-bench --scenario=fanout --nDevices=10000 --nPackets=100"
+// ./waf --run "learn-bench --scenario=batch --nPackets=10000 --nBurst=32"
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <new>
+#include <unistd.h>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/learn-module.h"
+#include "ns3/learn-topology.h"
+#include "ns3/learn-stats.h"
+#include "ns3/learn-profiler.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("LearnBench");
+
+//
+// Every allocation of the process is counted.
+//
+static uint64_t g_allocations = 0;
+
+void *
+operator new (std::size_t size)
+{
+  ++g_allocations;
+  void *p = std::malloc (size == 0 ? 1 : size);
+  if (p == 0)
+    {
+      throw std::bad_alloc ();
+    }
+  return p;
+}
+
+void
+operator delete (void *p) noexcept
+{
+  std::free (p);
+}
+
+static void
+BenchTopology (uint32_t nDevices)
+{
+  std::string csv = "learn-bench-devices.csv";
+  std::string bin = "learn-bench-topology.bin";
+
+  Ptr<UniformRandomVariable> pos = CreateObject<UniformRandomVariable> ();
+  {
+    std::ofstream os (csv.c_str ());
+    for (uint32_t i = 0; i < nDevices; ++i)
+      {
+        os << pos->GetValue (0, 1000) << "," << pos->GetValue (0, 1000) << ",5000000,0\n";
+      }
+  }
+
+  SystemWallClockMs clock;
+  clock.Start ();
+  LearnTopology::ConvertCsv (csv, "", bin);
+  std::cout << "topology convert-ms " << clock.End () << std::endl;
+
+  clock.Start ();
+  Ptr<LearnTopology> topology = Create<LearnTopology> (bin);
+  std::cout << "topology map-ms " << clock.End () << std::endl;
+
+  NodeContainer nodes;
+  nodes.Create (nDevices);
+  clock.Start ();
+  LearnHelper learn;
+  NetDeviceContainer devices = learn.Install (nodes, topology);
+  std::cout << "topology install-ms " << clock.End () << std::endl;
+  std::cout << "topology devices " << devices.GetN () << std::endl;
+
+  std::remove (csv.c_str ());
+  std::remove (bin.c_str ());
+}
+
+static uint64_t g_received = 0;
+
+static bool
+CountReceive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address &from)
+{
+  ++g_received;
+  return true;
+}
+
+//
+// Create nDevices on one channel, spread over a square of side meters, with
+// every device counting what it receives.
+//
+static NetDeviceContainer
+CreateDevices (LearnHelper &learn, NodeContainer &nodes, uint32_t nDevices, double side)
+{
+  Ptr<UniformRandomVariable> pos = CreateObject<UniformRandomVariable> ();
+  nodes.Create (nDevices);
+  for (uint32_t i = 0; i < nDevices; ++i)
+    {
+      learn.AddPosition (pos->GetValue (0, side), pos->GetValue (0, side));
+    }
+  NetDeviceContainer devices = learn.Install (nodes);
+  for (uint32_t i = 0; i < devices.GetN (); ++i)
+    {
+      devices.Get (i)->SetReceiveCallback (MakeCallback (&CountReceive));
+    }
+  return devices;
+}
+
+static void
+BenchContention (uint32_t nDevices, uint32_t nPackets, bool wheel)
+{
+  LearnHelper learn;
+  learn.SetQueue ("ns3::DropTailQueue", "MaxSize", StringValue ("100000p"));
+  learn.SetDeviceAttribute ("DataRate", StringValue ("1Mbps"));
+  learn.SetDeviceAttribute ("CarrierSense", BooleanValue (true));
+  learn.SetChannelAttribute ("DelayFac", StringValue ("3ns"));
+  learn.SetChannelAttribute ("ArrivalWheel", BooleanValue (wheel));
+  NodeContainer nodes;
+  NetDeviceContainer devices = CreateDevices (learn, nodes, nDevices, 100);
+
+  //
+  // Every queue is full from the start, so the channel stays saturated until
+  // the last packet is out.
+  //
+  for (uint32_t i = 0; i < devices.GetN (); ++i)
+    {
+      for (uint32_t k = 0; k < nPackets; ++k)
+        {
+          devices.Get (i)->Send (Create<Packet> (100), devices.Get (i)->GetBroadcast (), 0x0800);
+        }
+    }
+
+  SystemWallClockMs clock;
+  uint64_t allocations = g_allocations;
+  clock.Start ();
+  Simulator::Run ();
+  int64_t ms = clock.End ();
+  allocations = g_allocations - allocations;
+  uint64_t sent = static_cast<uint64_t> (nDevices) * nPackets;
+  std::cout << "contention devices " << nDevices << std::endl;
+  std::cout << "contention wall-ms " << ms << std::endl;
+  std::cout << "contention sim-s " << Simulator::Now ().GetSeconds () << std::endl;
+  std::cout << "contention events " << Simulator::GetEventCount () << std::endl;
+  std::cout << "contention events-per-tx " << double (Simulator::GetEventCount ()) / sent << std::endl;
+  std::cout << "contention received " << g_received << std::endl;
+  std::cout << "contention allocs-per-delivery " << double (allocations) / g_received << std::endl;
+}
+
+static std::map<uint64_t, Time> g_highSent;
+static LearnHistogram g_highLatency;
+
+static bool
+RecordHighLatency (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address &from)
+{
+  std::map<uint64_t, Time>::iterator it = g_highSent.find (packet->GetUid ());
+  if (it != g_highSent.end ())
+    {
+      g_highLatency.Add (Simulator::Now () - it->second);
+      g_highSent.erase (it);
+    }
+  return true;
+}
+
+static void
+SendHigh (Ptr<NetDevice> device)
+{
+  Ptr<Packet> p = Create<Packet> (100);
+  SocketPriorityTag tag;
+  tag.SetPriority (6);
+  p->AddPacketTag (tag);
+  g_highSent[p->GetUid ()] = Simulator::Now ();
+  device->Send (p, device->GetBroadcast (), 0x0800);
+}
+
+//
+// One sender with nPackets bulk packets queued from the start and a small
+// high priority packet every 5 bulk transmission times. With one queue the
+// high priority packets wait for the whole backlog ahead of them.
+//
+static void
+BenchQos (uint32_t nPackets, uint32_t nQueues, std::string scheduler)
+{
+  LearnHelper learn;
+  learn.SetQueue ("ns3::DropTailQueue", "MaxSize", StringValue ("100000p"));
+  learn.SetTxQueuesN (nQueues);
+  learn.SetDeviceAttribute ("DataRate", StringValue ("1Mbps"));
+  learn.SetDeviceAttribute ("TxScheduler", StringValue (scheduler == "drr" ? "DeficitRoundRobin" : "StrictPriority"));
+  NodeContainer nodes;
+  NetDeviceContainer devices = CreateDevices (learn, nodes, 2, 10);
+  devices.Get (1)->SetReceiveCallback (MakeCallback (&RecordHighLatency));
+
+  Ptr<NetDevice> sender = devices.Get (0);
+  for (uint32_t k = 0; k < nPackets; ++k)
+    {
+      sender->Send (Create<Packet> (1000), sender->GetBroadcast (), 0x0800);
+    }
+  Time bulkTx = MilliSeconds (8);
+  for (uint32_t k = 0; k < nPackets / 5; ++k)
+    {
+      Simulator::Schedule (bulkTx * (5 * k + 1), &SendHigh, sender);
+    }
+
+  Simulator::Run ();
+  std::cout << "qos queues " << nQueues << std::endl;
+  std::cout << "qos scheduler " << scheduler << std::endl;
+  std::cout << "qos high-count " << g_highLatency.GetCount () << std::endl;
+  std::cout << "qos high-p50-ms " << g_highLatency.GetPercentile (0.5).GetMilliSeconds () << std::endl;
+  std::cout << "qos high-p99-ms " << g_highLatency.GetPercentile (0.99).GetMilliSeconds () << std::endl;
+  std::cout << "qos high-max-ms " << g_highLatency.GetMax ().GetMilliSeconds () << std::endl;
+}
+
+//
+// Resident set size from /proc, only meaningful on Linux.
+//
+static uint64_t
+GetRssBytes (void)
+{
+  std::ifstream statm ("/proc/self/statm");
+  uint64_t size = 0;
+  uint64_t resident = 0;
+  statm >> size >> resident;
+  return resident * sysconf (_SC_PAGESIZE);
+}
+
+static void
+BenchMemory (uint32_t nDevices, bool compact)
+{
+  LearnHelper learn;
+  Ptr<UniformRandomVariable> pos = CreateObject<UniformRandomVariable> ();
+  for (uint32_t i = 0; i < nDevices; ++i)
+    {
+      learn.AddPosition (pos->GetValue (0, 1000), pos->GetValue (0, 1000));
+    }
+
+  NodeContainer nodes;
+  Ptr<LearnChannel> channel;
+  uint64_t before = GetRssBytes ();
+  if (compact)
+    {
+      channel = learn.InstallCompact (nDevices);
+    }
+  else
+    {
+      nodes.Create (nDevices);
+      NetDeviceContainer devices = learn.Install (nodes);
+      channel = DynamicCast<LearnChannel> (devices.Get (0)->GetChannel ());
+    }
+  uint64_t after = GetRssBytes ();
+  std::cout << "memory mode " << (compact ? "compact" : "full") << std::endl;
+  std::cout << "memory devices " << channel->GetNDevices () << std::endl;
+  std::cout << "memory bytes-per-device " << double (after - before) / nDevices << std::endl;
+}
+
+//
+// Only the fan-out is timed: the receive events it schedules run afterwards.
+//
+static void
+BenchFanOut (uint32_t nDevices, uint32_t nPackets, bool specialized)
+{
+  LearnHelper learn;
+  learn.SetChannelAttribute ("DelayFac", StringValue ("3ns"));
+  learn.SetChannelAttribute ("SpecializedFanOut", BooleanValue (specialized));
+  Ptr<UniformRandomVariable> pos = CreateObject<UniformRandomVariable> ();
+  for (uint32_t i = 0; i < nDevices; ++i)
+    {
+      learn.AddPosition (pos->GetValue (0, 1000), pos->GetValue (0, 1000));
+    }
+  Ptr<LearnChannel> channel = learn.InstallCompact (nDevices);
+  NodeContainer nodes;
+  nodes.Create (1);
+  Ptr<LearnNetDevice> sender = learn.Materialize (channel, 0, nodes.Get (0));
+  Ptr<Packet> p = Create<Packet> (100);
+
+  SystemWallClockMs clock;
+  clock.Start ();
+  for (uint32_t k = 0; k < nPackets; ++k)
+    {
+      channel->TransmitStart (p, sender, MicroSeconds (100));
+    }
+  int64_t ms = clock.End ();
+  Simulator::Run ();
+  std::string mode = specialized ? "specialized" : "generic";
+  std::cout << "fanout " << mode << "-ns-per-rx " << 1e6 * ms / (double (nPackets) * (nDevices - 1)) << std::endl;
+  Simulator::Destroy ();
+}
+
+//
+// Only the hand over is timed, not the transmissions: the first packet of
+// each burst goes out at once, the others wait in the queue.
+//
+static void
+BenchBatch (uint32_t nBursts, uint32_t nBurst, bool batch)
+{
+  LearnHelper learn;
+  learn.SetQueue ("ns3::DropTailQueue", "MaxSize", StringValue ("100000000p"));
+  learn.SetChannelAttribute ("DelayFac", StringValue ("3ns"));
+  NodeContainer nodes;
+  NetDeviceContainer devices = CreateDevices (learn, nodes, 2, 100);
+  Ptr<LearnNetDevice> device = devices.Get (0)->GetObject<LearnNetDevice> ();
+  Address dest = devices.Get (1)->GetAddress ();
+
+  //
+  // The packets are made beforehand, the clock only sees the sends.
+  //
+  std::vector<Ptr<Packet> > packets (static_cast<std::size_t> (nBursts) * nBurst);
+  for (std::size_t k = 0; k < packets.size (); ++k)
+    {
+      packets[k] = Create<Packet> (64);
+    }
+  SystemWallClockMs clock;
+  clock.Start ();
+  for (uint32_t b = 0; b < nBursts; ++b)
+    {
+      const Ptr<Packet> *burst = &packets[static_cast<std::size_t> (b) * nBurst];
+      if (batch)
+        {
+          device->SendBatch (burst, nBurst, dest, 0x0800);
+        }
+      else
+        {
+          for (uint32_t k = 0; k < nBurst; ++k)
+            {
+              device->Send (burst[k], dest, 0x0800);
+            }
+        }
+    }
+  int64_t ms = clock.End ();
+  packets.clear ();
+  Simulator::Run ();
+  std::string mode = batch ? "sendbatch" : "send";
+  std::cout << "batch " << mode << "-ns-per-packet " << 1e6 * ms / (double (nBursts) * nBurst) << std::endl;
+  std::cout << "batch " << mode << "-received " << g_received << std::endl;
+  g_received = 0;
+  Simulator::Destroy ();
+}
+
+int
+main (int argc, char *argv[])
+{
+  std::string scenario = "topology";
+  uint32_t nDevices = 10000;
+  uint32_t nPackets = 10;
+  uint32_t nQueues = 3;
+  uint32_t nBurst = 32;
+  std::string scheduler = "sp";
+  bool compact = false;
+  bool wheel = false;
+  std::string profile;
+
+  CommandLine cmd;
+  cmd.AddValue ("scenario", "Benchmark to run: topology, contention, qos, memory, fanout, batch", scenario);
+  cmd.AddValue ("nDevices", "Number of devices", nDevices);
+  cmd.AddValue ("nPackets", "Packets sent by each device", nPackets);
+  cmd.AddValue ("nQueues", "Tx queues per device (qos)", nQueues);
+  cmd.AddValue ("nBurst", "Packets per burst (batch)", nBurst);
+  cmd.AddValue ("scheduler", "Tx scheduler, sp or drr (qos)", scheduler);
+  cmd.AddValue ("compact", "Use compact devices (memory)", compact);
+  cmd.AddValue ("wheel", "Hold pending receptions in the channel's arrival wheel (contention)", wheel);
+  cmd.AddValue ("profile", "Write the folded stacks of the learn handlers to this file", profile);
+  cmd.Parse (argc, argv);
+
+  if (!profile.empty ())
+    {
+      LearnProfiler::Enable ();
+    }
+
+  if (scenario == "topology")
+    {
+      BenchTopology (nDevices);
+    }
+  else if (scenario == "contention")
+    {
+      BenchContention (nDevices, nPackets, wheel);
+    }
+  else if (scenario == "qos")
+    {
+      BenchQos (nPackets, nQueues, scheduler);
+    }
+  else if (scenario == "memory")
+    {
+      BenchMemory (nDevices, compact);
+    }
+  else if (scenario == "fanout")
+    {
+      BenchFanOut (nDevices, nPackets, true);
+      BenchFanOut (nDevices, nPackets, false);
+    }
+  else if (scenario == "batch")
+    {
+      BenchBatch (nPackets, nBurst, false);
+      BenchBatch (nPackets, nBurst, true);
+    }
+  else
+    {
+      NS_ABORT_MSG ("Unknown scenario " << scenario);
+    }
+
+  if (!profile.empty ())
+    {
+      LearnProfiler::WriteFolded (profile);
+      LearnProfiler::Print (std::cout);
+    }
+  Simulator::Destroy ();
+  return 0;
+}
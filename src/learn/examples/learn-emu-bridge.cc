@@ -0,0 +1,157 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+//
+// A local process talks to a simulated channel through a LearnSocketBridge
+// over a socketpair, no privileges needed. The child process sends frames
+// to device 1, which echoes them back; the child measures the round trip in
+// wall clock time and the bridge reports how far simulated time lagged.
+//
+// ./waf --run "learn-emu-bridge --nFrames=200 --interval=5ms"
+//
+
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/learn-module.h"
+#include "ns3/learn-bridge.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("LearnEmuBridge");
+
+static const uint16_t ECHO_PROTOCOL = 0x88b5;
+
+static uint64_t
+NowNs (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return uint64_t (ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+//
+// The outside process: frames of destination, source, protocol and a send
+// time stamp, one per interval, then collect the echoes for a while.
+//
+static int
+RunExternal (int fd, Mac48Address self, Mac48Address peer, uint32_t nFrames, uint64_t intervalNs)
+{
+  uint32_t received = 0;
+  uint64_t rttSum = 0;
+  uint64_t rttMax = 0;
+  uint64_t next = NowNs ();
+  uint64_t end = next + nFrames * intervalNs + 1000000000;
+  uint32_t sent = 0;
+  while (NowNs () < end)
+    {
+      if (sent < nFrames && NowNs () >= next)
+        {
+          uint8_t frame[14 + sizeof (uint64_t)];
+          peer.CopyTo (frame);
+          self.CopyTo (frame + 6);
+          frame[12] = ECHO_PROTOCOL >> 8;
+          frame[13] = ECHO_PROTOCOL & 0xff;
+          uint64_t now = NowNs ();
+          memcpy (frame + 14, &now, sizeof (now));
+          if (send (fd, frame, sizeof (frame), 0) < 0)
+            {
+              perror ("send");
+              return 1;
+            }
+          ++sent;
+          next += intervalNs;
+        }
+      struct pollfd pfd = {fd, POLLIN, 0};
+      if (poll (&pfd, 1, 1) > 0)
+        {
+          uint8_t frame[2048];
+          ssize_t len = recv (fd, frame, sizeof (frame), 0);
+          if (len <= 0)
+            {
+              break;
+            }
+          if (len >= ssize_t (14 + sizeof (uint64_t)))
+            {
+              uint64_t stamp;
+              memcpy (&stamp, frame + 14, sizeof (stamp));
+              uint64_t rtt = NowNs () - stamp;
+              rttSum += rtt;
+              rttMax = std::max (rttMax, rtt);
+              ++received;
+            }
+        }
+    }
+  printf ("external: sent=%u echoed=%u mean rtt=%.1fus max rtt=%.1fus\n", sent, received,
+          received > 0 ? rttSum / 1e3 / received : 0.0, rttMax / 1e3);
+  return 0;
+}
+
+static bool
+Echo (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address &from)
+{
+  if (protocol == ECHO_PROTOCOL)
+    {
+      device->Send (packet->Copy (), from, protocol);
+    }
+  return true;
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t nFrames = 100;
+  Time interval = MilliSeconds (10);
+  uint32_t maxBatch = 64;
+
+  CommandLine cmd;
+  cmd.AddValue ("nFrames", "Frames sent by the external process", nFrames);
+  cmd.AddValue ("interval", "Time between two frames of the external process", interval);
+  cmd.AddValue ("maxBatch", "Most frames moved per system call", maxBatch);
+  cmd.Parse (argc, argv);
+
+  GlobalValue::Bind ("SimulatorImplementationType", StringValue ("ns3::RealtimeSimulatorImpl"));
+
+  LearnHelper learn;
+  learn.SetChannelAttribute ("DelayFac", StringValue ("3ns"));
+  learn.AddPosition (0, 0);
+  learn.AddPosition (100, 0);
+  NodeContainer nodes;
+  nodes.Create (2);
+  NetDeviceContainer devices = learn.Install (nodes);
+  Ptr<LearnNetDevice> tap = devices.Get (0)->GetObject<LearnNetDevice> ();
+  devices.Get (1)->SetReceiveCallback (MakeCallback (&Echo));
+
+  int fds[2];
+  if (socketpair (AF_UNIX, SOCK_SEQPACKET, 0, fds) < 0)
+    {
+      perror ("socketpair");
+      return 1;
+    }
+  Mac48Address self = Mac48Address::ConvertFrom (tap->GetAddress ());
+  Mac48Address peer = Mac48Address::ConvertFrom (devices.Get (1)->GetAddress ());
+  pid_t pid = fork ();
+  if (pid == 0)
+    {
+      close (fds[0]);
+      _exit (RunExternal (fds[1], self, peer, nFrames, interval.GetNanoSeconds ()));
+    }
+  close (fds[1]);
+
+  Ptr<LearnSocketBridge> bridge = CreateObject<LearnSocketBridge> ();
+  bridge->SetAttribute ("MaxBatch", UintegerValue (maxBatch));
+  bridge->Attach (tap, fds[0]);
+
+  Simulator::Stop (interval * nFrames + Seconds (1.5));
+  Simulator::Run ();
+  bridge->PrintStats (std::cout);
+  bridge->Dispose ();
+  Simulator::Destroy ();
+  waitpid (pid, 0, 0);
+  return 0;
+}
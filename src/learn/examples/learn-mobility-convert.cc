@@ -0,0 +1,56 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+//
+// Convert a mobility trace into the binary format played by
+// LearnMobilityTracePlayer.
+//
+//   ns2: an ns-2 movement file, as written by setdest or by SUMO's
+//        traceExporter.py --ns2mobility-output
+//   csv: one "time,node,x,y[,z]" line per waypoint, nodes numbered from 0
+//
+// ./waf --run "learn-mobility-convert --ns2=scenario.tcl --output=mobility.bin"
+// ./waf --run "learn-mobility-convert --csv=fcd.csv --output=mobility.bin"
+//
+
+#include "ns3/core-module.h"
+#include "ns3/learn-mobility-trace.h"
+
+using namespace ns3;
+
+int
+main (int argc, char *argv[])
+{
+  std::string ns2;
+  std::string csv;
+  std::string output = "mobility.bin";
+
+  CommandLine cmd;
+  cmd.AddValue ("ns2", "ns-2 movement file", ns2);
+  cmd.AddValue ("csv", "Csv file with one time,node,x,y[,z] line per waypoint", csv);
+  cmd.AddValue ("output", "Binary mobility trace to write", output);
+  cmd.Parse (argc, argv);
+
+  NS_ABORT_MSG_IF (ns2.empty () == csv.empty (), "Give one of --ns2 and --csv");
+
+  SystemWallClockMs clock;
+  clock.Start ();
+  if (!ns2.empty ())
+    {
+      LearnMobilityTrace::ConvertNs2 (ns2, output);
+    }
+  else
+    {
+      LearnMobilityTrace::ConvertCsv (csv, output);
+    }
+  int64_t ms = clock.End ();
+
+  Ptr<LearnMobilityTrace> trace = Create<LearnMobilityTrace> (output);
+  uint64_t nWaypoints = 0;
+  for (uint64_t i = 0; i < trace->GetNNodes (); ++i)
+    {
+      nWaypoints += trace->GetNWaypoints (i);
+    }
+  std::cout << output << ": " << trace->GetNNodes () << " nodes, " << nWaypoints
+            << " waypoints, converted in " << ms << " ms" << std::endl;
+  return 0;
+}
@@ -0,0 +1,90 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+//
+// Independent replications of a small contention scenario, each in its own
+// process with one RNG run, several at once. Prints the delivery ratio and the
+// delivered packets with their confidence intervals, and the latency
+// histogram merged over all the replications.
+//
+// ./waf --run "learn-replications --nReplications=100"
+// ./waf --run "learn-replications --nReplications=200 --workers=8 --firstRun=1000"
+//
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/learn-module.h"
+#include "ns3/learn-replication.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("LearnReplications");
+
+//
+// nDevices with carrier sense at random positions each broadcast nPackets,
+// and every receiver loses 10% of the packets.
+//
+static void
+RunReplication (uint32_t nDevices, uint32_t nPackets, uint32_t index, LearnReplicationResult *result)
+{
+  LearnHelper learn;
+  learn.SetDeviceAttribute ("DataRate", StringValue ("1Mbps"));
+  learn.SetDeviceAttribute ("CarrierSense", BooleanValue (true));
+  learn.SetDeviceAttribute ("LatencyStats", StringValue ("Device"));
+  learn.SetChannelAttribute ("DelayFac", StringValue ("3ns"));
+  Ptr<UniformRandomVariable> pos = CreateObject<UniformRandomVariable> ();
+  for (uint32_t i = 0; i < nDevices; ++i)
+    {
+      learn.AddPosition (pos->GetValue (0, 100), pos->GetValue (0, 100));
+    }
+  NodeContainer nodes;
+  nodes.Create (nDevices);
+  NetDeviceContainer devices = learn.Install (nodes);
+
+  for (uint32_t i = 0; i < devices.GetN (); ++i)
+    {
+      Ptr<RateErrorModel> em = CreateObject<RateErrorModel> ();
+      em->SetAttribute ("ErrorUnit", StringValue ("ERROR_UNIT_PACKET"));
+      em->SetAttribute ("ErrorRate", DoubleValue (0.1));
+      devices.Get (i)->GetObject<LearnNetDevice> ()->SetReceiveErrorModel (em);
+      for (uint32_t k = 0; k < nPackets; ++k)
+        {
+          devices.Get (i)->Send (Create<Packet> (100), devices.Get (i)->GetBroadcast (), 0x0800);
+        }
+    }
+  Simulator::Run ();
+
+  LearnHistogram &latency = result->GetHistogram ("latency");
+  for (uint32_t i = 0; i < devices.GetN (); ++i)
+    {
+      latency.Merge (devices.Get (i)->GetObject<LearnNetDevice> ()->GetLatencyStats ().total);
+    }
+  double offered = double (nDevices) * nPackets * (nDevices - 1);
+  result->SetCounter ("delivered", latency.GetCount ());
+  result->SetCounter ("delivery-ratio", latency.GetCount () / offered);
+  result->SetCounter ("sim-seconds", Simulator::Now ().GetSeconds ());
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t nReplications = 50;
+  uint32_t workers = 0;
+  uint64_t firstRun = 1;
+  uint32_t nDevices = 20;
+  uint32_t nPackets = 10;
+
+  CommandLine cmd;
+  cmd.AddValue ("nReplications", "Number of independent replications", nReplications);
+  cmd.AddValue ("workers", "Worker processes, 0 for one per core", workers);
+  cmd.AddValue ("firstRun", "RNG run of the first replication", firstRun);
+  cmd.AddValue ("nDevices", "Number of devices", nDevices);
+  cmd.AddValue ("nPackets", "Packets sent by each device", nPackets);
+  cmd.Parse (argc, argv);
+
+  LearnReplicationRunner runner;
+  runner.SetWorkers (workers);
+  runner.SetFirstRun (firstRun);
+  runner.Run (nReplications, MakeBoundCallback (&RunReplication, nDevices, nPackets));
+  runner.Print (std::cout);
+  return 0;
+}
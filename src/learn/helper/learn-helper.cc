@@ -4,6 +4,10 @@
 #include "ns3/log.h"
 #include "ns3/simulator.h"
 #include "ns3/learn.h"
+#include "ns3/learn-topology.h"
+#include "ns3/learn-profiler.h"
+#include <fstream>
+#include <map>
 #include "ns3/queue.h"
 #include "ns3/net-device-queue-interface.h"
 #include "ns3/config.h"
@@ -20,7 +24,30 @@ namespace ns3
 
 NS_LOG_COMPONENT_DEFINE("LearnHelper");
 
-LearnHelper::LearnHelper() : top(0)
+static void
+DumpLatencyStats(NetDeviceContainer devices, std::string filename)
+{
+	std::ofstream os(filename.c_str());
+	NS_ABORT_MSG_IF(!os, "Cannot open " << filename);
+	for (uint32_t i = 0; i < devices.GetN(); ++i)
+	{
+		Ptr<LearnNetDevice> device = devices.Get(i)->GetObject<LearnNetDevice>();
+		if (device != 0)
+		{
+			device->PrintLatencyStats(os);
+		}
+	}
+}
+
+static void
+WriteProfile(std::string filename)
+{
+	LearnProfiler::WriteFolded(filename);
+	LearnProfiler::Disable();
+}
+
+LearnHelper::LearnHelper()
+	: m_nTxQueues(1)
 {
 	m_queueFactory.SetTypeId("ns3::DropTailQueue<Packet>");
 	m_deviceFactory.SetTypeId("ns3::LearnNetDevice");
@@ -42,6 +69,12 @@ void LearnHelper::SetQueue(std::string type,
 	m_queueFactory.Set(n4, v4);
 }
 
+void LearnHelper::SetTxQueuesN(std::size_t n)
+{
+	NS_ASSERT_MSG(n > 0, "A device needs at least one tx queue");
+	m_nTxQueues = n;
+}
+
 void LearnHelper::SetDeviceAttribute(std::string n1, const AttributeValue &v1)
 {
 	m_deviceFactory.Set(n1, v1);
@@ -52,6 +85,22 @@ void LearnHelper::SetChannelAttribute(std::string n1, const AttributeValue &v1)
 	m_channelFactory.Set(n1, v1);
 }
 
+void LearnHelper::EnableLatencyStatsDump(NetDeviceContainer devices, std::string filename)
+{
+	//
+	// Destroy events run before the devices are released, and the statistics
+	// survive the disposal of the devices.
+	//
+	Simulator::ScheduleDestroy(&DumpLatencyStats, devices, filename);
+}
+
+void LearnHelper::EnableProfiler(std::string filename)
+{
+	LearnProfiler::Reset();
+	LearnProfiler::Enable();
+	Simulator::ScheduleDestroy(&WriteProfile, filename);
+}
+
 void LearnHelper::EnablePcapInternal(std::string prefix, Ptr<NetDevice> nd, bool promiscuous, bool explicitFilename)
 {
 	//
@@ -195,23 +244,168 @@ LearnHelper::Install(NodeContainer c)
 {
 	NetDeviceContainer container;
 	Ptr<LearnChannel> channel = m_channelFactory.Create<LearnChannel>();
+	NS_ASSERT_MSG(c.GetN() <= m_xs.size(), "Not enough positions for the nodes");
+	channel->Reserve(c.GetN());
 	for (decltype(c.GetN()) i = 0; i < c.GetN(); ++i)
 	{
-		Ptr<Node> n = c.Get(i);
-		Ptr<LearnNetDevice> dev = m_deviceFactory.Create<LearnNetDevice>();
-		dev->SetAddress(Mac48Address::Allocate());
-		dev->SetXY(m_xs[i], m_ys[i]);
-		n->AddDevice(dev);
-		Ptr<Queue<Packet>> queue = m_queueFactory.Create<Queue<Packet>>();
-		dev->SetQueue(queue);
+		container.Add(InstallDevice(c.Get(i), channel, m_xs[i], m_ys[i]));
+	}
+	return container;
+}
 
-		Ptr<NetDeviceQueueInterface> ndqi = CreateObject<NetDeviceQueueInterface>();
-		ndqi->GetTxQueue(0)->ConnectQueueTraces(queue);
-		dev->AggregateObject(ndqi);
-		dev->Attach(channel);
+NetDeviceContainer
+LearnHelper::Install(NodeContainer c, Ptr<const LearnTopology> topology)
+{
+	NS_ABORT_MSG_IF(c.GetN() != topology->GetNDevices(),
+					"Topology has " << topology->GetNDevices() << " devices for " << c.GetN() << " nodes");
+	NetDeviceContainer container;
+	std::map<uint32_t, std::size_t> groupSizes;
+	for (uint64_t i = 0; i < topology->GetNDevices(); ++i)
+	{
+		++groupSizes[topology->GetDevice(i).group];
+	}
+	std::map<uint32_t, Ptr<LearnChannel>> channels;
+	for (decltype(c.GetN()) i = 0; i < c.GetN(); ++i)
+	{
+		const LearnTopologyDevice &d = topology->GetDevice(i);
+		Ptr<LearnChannel> &channel = channels[d.group];
+		if (channel == 0)
+		{
+			channel = m_channelFactory.Create<LearnChannel>();
+			channel->Reserve(groupSizes[d.group]);
+		}
+		Ptr<LearnNetDevice> dev = InstallDevice(c.Get(i), channel, d.x, d.y);
+		if (d.dataRate != 0)
+		{
+			dev->SetDataRate(DataRate(d.dataRate));
+		}
 		container.Add(dev);
 	}
+
+	for (uint64_t k = 0; k < topology->GetNLinks(); ++k)
+	{
+		const LearnTopologyLink &l = topology->GetLink(k);
+		Ptr<LearnNetDevice> src = container.Get(l.src)->GetObject<LearnNetDevice>();
+		Ptr<LearnNetDevice> dst = container.Get(l.dst)->GetObject<LearnNetDevice>();
+		if (src->GetChannel() != dst->GetChannel())
+		{
+			NS_LOG_WARN("Ignoring link " << l.src << "->" << l.dst << " between groups");
+			continue;
+		}
+		DynamicCast<LearnChannel>(src->GetChannel())->SetLinkLoss(src, dst, l.loss);
+	}
 	return container;
 }
 
+Ptr<LearnChannel>
+LearnHelper::InstallCompact(std::size_t n)
+{
+	NS_ASSERT_MSG(n <= m_xs.size(), "Not enough positions for the devices");
+	Ptr<LearnChannel> channel = m_channelFactory.Create<LearnChannel>();
+	channel->Reserve(n);
+	for (std::size_t i = 0; i < n; ++i)
+	{
+		channel->AddCompactDevice(m_xs[i], m_ys[i]);
+	}
+	return channel;
+}
+
+//
+// The dense arrays of the channel are reserved once for the whole group, and
+// no node nor NetDevice is made: this is the way to load very large
+// topologies. Compact devices do not send, so the data rates of the file are
+// not used; materialized devices get the DataRate of the helper.
+//
+Ptr<LearnChannel>
+LearnHelper::InstallCompact(Ptr<const LearnTopology> topology, uint32_t group)
+{
+	std::size_t n = 0;
+	for (uint64_t i = 0; i < topology->GetNDevices(); ++i)
+	{
+		n += topology->GetDevice(i).group == group;
+	}
+	Ptr<LearnChannel> channel = m_channelFactory.Create<LearnChannel>();
+	channel->Reserve(n);
+	//
+	// Channel index of each device of the file, NO_DEVICE in other groups.
+	// Only needed to place the links.
+	//
+	std::vector<std::size_t> index(topology->GetNLinks() > 0 ? topology->GetNDevices() : 0, LearnChannel::NO_DEVICE);
+	for (uint64_t i = 0; i < topology->GetNDevices(); ++i)
+	{
+		const LearnTopologyDevice &d = topology->GetDevice(i);
+		if (d.group != group)
+		{
+			continue;
+		}
+		std::size_t k = channel->AddCompactDevice(d.x, d.y);
+		if (!index.empty())
+		{
+			index[i] = k;
+		}
+	}
+	for (uint64_t k = 0; k < topology->GetNLinks(); ++k)
+	{
+		const LearnTopologyLink &l = topology->GetLink(k);
+		std::size_t src = index[l.src];
+		std::size_t dst = index[l.dst];
+		if (src == LearnChannel::NO_DEVICE || dst == LearnChannel::NO_DEVICE)
+		{
+			if (src != dst)
+			{
+				NS_LOG_WARN("Ignoring link " << l.src << "->" << l.dst << " between groups");
+			}
+			continue;
+		}
+		channel->SetLinkLoss(src, dst, l.loss);
+	}
+	return channel;
+}
+
+Ptr<LearnNetDevice>
+LearnHelper::Materialize(Ptr<LearnChannel> channel, std::size_t index, Ptr<Node> n)
+{
+	Ptr<LearnNetDevice> dev = CreateDevice(n);
+	dev->Materialize(channel, index);
+	return dev;
+}
+
+Ptr<LearnNetDevice>
+LearnHelper::InstallDevice(Ptr<Node> n, Ptr<LearnChannel> channel, double x, double y)
+{
+	Ptr<LearnNetDevice> dev = CreateDevice(n);
+	dev->SetXY(x, y);
+	dev->Attach(channel);
+	return dev;
+}
+
+Ptr<LearnNetDevice>
+LearnHelper::CreateDevice(Ptr<Node> n)
+{
+	Ptr<LearnNetDevice> dev = m_deviceFactory.Create<LearnNetDevice>();
+	dev->SetAddress(Mac48Address::Allocate());
+	n->AddDevice(dev);
+	Ptr<NetDeviceQueueInterface> ndqi = CreateObject<NetDeviceQueueInterface>();
+	ndqi->SetTxQueuesN(m_nTxQueues);
+	for (std::size_t i = 0; i < m_nTxQueues; ++i)
+	{
+		Ptr<Queue<Packet>> queue = m_queueFactory.Create<Queue<Packet>>();
+		if (i == 0)
+		{
+			dev->SetQueue(queue);
+		}
+		else
+		{
+			dev->AddTxQueue(queue);
+		}
+		ndqi->GetTxQueue(i)->ConnectQueueTraces(queue);
+	}
+	if (m_nTxQueues > 1)
+	{
+		ndqi->SetSelectQueueCallback(MakeCallback(&LearnNetDevice::SelectTxQueue, dev));
+	}
+	dev->AggregateObject(ndqi);
+	return dev;
+}
+
 } // namespace ns3
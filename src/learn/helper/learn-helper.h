@@ -3,6 +3,7 @@
 #define LEARN_HELPER_H
 
 #include <string>
+#include <vector>
 #include "ns3/object-factory.h"
 #include "ns3/net-device-container.h"
 #include "ns3/node-container.h"
@@ -13,6 +14,9 @@ namespace ns3
 
 class NetDevice;
 class Node;
+class LearnChannel;
+class LearnNetDevice;
+class LearnTopology;
 
 class LearnHelper : public PcapHelperForDevice, public AsciiTraceHelperForDevice
 {
@@ -25,21 +29,36 @@ class LearnHelper : public PcapHelperForDevice, public AsciiTraceHelperForDevice
 				  std::string n3 = "", const AttributeValue &v3 = EmptyAttributeValue(),
 				  std::string n4 = "", const AttributeValue &v4 = EmptyAttributeValue());
 
+	//number of tx queues created per device, from the SetQueue factory
+	void SetTxQueuesN(std::size_t n);
+
 	void SetDeviceAttribute(std::string name, const AttributeValue &value);
 
 	void SetChannelAttribute(std::string name, const AttributeValue &value);
 
 	NetDeviceContainer Install(NodeContainer c);
+	//install the devices described by a topology file, one channel per group
+	NetDeviceContainer Install(NodeContainer c, Ptr<const LearnTopology> topology);
 
 	NetDeviceContainer Install(Ptr<Node> n);
 
 	NetDeviceContainer Install(std::string nName);
+	//create a channel of n compact devices at the added positions, with no node nor NetDevice
+	Ptr<LearnChannel> InstallCompact(std::size_t n);
+	//create a channel of compact devices for the devices of group in a topology file, in file order, with their link losses
+	Ptr<LearnChannel> InstallCompact(Ptr<const LearnTopology> topology, uint32_t group = 0);
+	//give compact device index of channel a full device on node n, with its queues
+	Ptr<LearnNetDevice> Materialize(Ptr<LearnChannel> channel, std::size_t index, Ptr<Node> n);
+
+	//write the latency statistics of the devices to filename when the simulation is destroyed
+	void EnableLatencyStatsDump(NetDeviceContainer devices, std::string filename);
+	//profile the learn handlers and write the folded stacks to filename when the simulation is destroyed
+	void EnableProfiler(std::string filename);
 
 	void AddPosition(double x, double y)
 	{
-		m_xs[top] = x;
-		m_ys[top] = y;
-		++top;
+		m_xs.push_back(x);
+		m_ys.push_back(y);
 	}
 
   private:
@@ -50,13 +69,17 @@ class LearnHelper : public PcapHelperForDevice, public AsciiTraceHelperForDevice
 		std::string prefix,
 		Ptr<NetDevice> nd,
 		bool explicitFilename);
+	//create a device with its queue on node n and attach it to channel
+	Ptr<LearnNetDevice> InstallDevice(Ptr<Node> n, Ptr<LearnChannel> channel, double x, double y);
+	//create a device with its queues on node n, not attached yet
+	Ptr<LearnNetDevice> CreateDevice(Ptr<Node> n);
 
 	ObjectFactory m_queueFactory;
 	ObjectFactory m_channelFactory;
 	ObjectFactory m_deviceFactory;
-	double m_xs[16];
-	double m_ys[16];
-	int top;
+	std::size_t m_nTxQueues;
+	std::vector<double> m_xs;
+	std::vector<double> m_ys;
 };
 
 } // namespace ns3
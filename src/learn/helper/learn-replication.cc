@@ -0,0 +1,525 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <sstream>
+#include <vector>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "ns3/abort.h"
+#include "ns3/assert.h"
+#include "ns3/log.h"
+#include "ns3/rng-seed-manager.h"
+#include "ns3/simulator.h"
+#include "ns3/system-wall-clock-ms.h"
+#include "learn-replication.h"
+
+namespace ns3
+{
+NS_LOG_COMPONENT_DEFINE("LearnReplication");
+
+namespace
+{
+template <typename T>
+void WriteRaw(std::ostream &os, const T &v)
+{
+	os.write(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+
+template <typename T>
+T ReadRaw(std::istream &is)
+{
+	T v;
+	is.read(reinterpret_cast<char *>(&v), sizeof(T));
+	NS_ABORT_MSG_IF(!is, "Truncated replication result");
+	return v;
+}
+
+void WriteString(std::ostream &os, const std::string &s)
+{
+	WriteRaw<uint32_t>(os, s.size());
+	os.write(s.data(), s.size());
+}
+
+std::string ReadString(std::istream &is)
+{
+	std::string s(ReadRaw<uint32_t>(is), '\0');
+	is.read(&s[0], s.size());
+	NS_ABORT_MSG_IF(!is, "Truncated replication result");
+	return s;
+}
+
+bool WriteFull(int fd, const void *buf, std::size_t size)
+{
+	const char *p = static_cast<const char *>(buf);
+	while (size > 0)
+	{
+		ssize_t n = write(fd, p, size);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+//false if the other end closed the pipe first
+bool ReadFull(int fd, void *buf, std::size_t size)
+{
+	char *p = static_cast<char *>(buf);
+	while (size > 0)
+	{
+		ssize_t n = read(fd, p, size);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+//
+// Quantile of the standard normal distribution, rational approximation by
+// P. J. Acklam, relative error below 1.2e-9.
+//
+double NormalQuantile(double p)
+{
+	static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+							   1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+	static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+							   6.680131188771972e+01, -1.328068155288572e+01};
+	static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+							   -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+	static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+							   3.754408661907416e+00};
+	const double low = 0.02425;
+	if (p < low || p > 1 - low)
+	{
+		double q = std::sqrt(-2 * std::log(p < low ? p : 1 - p));
+		double x = (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+				   ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+		return p < low ? x : -x;
+	}
+	double q = p - 0.5;
+	double r = q * q;
+	return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q /
+		   (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+}
+
+//
+// Distribution function of Student's t with nu degrees of freedom, from the
+// finite series for integer nu (Abramowitz and Stegun 26.7.3 and 26.7.4).
+//
+double StudentCdf(double t, uint32_t nu)
+{
+	double theta = std::atan(std::fabs(t) / std::sqrt(static_cast<double>(nu)));
+	double c2 = std::cos(theta) * std::cos(theta);
+	double a;
+	if (nu % 2 == 1)
+	{
+		double sum = 0;
+		double term = std::cos(theta);
+		for (uint32_t k = 1; k + 2 <= nu; k += 2)
+		{
+			sum += term;
+			term *= c2 * (k + 1) / (k + 2);
+		}
+		a = 2 / M_PI * (theta + std::sin(theta) * sum);
+	}
+	else
+	{
+		double sum = 0;
+		double term = 1;
+		for (uint32_t k = 0; k + 2 <= nu; k += 2)
+		{
+			sum += term;
+			term *= c2 * (k + 1) / (k + 2);
+		}
+		a = std::sin(theta) * sum;
+	}
+	return t < 0 ? (1 - a) / 2 : (1 + a) / 2;
+}
+
+double StudentDensity(double t, uint32_t nu)
+{
+	double n = nu;
+	return std::exp(std::lgamma((n + 1) / 2) - std::lgamma(n / 2)) / std::sqrt(n * M_PI) *
+		   std::pow(1 + t * t / n, -(n + 1) / 2);
+}
+
+//
+// Quantile of Student's t distribution with nu degrees of freedom. Closed
+// forms for 1 and 2 degrees of freedom; otherwise the Cornish-Fisher
+// expansion of the normal quantile, refined with Newton steps on the exact
+// distribution function. Past the median the function is concave, so the
+// steps converge from below after the first one.
+//
+double StudentQuantile(double p, uint32_t nu)
+{
+	if (nu == 1)
+	{
+		return std::tan(M_PI * (p - 0.5));
+	}
+	if (nu == 2)
+	{
+		return (2 * p - 1) / std::sqrt(2 * p * (1 - p));
+	}
+	if (p < 0.5)
+	{
+		return -StudentQuantile(1 - p, nu);
+	}
+	double z = NormalQuantile(p);
+	double z2 = z * z;
+	double n = nu;
+	double t = z + z * (z2 + 1) / (4 * n) + z * ((5 * z2 + 16) * z2 + 3) / (96 * n * n) +
+			   z * (((3 * z2 + 19) * z2 + 17) * z2 - 15) / (384 * n * n * n);
+	for (uint32_t k = 0; k < 50; ++k)
+	{
+		double step = (StudentCdf(t, nu) - p) / StudentDensity(t, nu);
+		t -= step;
+		if (std::fabs(step) <= 1e-12 * std::fabs(t))
+		{
+			break;
+		}
+	}
+	return t;
+}
+} // namespace
+
+/////////////////////////////////////////////////////////////
+
+void LearnReplicationResult::SetCounter(std::string name, double value)
+{
+	m_counters[name] = value;
+}
+
+void LearnReplicationResult::AddCounter(std::string name, double value)
+{
+	m_counters[name] += value;
+}
+
+LearnHistogram &
+LearnReplicationResult::GetHistogram(std::string name)
+{
+	return m_histograms[name];
+}
+
+const std::map<std::string, double> &
+LearnReplicationResult::GetCounters(void) const
+{
+	return m_counters;
+}
+
+const std::map<std::string, LearnHistogram> &
+LearnReplicationResult::GetHistograms(void) const
+{
+	return m_histograms;
+}
+
+void LearnReplicationResult::Serialize(std::ostream &os) const
+{
+	WriteRaw<uint32_t>(os, m_counters.size());
+	for (std::map<std::string, double>::const_iterator it = m_counters.begin(); it != m_counters.end(); ++it)
+	{
+		WriteString(os, it->first);
+		WriteRaw(os, it->second);
+	}
+	WriteRaw<uint32_t>(os, m_histograms.size());
+	for (std::map<std::string, LearnHistogram>::const_iterator it = m_histograms.begin(); it != m_histograms.end(); ++it)
+	{
+		WriteString(os, it->first);
+		it->second.Serialize(os);
+	}
+}
+
+void LearnReplicationResult::Deserialize(std::istream &is)
+{
+	m_counters.clear();
+	m_histograms.clear();
+	uint32_t nCounters = ReadRaw<uint32_t>(is);
+	for (uint32_t k = 0; k < nCounters; ++k)
+	{
+		std::string name = ReadString(is);
+		m_counters[name] = ReadRaw<double>(is);
+	}
+	uint32_t nHistograms = ReadRaw<uint32_t>(is);
+	for (uint32_t k = 0; k < nHistograms; ++k)
+	{
+		std::string name = ReadString(is);
+		m_histograms[name].Deserialize(is);
+	}
+}
+
+/////////////////////////////////////////////////////////////
+
+LearnReplicationRunner::LearnReplicationRunner()
+	: m_workers(0), m_firstRun(1), m_confidence(0.95), m_progress(true), m_nReplications(0)
+{
+}
+
+void LearnReplicationRunner::SetWorkers(uint32_t n)
+{
+	m_workers = n;
+}
+
+void LearnReplicationRunner::SetFirstRun(uint64_t run)
+{
+	m_firstRun = run;
+}
+
+void LearnReplicationRunner::SetConfidence(double level)
+{
+	NS_ASSERT_MSG(level > 0 && level < 1, "Confidence level must be in (0, 1)");
+	m_confidence = level;
+}
+
+void LearnReplicationRunner::SetProgress(bool progress)
+{
+	m_progress = progress;
+}
+
+//
+// Every replication runs in a child forked from the runner for it alone, so
+// it starts from the runner's state as of Run: the RNG stream counter, the
+// Config defaults and every other global are the same whichever slot runs
+// it and whatever ran before. Up to nWorkers children run at once. Each
+// writes to its pipe the index, the size, then the serialized
+// LearnReplicationResult, and exits.
+//
+void LearnReplicationRunner::Run(uint32_t nReplications, Scenario scenario)
+{
+	NS_LOG_FUNCTION(this << nReplications);
+	m_nReplications = 0;
+	m_counters.clear();
+	m_histograms.clear();
+	if (nReplications == 0)
+	{
+		return;
+	}
+	uint32_t nWorkers = m_workers;
+	if (nWorkers == 0)
+	{
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		nWorkers = cores > 0 ? static_cast<uint32_t>(cores) : 1;
+	}
+	nWorkers = std::min(nWorkers, nReplications);
+
+	//
+	// Buffered output would otherwise be written once more by every child.
+	//
+	std::cout.flush();
+	std::cerr.flush();
+
+	std::vector<pid_t> pids(nWorkers, -1);
+	std::vector<uint32_t> running(nWorkers, 0);
+	std::vector<struct pollfd> resultFds(nWorkers);
+	for (uint32_t w = 0; w < nWorkers; ++w)
+	{
+		resultFds[w].fd = -1;
+		resultFds[w].events = POLLIN;
+		resultFds[w].revents = 0;
+	}
+
+	SystemWallClockMs clock;
+	clock.Start();
+	uint32_t next = 0;
+	while (m_nReplications < nReplications)
+	{
+		for (uint32_t w = 0; w < nWorkers && next < nReplications; ++w)
+		{
+			if (resultFds[w].fd >= 0)
+			{
+				continue;
+			}
+			int result[2];
+			NS_ABORT_MSG_IF(pipe(result) != 0, "Cannot create replication pipe");
+			pid_t pid = fork();
+			NS_ABORT_MSG_IF(pid < 0, "Cannot fork replication " << next);
+			if (pid == 0)
+			{
+				close(result[0]);
+				for (uint32_t k = 0; k < nWorkers; ++k)
+				{
+					if (resultFds[k].fd >= 0)
+					{
+						close(resultFds[k].fd);
+					}
+				}
+				RunReplication(next, result[1], scenario);
+				std::cout.flush();
+				std::cerr.flush();
+				_exit(0);
+			}
+			close(result[1]);
+			pids[w] = pid;
+			running[w] = next++;
+			resultFds[w].fd = result[0];
+			resultFds[w].revents = 0;
+		}
+
+		if (poll(&resultFds[0], resultFds.size(), -1) < 0)
+		{
+			NS_ABORT_MSG_IF(errno != EINTR, "poll failed on the replication pipes");
+			continue;
+		}
+		for (uint32_t w = 0; w < nWorkers; ++w)
+		{
+			if (resultFds[w].fd < 0 || resultFds[w].revents == 0)
+			{
+				continue;
+			}
+			uint32_t header[2];
+			NS_ABORT_MSG_IF(!ReadFull(resultFds[w].fd, header, sizeof(header)),
+							"Process " << pids[w] << " died running replication " << running[w]);
+			std::string bytes(header[1], '\0');
+			NS_ABORT_MSG_IF(header[1] > 0 && !ReadFull(resultFds[w].fd, &bytes[0], bytes.size()),
+							"Process " << pids[w] << " died sending replication " << header[0]);
+			close(resultFds[w].fd);
+			resultFds[w].fd = -1;
+			resultFds[w].revents = 0;
+			int status;
+			waitpid(pids[w], &status, 0);
+			std::istringstream is(bytes);
+			LearnReplicationResult result;
+			result.Deserialize(is);
+			Merge(result);
+
+			if (m_progress)
+			{
+				double elapsed = clock.End() / 1000.0;
+				double left = elapsed / m_nReplications * (nReplications - m_nReplications);
+				std::cerr << "\rreplications " << m_nReplications << "/" << nReplications << ", " << elapsed
+						  << "s elapsed, about " << left << "s left   " << std::flush;
+			}
+		}
+	}
+	if (m_progress)
+	{
+		std::cerr << std::endl;
+	}
+}
+
+void LearnReplicationRunner::RunReplication(uint32_t index, int resultFd, Scenario scenario)
+{
+	RngSeedManager::SetRun(m_firstRun + index);
+	LearnReplicationResult result;
+	scenario(index, &result);
+	Simulator::Destroy();
+
+	std::ostringstream os;
+	result.Serialize(os);
+	std::string bytes = os.str();
+	uint32_t header[2] = {index, static_cast<uint32_t>(bytes.size())};
+	if (WriteFull(resultFd, header, sizeof(header)))
+	{
+		WriteFull(resultFd, bytes.data(), bytes.size());
+	}
+	close(resultFd);
+}
+
+//
+// Counters are merged with Welford's update, which stays accurate when the
+// spread is small compared to the mean.
+//
+void LearnReplicationRunner::Merge(const LearnReplicationResult &result)
+{
+	++m_nReplications;
+	const std::map<std::string, double> &counters = result.GetCounters();
+	for (std::map<std::string, double>::const_iterator it = counters.begin(); it != counters.end(); ++it)
+	{
+		std::map<std::string, CounterStats>::iterator stats = m_counters.find(it->first);
+		if (stats == m_counters.end())
+		{
+			CounterStats empty = {0, 0, 0};
+			stats = m_counters.insert(std::make_pair(it->first, empty)).first;
+		}
+		CounterStats &c = stats->second;
+		++c.n;
+		double delta = it->second - c.mean;
+		c.mean += delta / c.n;
+		c.m2 += delta * (it->second - c.mean);
+	}
+	const std::map<std::string, LearnHistogram> &histograms = result.GetHistograms();
+	for (std::map<std::string, LearnHistogram>::const_iterator it = histograms.begin(); it != histograms.end(); ++it)
+	{
+		m_histograms[it->first].Merge(it->second);
+	}
+}
+
+uint32_t
+LearnReplicationRunner::GetNReplications(void) const
+{
+	return m_nReplications;
+}
+
+const LearnReplicationRunner::CounterStats &
+LearnReplicationRunner::FindCounter(std::string name) const
+{
+	std::map<std::string, CounterStats>::const_iterator it = m_counters.find(name);
+	NS_ABORT_MSG_IF(it == m_counters.end(), "No counter " << name);
+	return it->second;
+}
+
+double
+LearnReplicationRunner::GetMean(std::string name) const
+{
+	return FindCounter(name).mean;
+}
+
+double
+LearnReplicationRunner::GetStdDev(std::string name) const
+{
+	const CounterStats &c = FindCounter(name);
+	return c.n > 1 ? std::sqrt(c.m2 / (c.n - 1)) : 0;
+}
+
+double
+LearnReplicationRunner::GetHalfWidth(std::string name) const
+{
+	const CounterStats &c = FindCounter(name);
+	if (c.n < 2)
+	{
+		return 0;
+	}
+	return StudentQuantile(0.5 + m_confidence / 2, c.n - 1) * GetStdDev(name) / std::sqrt(static_cast<double>(c.n));
+}
+
+const LearnHistogram &
+LearnReplicationRunner::GetHistogram(std::string name) const
+{
+	std::map<std::string, LearnHistogram>::const_iterator it = m_histograms.find(name);
+	NS_ABORT_MSG_IF(it == m_histograms.end(), "No histogram " << name);
+	return it->second;
+}
+
+void LearnReplicationRunner::Print(std::ostream &os) const
+{
+	for (std::map<std::string, CounterStats>::const_iterator it = m_counters.begin(); it != m_counters.end(); ++it)
+	{
+		os << it->first << " " << it->second.mean << " +- " << GetHalfWidth(it->first) << " ("
+		   << m_confidence * 100 << "% ci, n=" << it->second.n << ")" << std::endl;
+	}
+	for (std::map<std::string, LearnHistogram>::const_iterator it = m_histograms.begin(); it != m_histograms.end(); ++it)
+	{
+		os << it->first << " ";
+		it->second.Print(os);
+		os << std::endl;
+	}
+}
+
+} // namespace ns3
@@ -0,0 +1,94 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef LEARN_REPLICATION_H
+#define LEARN_REPLICATION_H
+
+#include <stdint.h>
+#include <iostream>
+#include <map>
+#include <string>
+#include "ns3/callback.h"
+#include "ns3/learn-stats.h"
+
+namespace ns3
+{
+
+//named counters and histograms produced by one replication
+class LearnReplicationResult
+{
+  public:
+	//set counter name of this replication
+	void SetCounter(std::string name, double value);
+	//add value to counter name, starting from 0
+	void AddCounter(std::string name, double value);
+	//histogram name of this replication, created empty on first use
+	LearnHistogram &GetHistogram(std::string name);
+
+	const std::map<std::string, double> &GetCounters(void) const;
+
+	const std::map<std::string, LearnHistogram> &GetHistograms(void) const;
+	//binary form sent from the workers to the runner
+	void Serialize(std::ostream &os) const;
+	void Deserialize(std::istream &is);
+
+  private:
+	std::map<std::string, double> m_counters;
+	std::map<std::string, LearnHistogram> m_histograms;
+};
+
+//run independent replications of a scenario, each in a fresh process forked for it with its own RNG run, and merge
+//their results; a replication matches a run of the scenario with RngRun firstRun + index from the same state
+class LearnReplicationRunner
+{
+  public:
+	//build and run one replication, fill in its results; the runner destroys the simulator afterwards
+	typedef Callback<void, uint32_t, LearnReplicationResult *> Scenario;
+
+	LearnReplicationRunner();
+	//replications run at once, 0 for one per online core
+	void SetWorkers(uint32_t n);
+	//RNG run of replication 0, replication i uses run firstRun + i
+	void SetFirstRun(uint64_t run);
+	//confidence level of the intervals, in (0, 1)
+	void SetConfidence(double level);
+	//print progress to std::cerr while running
+	void SetProgress(bool progress);
+	//run nReplications of scenario and merge their results
+	void Run(uint32_t nReplications, Scenario scenario);
+
+	uint32_t GetNReplications(void) const;
+	//mean of counter name over the replications
+	double GetMean(std::string name) const;
+	//sample standard deviation of counter name over the replications
+	double GetStdDev(std::string name) const;
+	//half width of the confidence interval of the mean of counter name
+	double GetHalfWidth(std::string name) const;
+	//histogram name merged over the replications
+	const LearnHistogram &GetHistogram(std::string name) const;
+	//one line per counter with its confidence interval, then the merged histograms
+	void Print(std::ostream &os) const;
+
+  private:
+	//body of the process of replication index: run it and write its results to resultFd
+	void RunReplication(uint32_t index, int resultFd, Scenario scenario);
+	//merge the results of one replication
+	void Merge(const LearnReplicationResult &result);
+	//running mean and sum of squared deviations of a counter
+	struct CounterStats
+	{
+		uint32_t n;
+		double mean;
+		double m2;
+	};
+	const CounterStats &FindCounter(std::string name) const;
+	uint32_t m_workers;
+	uint64_t m_firstRun;
+	double m_confidence;
+	bool m_progress;
+	uint32_t m_nReplications;
+	std::map<std::string, CounterStats> m_counters;
+	std::map<std::string, LearnHistogram> m_histograms;
+};
+
+} // namespace ns3
+
+#endif /* LEARN_REPLICATION_H */
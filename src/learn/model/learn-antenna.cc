@@ -0,0 +1,89 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include "ns3/abort.h"
+#include "ns3/log.h"
+#include "learn-antenna.h"
+
+namespace ns3
+{
+NS_LOG_COMPONENT_DEFINE("LearnAntenna");
+
+LearnAntennaPattern::LearnAntennaPattern(uint32_t nAzimuth, uint32_t nElevation, const std::vector<double> &gains)
+	: m_nAzimuth(nAzimuth), m_nElevation(nElevation), m_gains(gains)
+{
+	Check();
+}
+
+LearnAntennaPattern::LearnAntennaPattern(std::string filename)
+	: m_nAzimuth(0), m_nElevation(0)
+{
+	NS_LOG_FUNCTION(this << filename);
+	std::ifstream is(filename.c_str());
+	NS_ABORT_MSG_IF(!is, "Cannot open antenna pattern " << filename);
+	std::string line;
+	std::ostringstream values;
+	while (std::getline(is, line))
+	{
+		std::string::size_type start = line.find_first_not_of(" \t");
+		if (start != std::string::npos && line[start] != '#')
+		{
+			values << line << " ";
+		}
+	}
+	std::istringstream vs(values.str());
+	vs >> m_nAzimuth >> m_nElevation;
+	double g;
+	while (vs >> g)
+	{
+		m_gains.push_back(g);
+	}
+	NS_ABORT_MSG_IF(!vs.eof(), "Bad value in antenna pattern " << filename);
+	Check();
+}
+
+void LearnAntennaPattern::Check(void) const
+{
+	NS_ABORT_MSG_IF(m_nAzimuth < 2 || m_nElevation < 1, "An antenna pattern needs at least 2 azimuth points");
+	NS_ABORT_MSG_IF(m_gains.size() != static_cast<std::size_t>(m_nAzimuth) * m_nElevation,
+					"Antenna pattern has " << m_gains.size() << " gains for a " << m_nAzimuth << " x " << m_nElevation
+										   << " grid");
+}
+
+double
+LearnAntennaPattern::GetGain(double azimuth, double elevation) const
+{
+	double fa = (azimuth + 180) / 360 * (m_nAzimuth - 1);
+	fa = std::min(std::max(fa, 0.0), static_cast<double>(m_nAzimuth - 1));
+	uint32_t a0 = std::min(static_cast<uint32_t>(fa), m_nAzimuth - 2);
+	double ta = fa - a0;
+	const double *row = &m_gains[0];
+	if (m_nElevation == 1)
+	{
+		return (1 - ta) * row[a0] + ta * row[a0 + 1];
+	}
+	double fe = (elevation + 90) / 180 * (m_nElevation - 1);
+	fe = std::min(std::max(fe, 0.0), static_cast<double>(m_nElevation - 1));
+	uint32_t e0 = std::min(static_cast<uint32_t>(fe), m_nElevation - 2);
+	double te = fe - e0;
+	const double *low = row + e0 * m_nAzimuth;
+	const double *high = low + m_nAzimuth;
+	return (1 - te) * ((1 - ta) * low[a0] + ta * low[a0 + 1]) + te * ((1 - ta) * high[a0] + ta * high[a0 + 1]);
+}
+
+uint32_t
+LearnAntennaPattern::GetNAzimuth(void) const
+{
+	return m_nAzimuth;
+}
+
+uint32_t
+LearnAntennaPattern::GetNElevation(void) const
+{
+	return m_nElevation;
+}
+
+} // namespace ns3
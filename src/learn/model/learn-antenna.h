@@ -0,0 +1,52 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef LEARN_ANTENNA_H
+#define LEARN_ANTENNA_H
+
+#include <string>
+#include <vector>
+#include "ns3/simple-ref-count.h"
+
+namespace ns3
+{
+
+//
+// Antenna gain tabulated on an azimuth x elevation grid, looked up with
+// bilinear interpolation. Azimuth points are evenly spaced over [-180, 180]
+// degrees, both ends included, and elevation points over [-90, 90]. With a
+// single elevation point the pattern only depends on azimuth.
+//
+// Text file format, '#' starts a comment line:
+//
+//   nAzimuth nElevation
+//   gain(el0, az0) gain(el0, az1) ... gain(el0, azN)
+//   ...
+//   gain(elM, az0) ... gain(elM, azN)
+//
+// Gains are in dBi, in the antenna frame: azimuth 0 and elevation 0 point
+// along the boresight.
+//
+class LearnAntennaPattern : public SimpleRefCount<LearnAntennaPattern>
+{
+  public:
+	//pattern from gains in dBi, by elevation row then azimuth
+	LearnAntennaPattern(uint32_t nAzimuth, uint32_t nElevation, const std::vector<double> &gains);
+	//load a pattern file
+	LearnAntennaPattern(std::string filename);
+	//gain in dBi toward azimuth in [-180, 180] and elevation in [-90, 90] degrees, antenna frame
+	double GetGain(double azimuth, double elevation) const;
+
+	uint32_t GetNAzimuth(void) const;
+
+	uint32_t GetNElevation(void) const;
+
+  private:
+	void Check(void) const;
+	uint32_t m_nAzimuth;
+	uint32_t m_nElevation;
+	//gains by elevation row then azimuth
+	std::vector<double> m_gains;
+};
+
+} // namespace ns3
+
+#endif /* LEARN_ANTENNA_H */
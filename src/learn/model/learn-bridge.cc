@@ -0,0 +1,388 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "ns3/abort.h"
+#include "ns3/log.h"
+#include "ns3/global-value.h"
+#include "ns3/string.h"
+#include "ns3/uinteger.h"
+#include "ns3/simulator.h"
+#include "ns3/node.h"
+#include "ns3/packet.h"
+#include "ns3/mac48-address.h"
+#include "learn.h"
+#include "learn-bridge.h"
+
+namespace ns3
+{
+NS_LOG_COMPONENT_DEFINE("LearnBridge");
+
+NS_OBJECT_ENSURE_REGISTERED(LearnSocketBridge);
+
+namespace
+{
+//destination, source and protocol
+const uint32_t HEADER_SIZE = 14;
+//a batch read from the socket: arrival time in ns and number of frames,
+//then one slot per frame of its length and its bytes
+const uint32_t BATCH_HEADER_SIZE = sizeof(uint64_t) + sizeof(uint32_t);
+//slot length of a datagram longer than the slot, counted as dropped by the simulation
+const uint32_t TRUNCATED = ~static_cast<uint32_t>(0);
+
+uint64_t NowNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+} // namespace
+
+LearnSocketBridge::Reader::Reader(uint32_t maxBatch, uint32_t slotSize)
+	: m_maxBatch(maxBatch), m_slotSize(slotSize), m_msgs(maxBatch), m_iov(maxBatch)
+{
+}
+
+//
+// Runs in the reader thread once the socket is readable, and takes every
+// datagram already queued, up to a batch, in one system call. The frames land
+// in their slots of the buffer handed to the simulation; nothing is copied
+// until the packets are built.
+//
+FdReader::Data
+LearnSocketBridge::Reader::DoRead(void)
+{
+	uint32_t stride = sizeof(uint32_t) + m_slotSize;
+	uint8_t *buf = static_cast<uint8_t *>(malloc(BATCH_HEADER_SIZE + m_maxBatch * stride));
+	NS_ABORT_MSG_IF(buf == 0, "LearnSocketBridge: out of memory");
+	for (uint32_t k = 0; k < m_maxBatch; ++k)
+	{
+		memset(&m_msgs[k], 0, sizeof(m_msgs[k]));
+		m_iov[k].iov_base = buf + BATCH_HEADER_SIZE + k * stride + sizeof(uint32_t);
+		m_iov[k].iov_len = m_slotSize;
+		m_msgs[k].msg_hdr.msg_iov = &m_iov[k];
+		m_msgs[k].msg_hdr.msg_iovlen = 1;
+	}
+	int n = recvmmsg(m_fd, &m_msgs[0], m_maxBatch, MSG_DONTWAIT, 0);
+	if (n < 0 && (errno == EAGAIN || errno == EINTR))
+	{
+		free(buf);
+		return FdReader::Data(0, -1);
+	}
+	//
+	// Bridge frames are never empty, so an empty datagram is the end of a
+	// SOCK_SEQPACKET connection.
+	//
+	if (n <= 0 || m_msgs[0].msg_len == 0)
+	{
+		NS_LOG_INFO("LearnSocketBridge: socket closed");
+		free(buf);
+		return FdReader::Data(0, 0);
+	}
+	uint64_t arrival = NowNs();
+	uint32_t count = n;
+	memcpy(buf, &arrival, sizeof(arrival));
+	memcpy(buf + sizeof(arrival), &count, sizeof(count));
+	for (uint32_t k = 0; k < count; ++k)
+	{
+		uint32_t len = (m_msgs[k].msg_hdr.msg_flags & MSG_TRUNC) ? TRUNCATED : m_msgs[k].msg_len;
+		memcpy(buf + BATCH_HEADER_SIZE + k * stride, &len, sizeof(len));
+	}
+	return FdReader::Data(buf, BATCH_HEADER_SIZE + count * stride);
+}
+
+TypeId
+LearnSocketBridge::GetTypeId(void)
+{
+	static TypeId tid =
+		TypeId("ns3::LearnSocketBridge")
+			.SetParent<Object>()
+			.SetGroupName("Learn")
+			.AddConstructor<LearnSocketBridge>()
+			.AddAttribute("MaxBatch", "Most frames read or written in one system call",
+						  UintegerValue(64), MakeUintegerAccessor(&LearnSocketBridge::m_maxBatch),
+						  MakeUintegerChecker<uint32_t>(1, 1024));
+	return tid;
+}
+
+LearnSocketBridge::LearnSocketBridge()
+	: m_nodeId(0), m_fd(-1), m_maxBatch(64), m_nPending(0), m_wallStart(0), m_nFramesIn(0), m_nFramesOut(0),
+	  m_nBatchesIn(0), m_nBatchesOut(0), m_nDropped(0)
+{
+	NS_LOG_FUNCTION(this);
+}
+
+LearnSocketBridge::~LearnSocketBridge()
+{
+	NS_LOG_FUNCTION(this);
+}
+
+void LearnSocketBridge::DoDispose(void)
+{
+	NS_LOG_FUNCTION(this);
+	Stop();
+	if (m_fd >= 0)
+	{
+		close(m_fd);
+		m_fd = -1;
+	}
+	m_device = 0;
+	Object::DoDispose();
+}
+
+void LearnSocketBridge::Attach(Ptr<LearnNetDevice> device, int fd)
+{
+	NS_LOG_FUNCTION(this << device << fd);
+	StringValue impl;
+	GlobalValue::GetValueByName("SimulatorImplementationType", impl);
+	NS_ABORT_MSG_IF(impl.Get() != "ns3::RealtimeSimulatorImpl",
+					"LearnSocketBridge needs SimulatorImplementationType=ns3::RealtimeSimulatorImpl");
+	NS_ABORT_MSG_IF(m_device != 0, "LearnSocketBridge is already attached");
+	m_device = device;
+	m_nodeId = device->GetNode()->GetId();
+	m_fd = fd;
+	device->SetPromiscReceiveCallback(MakeCallback(&LearnSocketBridge::FromDevice, this));
+	Simulator::ScheduleNow(&LearnSocketBridge::Start, this);
+}
+
+void LearnSocketBridge::Connect(Ptr<LearnNetDevice> device, std::string path)
+{
+	NS_LOG_FUNCTION(this << device << path);
+	int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	NS_ABORT_MSG_IF(fd < 0, "LearnSocketBridge: socket failed: " << strerror(errno));
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	NS_ABORT_MSG_IF(path.size() >= sizeof(addr.sun_path), "LearnSocketBridge: socket path too long");
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+	NS_ABORT_MSG_IF(connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0,
+					"LearnSocketBridge: cannot connect to " << path << ": " << strerror(errno));
+	Attach(device, fd);
+}
+
+void LearnSocketBridge::Start(void)
+{
+	NS_LOG_FUNCTION(this);
+	m_wallStart = NowNs();
+	m_simStart = Simulator::Now();
+	m_reader = Create<Reader>(m_maxBatch, m_device->GetMtu() + HEADER_SIZE);
+	m_reader->Start(m_fd, MakeCallback(&LearnSocketBridge::ReadCallback, this));
+}
+
+void LearnSocketBridge::Stop(void)
+{
+	NS_LOG_FUNCTION(this);
+	if (m_reader != 0)
+	{
+		m_reader->Stop();
+		m_reader = 0;
+	}
+}
+
+void LearnSocketBridge::ReadCallback(uint8_t *buf, ssize_t len)
+{
+	//
+	// Reader thread. The realtime simulator takes events from other threads
+	// and runs them as soon as it can.
+	//
+	Simulator::ScheduleWithContext(m_nodeId, Seconds(0), &LearnSocketBridge::ForwardBatch, this, buf);
+}
+
+Time LearnSocketBridge::GetLag(uint64_t wallNs, Time simTime) const
+{
+	return NanoSeconds(static_cast<int64_t>(wallNs - m_wallStart)) - (simTime - m_simStart);
+}
+
+void LearnSocketBridge::ForwardBatch(uint8_t *buf)
+{
+	NS_LOG_FUNCTION(this);
+	//
+	// The reader may have queued a batch just before the bridge was disposed.
+	//
+	if (m_device == 0)
+	{
+		free(buf);
+		return;
+	}
+	uint64_t arrival;
+	uint32_t count;
+	memcpy(&arrival, buf, sizeof(arrival));
+	memcpy(&count, buf + sizeof(arrival), sizeof(count));
+	Time lag = GetLag(arrival, Simulator::Now());
+	uint32_t stride = sizeof(uint32_t) + m_device->GetMtu() + HEADER_SIZE;
+	++m_nBatchesIn;
+	for (uint32_t k = 0; k < count; ++k)
+	{
+		const uint8_t *slot = buf + BATCH_HEADER_SIZE + k * stride;
+		uint32_t len;
+		memcpy(&len, slot, sizeof(len));
+		const uint8_t *frame = slot + sizeof(len);
+		if (len == TRUNCATED)
+		{
+			NS_LOG_WARN("LearnSocketBridge: dropping a frame longer than the MTU");
+			++m_nDropped;
+			continue;
+		}
+		if (len < HEADER_SIZE)
+		{
+			NS_LOG_WARN("LearnSocketBridge: dropping a runt frame of " << len << " bytes");
+			++m_nDropped;
+			continue;
+		}
+		Mac48Address dst;
+		Mac48Address src;
+		dst.CopyFrom(frame);
+		src.CopyFrom(frame + 6);
+		uint16_t protocol = (frame[12] << 8) | frame[13];
+		m_inboundLag.Add(lag);
+		++m_nFramesIn;
+		m_device->SendFrom(Create<Packet>(frame + HEADER_SIZE, len - HEADER_SIZE), src, dst, protocol);
+	}
+	free(buf);
+}
+
+bool LearnSocketBridge::FromDevice(Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol,
+								   const Address &from, const Address &to, NetDevice::PacketType packetType)
+{
+	NS_LOG_FUNCTION(this << packet << protocol);
+	if (packetType == NetDevice::PACKET_OTHERHOST || m_fd < 0)
+	{
+		return true;
+	}
+	if (m_nPending == m_pending.size())
+	{
+		m_pending.push_back(Frame());
+	}
+	Frame &frame = m_pending[m_nPending];
+	Mac48Address::ConvertFrom(to).CopyTo(frame.header);
+	Mac48Address::ConvertFrom(from).CopyTo(frame.header + 6);
+	frame.header[12] = protocol >> 8;
+	frame.header[13] = protocol & 0xff;
+	frame.payload.resize(packet->GetSize());
+	if (!frame.payload.empty())
+	{
+		packet->CopyData(&frame.payload[0], frame.payload.size());
+	}
+	frame.simTime = Simulator::Now();
+	//
+	// Frames received at the same time leave in one batch, written once the
+	// events already due now have run.
+	//
+	if (m_nPending++ == 0)
+	{
+		Simulator::ScheduleNow(&LearnSocketBridge::Flush, this);
+	}
+	if (m_nPending == m_maxBatch)
+	{
+		Flush();
+	}
+	return true;
+}
+
+void LearnSocketBridge::Flush(void)
+{
+	if (m_nPending == 0)
+	{
+		return;
+	}
+	NS_LOG_FUNCTION(this << m_nPending);
+	std::vector<struct mmsghdr> msgs(m_nPending);
+	std::vector<struct iovec> iov(2 * m_nPending);
+	for (uint32_t k = 0; k < m_nPending; ++k)
+	{
+		Frame &frame = m_pending[k];
+		iov[2 * k].iov_base = frame.header;
+		iov[2 * k].iov_len = HEADER_SIZE;
+		iov[2 * k + 1].iov_base = frame.payload.empty() ? 0 : &frame.payload[0];
+		iov[2 * k + 1].iov_len = frame.payload.size();
+		memset(&msgs[k], 0, sizeof(msgs[k]));
+		msgs[k].msg_hdr.msg_iov = &iov[2 * k];
+		msgs[k].msg_hdr.msg_iovlen = 2;
+	}
+	uint32_t sent = 0;
+	while (sent < m_nPending)
+	{
+		int n = sendmmsg(m_fd, &msgs[sent], m_nPending - sent, 0);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			NS_LOG_WARN("LearnSocketBridge: write failed: " << strerror(errno));
+			m_nDropped += m_nPending - sent;
+			break;
+		}
+		sent += n;
+	}
+	uint64_t wall = NowNs();
+	for (uint32_t k = 0; k < sent; ++k)
+	{
+		m_outboundLag.Add(GetLag(wall, m_pending[k].simTime));
+	}
+	++m_nBatchesOut;
+	m_nFramesOut += sent;
+	m_nPending = 0;
+}
+
+uint64_t
+LearnSocketBridge::GetNFramesIn(void) const
+{
+	return m_nFramesIn;
+}
+
+uint64_t
+LearnSocketBridge::GetNFramesOut(void) const
+{
+	return m_nFramesOut;
+}
+
+uint64_t
+LearnSocketBridge::GetNBatchesIn(void) const
+{
+	return m_nBatchesIn;
+}
+
+uint64_t
+LearnSocketBridge::GetNBatchesOut(void) const
+{
+	return m_nBatchesOut;
+}
+
+uint64_t
+LearnSocketBridge::GetNDropped(void) const
+{
+	return m_nDropped;
+}
+
+const LearnHistogram &
+LearnSocketBridge::GetInboundLag(void) const
+{
+	return m_inboundLag;
+}
+
+const LearnHistogram &
+LearnSocketBridge::GetOutboundLag(void) const
+{
+	return m_outboundLag;
+}
+
+void LearnSocketBridge::PrintStats(std::ostream &os) const
+{
+	os << "frames in=" << m_nFramesIn << " out=" << m_nFramesOut << " dropped=" << m_nDropped
+	   << " batches in=" << m_nBatchesIn << " out=" << m_nBatchesOut << std::endl;
+	os << "inbound lag ";
+	m_inboundLag.Print(os);
+	os << " jitter(p99-p50)=" << (m_inboundLag.GetPercentile(0.99) - m_inboundLag.GetPercentile(0.5)).GetSeconds()
+	   << "s" << std::endl;
+	os << "outbound lag ";
+	m_outboundLag.Print(os);
+	os << " jitter(p99-p50)=" << (m_outboundLag.GetPercentile(0.99) - m_outboundLag.GetPercentile(0.5)).GetSeconds()
+	   << "s" << std::endl;
+}
+
+} // namespace ns3
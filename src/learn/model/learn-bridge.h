@@ -0,0 +1,130 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef LEARN_BRIDGE_H
+#define LEARN_BRIDGE_H
+
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "ns3/object.h"
+#include "ns3/ptr.h"
+#include "ns3/nstime.h"
+#include "ns3/net-device.h"
+#include "ns3/unix-fd-reader.h"
+#include "learn-stats.h"
+
+namespace ns3
+{
+
+class LearnNetDevice;
+class Packet;
+
+//
+// Bridge between a LearnNetDevice and a local process over a Unix
+// SOCK_SEQPACKET or SOCK_DGRAM socket, such as one end of a socketpair. Each
+// datagram is one frame: destination MAC, source MAC, protocol in network
+// order (an Ethernet II header), then the payload.
+//
+// Frames from the socket are sent by the device with SendFrom, frames the
+// device receives for itself or a group are written to the socket. Both ways
+// move frames in batches, one recvmmsg or sendmmsg per batch, and the header
+// and the payload are gathered from separate buffers.
+//
+// The bridge needs the RealtimeSimulatorImpl. It records, for each frame, how
+// far the wall clock is ahead of simulated time when the frame crosses.
+//
+class LearnSocketBridge : public Object
+{
+  public:
+	static TypeId GetTypeId(void);
+
+	LearnSocketBridge();
+
+	virtual ~LearnSocketBridge();
+	//bridge device to socket fd, the bridge closes fd when disposed
+	void Attach(Ptr<LearnNetDevice> device, int fd);
+	//bridge device to the Unix socket bound at path
+	void Connect(Ptr<LearnNetDevice> device, std::string path);
+	//stop reading the socket
+	void Stop(void);
+	//frames moved from the socket to the device, and the other way
+	uint64_t GetNFramesIn(void) const;
+
+	uint64_t GetNFramesOut(void) const;
+	//batches read from and written to the socket
+	uint64_t GetNBatchesIn(void) const;
+
+	uint64_t GetNBatchesOut(void) const;
+	//frames that could not be written to the socket, or came from it longer than the MTU or shorter than a header
+	uint64_t GetNDropped(void) const;
+	//wall clock lead over simulated time when a frame came from the socket
+	const LearnHistogram &GetInboundLag(void) const;
+	//wall clock lead over simulated time when a frame went to the socket
+	const LearnHistogram &GetOutboundLag(void) const;
+	//frame and batch counts and the lag distributions
+	void PrintStats(std::ostream &os) const;
+
+  protected:
+	virtual void DoDispose(void);
+
+  private:
+	//reads a batch of datagrams per wakeup
+	class Reader : public FdReader
+	{
+	  public:
+		Reader(uint32_t maxBatch, uint32_t slotSize);
+
+	  private:
+		virtual FdReader::Data DoRead(void);
+		uint32_t m_maxBatch;
+		uint32_t m_slotSize;
+		std::vector<struct mmsghdr> m_msgs;
+		std::vector<struct iovec> m_iov;
+	};
+	//take the wall clock and simulated time origins and start reading
+	void Start(void);
+	//reader thread: hand a batch over to the simulation
+	void ReadCallback(uint8_t *buf, ssize_t len);
+	//send the frames of a batch read from the socket, frees buf
+	void ForwardBatch(uint8_t *buf);
+	//promiscuous receive callback of the device
+	bool FromDevice(Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address &from,
+					const Address &to, NetDevice::PacketType packetType);
+	//write the pending frames to the socket
+	void Flush(void);
+	//lead of wall clock time wallNs over simulated time simTime, both since Start
+	Time GetLag(uint64_t wallNs, Time simTime) const;
+
+	Ptr<LearnNetDevice> m_device;
+	//node of the device, the context of the events scheduled by the reader thread
+	uint32_t m_nodeId;
+	int m_fd;
+	Ptr<Reader> m_reader;
+	uint32_t m_maxBatch;
+	//frames waiting for the next Flush: header and payload
+	struct Frame
+	{
+		uint8_t header[14];
+		std::vector<uint8_t> payload;
+		Time simTime;
+	};
+	std::vector<Frame> m_pending;
+	//frames of m_pending in use, the vector keeps its buffers between batches
+	uint32_t m_nPending;
+	//origins of the lag measurement
+	uint64_t m_wallStart;
+	Time m_simStart;
+	uint64_t m_nFramesIn;
+	uint64_t m_nFramesOut;
+	uint64_t m_nBatchesIn;
+	uint64_t m_nBatchesOut;
+	uint64_t m_nDropped;
+	LearnHistogram m_inboundLag;
+	LearnHistogram m_outboundLag;
+};
+
+} // namespace ns3
+
+#endif /* LEARN_BRIDGE_H */
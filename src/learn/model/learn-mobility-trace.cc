@@ -0,0 +1,446 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ns3/abort.h"
+#include "ns3/assert.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/net-device-container.h"
+#include "learn.h"
+#include "learn-mobility-trace.h"
+#include "learn-profiler.h"
+
+namespace ns3
+{
+NS_LOG_COMPONENT_DEFINE("LearnMobilityTrace");
+
+NS_OBJECT_ENSURE_REGISTERED(LearnMobilityTracePlayer);
+
+namespace
+{
+const char MOBILITY_MAGIC[8] = {'L', 'R', 'N', 'M', 'O', 'B', 'I', '1'};
+const uint32_t MOBILITY_VERSION = 1;
+
+//a waypoint of a node, as collected by the converters before sorting
+struct NodeWaypoint
+{
+	uint64_t node;
+	LearnWaypoint waypoint;
+};
+
+bool WaypointBefore(const NodeWaypoint &a, const NodeWaypoint &b)
+{
+	return a.node < b.node || (a.node == b.node && a.waypoint.time < b.waypoint.time);
+}
+
+//
+// Group the waypoints by node, sorted by time, and write the file. Equal
+// times keep the order in which they were read.
+//
+void WriteTrace(std::vector<NodeWaypoint> &waypoints, uint64_t nNodes, std::string filename)
+{
+	std::stable_sort(waypoints.begin(), waypoints.end(), WaypointBefore);
+	std::ofstream os(filename.c_str(), std::ios::binary);
+	NS_ABORT_MSG_IF(!os, "Cannot open " << filename);
+	LearnMobilityTraceHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MOBILITY_MAGIC, sizeof(MOBILITY_MAGIC));
+	header.version = MOBILITY_VERSION;
+	header.nNodes = nNodes;
+	header.nWaypoints = waypoints.size();
+	os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	std::size_t k = 0;
+	for (uint64_t node = 0; node < nNodes; ++node)
+	{
+		LearnMobilityTraceNode entry;
+		entry.first = k;
+		while (k < waypoints.size() && waypoints[k].node == node)
+		{
+			++k;
+		}
+		entry.count = k - entry.first;
+		os.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+	}
+	for (k = 0; k < waypoints.size(); ++k)
+	{
+		os.write(reinterpret_cast<const char *>(&waypoints[k].waypoint), sizeof(LearnWaypoint));
+	}
+	NS_ABORT_MSG_IF(!os, "Failed to write " << filename);
+	NS_LOG_INFO("Wrote " << nNodes << " nodes and " << waypoints.size() << " waypoints");
+}
+
+//an ns-2 setdest: from time on, head for x, y at speed
+struct SetDest
+{
+	double time;
+	double x;
+	double y;
+	double speed;
+};
+
+bool SetDestBefore(const SetDest &a, const SetDest &b)
+{
+	return a.time < b.time;
+}
+
+//
+// Turn the setdest commands of one node into waypoints. A node moves in a
+// straight line until it reaches its destination or a new setdest stops it
+// where it is and sends it elsewhere.
+//
+void AddNs2Node(uint64_t node, const double *start, std::vector<SetDest> &moves, std::vector<NodeWaypoint> &waypoints)
+{
+	std::stable_sort(moves.begin(), moves.end(), SetDestBefore);
+	NodeWaypoint w;
+	w.node = node;
+	w.waypoint.time = 0;
+	w.waypoint.x = start[0];
+	w.waypoint.y = start[1];
+	w.waypoint.z = start[2];
+	waypoints.push_back(w);
+	//position and time of the last waypoint, and the arrival of the current move
+	LearnWaypoint last = w.waypoint;
+	bool moving = false;
+	LearnWaypoint arrival = last;
+	for (std::size_t k = 0; k < moves.size(); ++k)
+	{
+		const SetDest &move = moves[k];
+		if (moving && arrival.time <= move.time)
+		{
+			w.waypoint = arrival;
+			waypoints.push_back(w);
+			last = arrival;
+			moving = false;
+		}
+		LearnWaypoint here = last;
+		here.time = move.time;
+		if (moving)
+		{
+			double f = (move.time - last.time) / (arrival.time - last.time);
+			here.x = last.x + f * (arrival.x - last.x);
+			here.y = last.y + f * (arrival.y - last.y);
+		}
+		if (here.time > last.time)
+		{
+			w.waypoint = here;
+			waypoints.push_back(w);
+		}
+		last = here;
+		double dist = std::sqrt((move.x - here.x) * (move.x - here.x) + (move.y - here.y) * (move.y - here.y));
+		moving = move.speed > 0 && dist > 0;
+		if (moving)
+		{
+			arrival = here;
+			arrival.time = move.time + dist / move.speed;
+			arrival.x = move.x;
+			arrival.y = move.y;
+		}
+	}
+	if (moving)
+	{
+		w.waypoint = arrival;
+		waypoints.push_back(w);
+	}
+}
+} // namespace
+
+LearnMobilityTrace::LearnMobilityTrace(std::string filename)
+	: m_map(MAP_FAILED), m_size(0), m_header(0), m_nodes(0), m_waypoints(0)
+{
+	NS_LOG_FUNCTION(this << filename);
+	int fd = open(filename.c_str(), O_RDONLY);
+	NS_ABORT_MSG_IF(fd < 0, "Cannot open mobility trace " << filename);
+	struct stat st;
+	NS_ABORT_MSG_IF(fstat(fd, &st) != 0, "Cannot stat mobility trace " << filename);
+	m_size = st.st_size;
+	NS_ABORT_MSG_IF(m_size < sizeof(LearnMobilityTraceHeader), "Mobility trace " << filename << " is truncated");
+
+	//
+	// Nothing is read here but the node table. Playback touches one page per
+	// node at a time, spread over the file, so no read ahead is advised.
+	//
+	m_map = mmap(0, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	NS_ABORT_MSG_IF(m_map == MAP_FAILED, "Cannot map mobility trace " << filename);
+
+	const char *base = static_cast<const char *>(m_map);
+	m_header = reinterpret_cast<const LearnMobilityTraceHeader *>(base);
+	NS_ABORT_MSG_IF(memcmp(m_header->magic, MOBILITY_MAGIC, sizeof(MOBILITY_MAGIC)) != 0,
+					"Not a mobility trace " << filename);
+	NS_ABORT_MSG_IF(m_header->version != MOBILITY_VERSION,
+					"Unsupported mobility trace version " << m_header->version);
+	std::size_t room = m_size - sizeof(LearnMobilityTraceHeader);
+	NS_ABORT_MSG_IF(m_header->nNodes > room / sizeof(LearnMobilityTraceNode) ||
+						m_header->nWaypoints > (room - m_header->nNodes * sizeof(LearnMobilityTraceNode)) / sizeof(LearnWaypoint),
+					"Mobility trace " << filename << " is truncated");
+	m_nodes = reinterpret_cast<const LearnMobilityTraceNode *>(base + sizeof(LearnMobilityTraceHeader));
+	m_waypoints = reinterpret_cast<const LearnWaypoint *>(m_nodes + m_header->nNodes);
+	for (uint64_t i = 0; i < m_header->nNodes; ++i)
+	{
+		NS_ABORT_MSG_IF(m_nodes[i].first > m_header->nWaypoints || m_nodes[i].count > m_header->nWaypoints - m_nodes[i].first,
+						"Node " << i << " of mobility trace " << filename << " is out of range");
+	}
+	NS_LOG_INFO("Mapped " << m_header->nNodes << " nodes and " << m_header->nWaypoints << " waypoints");
+}
+
+LearnMobilityTrace::~LearnMobilityTrace()
+{
+	NS_LOG_FUNCTION(this);
+	if (m_map != MAP_FAILED)
+	{
+		munmap(m_map, m_size);
+	}
+}
+
+uint64_t
+LearnMobilityTrace::GetNNodes(void) const
+{
+	return m_header->nNodes;
+}
+
+uint64_t
+LearnMobilityTrace::GetNWaypoints(uint64_t node) const
+{
+	NS_ASSERT(node < m_header->nNodes);
+	return m_nodes[node].count;
+}
+
+const LearnWaypoint &
+LearnMobilityTrace::GetWaypoint(uint64_t node, uint64_t k) const
+{
+	NS_ASSERT(node < m_header->nNodes && k < m_nodes[node].count);
+	return m_waypoints[m_nodes[node].first + k];
+}
+
+//
+// Only whole pages before the one holding waypoint to are released. A page
+// shared with another node is read again from the page cache if that node
+// still needs it.
+//
+void LearnMobilityTrace::Release(uint64_t node, uint64_t from, uint64_t to)
+{
+	NS_ASSERT(node < m_header->nNodes && from <= to && to <= m_nodes[node].count);
+	static const uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+	uintptr_t begin = reinterpret_cast<uintptr_t>(m_waypoints + m_nodes[node].first + from) & ~(page - 1);
+	uintptr_t end = reinterpret_cast<uintptr_t>(m_waypoints + m_nodes[node].first + to) & ~(page - 1);
+	if (end > begin)
+	{
+		madvise(reinterpret_cast<void *>(begin), end - begin, MADV_DONTNEED);
+	}
+}
+
+void LearnMobilityTrace::ConvertNs2(std::string ns2, std::string filename)
+{
+	NS_LOG_FUNCTION(ns2 << filename);
+	std::ifstream is(ns2.c_str());
+	NS_ABORT_MSG_IF(!is, "Cannot open " << ns2);
+	std::vector<std::vector<SetDest>> moves;
+	std::vector<double> starts;
+	std::string line;
+	while (std::getline(is, line))
+	{
+		unsigned long node;
+		char axis;
+		double v;
+		SetDest move;
+		if (sscanf(line.c_str(), " $node_(%lu) set %c_ %lf", &node, &axis, &v) == 3)
+		{
+			NS_ABORT_MSG_IF(axis < 'X' || axis > 'Z', "Bad ns-2 line in " << ns2 << ": " << line);
+			if (node >= moves.size())
+			{
+				moves.resize(node + 1);
+				starts.resize(3 * (node + 1), 0);
+			}
+			starts[3 * node + axis - 'X'] = v;
+		}
+		else if (sscanf(line.c_str(), " $ns_ at %lf \"$node_(%lu) setdest %lf %lf %lf", &move.time, &node, &move.x,
+						&move.y, &move.speed) == 5)
+		{
+			if (node >= moves.size())
+			{
+				moves.resize(node + 1);
+				starts.resize(3 * (node + 1), 0);
+			}
+			moves[node].push_back(move);
+		}
+	}
+	std::vector<NodeWaypoint> waypoints;
+	for (uint64_t node = 0; node < moves.size(); ++node)
+	{
+		AddNs2Node(node, &starts[3 * node], moves[node], waypoints);
+		std::vector<SetDest>().swap(moves[node]);
+	}
+	WriteTrace(waypoints, moves.size(), filename);
+}
+
+void LearnMobilityTrace::ConvertCsv(std::string csv, std::string filename)
+{
+	NS_LOG_FUNCTION(csv << filename);
+	std::ifstream is(csv.c_str());
+	NS_ABORT_MSG_IF(!is, "Cannot open " << csv);
+	std::vector<NodeWaypoint> waypoints;
+	uint64_t nNodes = 0;
+	std::string line;
+	while (std::getline(is, line))
+	{
+		std::string::size_type start = line.find_first_not_of(" \t");
+		if (start == std::string::npos || line[start] == '#')
+		{
+			continue;
+		}
+		NodeWaypoint w;
+		unsigned long node;
+		w.waypoint.z = 0;
+		int n = sscanf(line.c_str(), "%lf ,%lu ,%lf ,%lf ,%lf", &w.waypoint.time, &node, &w.waypoint.x, &w.waypoint.y,
+					   &w.waypoint.z);
+		NS_ABORT_MSG_IF(n < 4, "Bad waypoint line in " << csv << ": " << line);
+		w.node = node;
+		nNodes = std::max<uint64_t>(nNodes, node + 1);
+		waypoints.push_back(w);
+	}
+	WriteTrace(waypoints, nNodes, filename);
+}
+
+/////////////////////////////////////////////////////////////
+
+TypeId
+LearnMobilityTracePlayer::GetTypeId(void)
+{
+	static TypeId tid = TypeId("ns3::LearnMobilityTracePlayer")
+							.SetParent<Object>()
+							.SetGroupName("Learn")
+							.AddConstructor<LearnMobilityTracePlayer>()
+							.AddAttribute("Interval", "Time between two position updates",
+										  TimeValue(MilliSeconds(100)),
+										  MakeTimeAccessor(&LearnMobilityTracePlayer::m_interval),
+										  MakeTimeChecker(TimeStep(1)));
+	return tid;
+}
+
+LearnMobilityTracePlayer::LearnMobilityTracePlayer()
+	: m_interval(MilliSeconds(100)), m_nMoves(0)
+{
+	NS_LOG_FUNCTION(this);
+}
+
+LearnMobilityTracePlayer::~LearnMobilityTracePlayer()
+{
+	NS_LOG_FUNCTION(this);
+}
+
+void LearnMobilityTracePlayer::SetTrace(Ptr<LearnMobilityTrace> trace)
+{
+	NS_LOG_FUNCTION(this << trace);
+	NS_ABORT_MSG_IF(!m_tracks.empty(), "Set the trace before adding devices");
+	m_trace = trace;
+}
+
+void LearnMobilityTracePlayer::Add(Ptr<LearnNetDevice> device, uint64_t node)
+{
+	NS_LOG_FUNCTION(this << device << node);
+	NS_ABORT_MSG_IF(m_trace == 0, "No mobility trace set");
+	NS_ABORT_MSG_IF(node >= m_trace->GetNNodes(), "Node " << node << " is not in the mobility trace");
+	Track track;
+	track.device = device;
+	track.node = node;
+	track.cursor = 0;
+	m_tracks.push_back(track);
+}
+
+void LearnMobilityTracePlayer::Add(const NetDeviceContainer &devices)
+{
+	for (uint32_t i = 0; i < devices.GetN(); ++i)
+	{
+		Ptr<LearnNetDevice> device = DynamicCast<LearnNetDevice>(devices.Get(i));
+		NS_ABORT_MSG_IF(device == 0, "Device " << i << " is not a LearnNetDevice");
+		Add(device, i);
+	}
+}
+
+void LearnMobilityTracePlayer::Start(void)
+{
+	NS_LOG_FUNCTION(this);
+	m_event.Cancel();
+	Update();
+}
+
+uint64_t
+LearnMobilityTracePlayer::GetNMoves(void) const
+{
+	return m_nMoves;
+}
+
+void LearnMobilityTracePlayer::DoDispose(void)
+{
+	NS_LOG_FUNCTION(this);
+	m_event.Cancel();
+	m_tracks.clear();
+	m_trace = 0;
+	Object::DoDispose();
+}
+
+//
+// Devices that did not move are not notified, so the channel's link caches
+// of a parked device stay valid.
+//
+void LearnMobilityTracePlayer::Update(void)
+{
+	LEARN_PROFILE_SCOPE("LearnMobilityTracePlayer::Update");
+	double now = Simulator::Now().GetSeconds();
+	bool moving = false;
+	for (std::size_t k = 0; k < m_tracks.size(); ++k)
+	{
+		Track &track = m_tracks[k];
+		uint64_t n = m_trace->GetNWaypoints(track.node);
+		if (n == 0)
+		{
+			continue;
+		}
+		uint64_t c = track.cursor;
+		while (c + 1 < n && m_trace->GetWaypoint(track.node, c + 1).time <= now)
+		{
+			++c;
+		}
+		if (c != track.cursor)
+		{
+			m_trace->Release(track.node, track.cursor, c);
+			track.cursor = c;
+		}
+		const LearnWaypoint &a = m_trace->GetWaypoint(track.node, c);
+		double x = a.x;
+		double y = a.y;
+		double z = a.z;
+		if (c + 1 < n)
+		{
+			moving = true;
+			if (now > a.time)
+			{
+				const LearnWaypoint &b = m_trace->GetWaypoint(track.node, c + 1);
+				double f = (now - a.time) / (b.time - a.time);
+				x += f * (b.x - a.x);
+				y += f * (b.y - a.y);
+				z += f * (b.z - a.z);
+			}
+		}
+		if (x != track.device->GetX() || y != track.device->GetY() || z != track.device->GetZ())
+		{
+			track.device->SetXYZ(x, y, z);
+			++m_nMoves;
+		}
+	}
+	if (moving)
+	{
+		m_event = Simulator::Schedule(m_interval, &LearnMobilityTracePlayer::Update, this);
+	}
+}
+
+} // namespace ns3
@@ -0,0 +1,139 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef LEARN_MOBILITY_TRACE_H
+#define LEARN_MOBILITY_TRACE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "ns3/simple-ref-count.h"
+#include "ns3/object.h"
+#include "ns3/ptr.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+
+namespace ns3
+{
+
+class LearnNetDevice;
+class NetDeviceContainer;
+
+//
+// Binary mobility trace file, native endian, all records 8 byte aligned:
+//
+//   LearnMobilityTraceHeader
+//   LearnMobilityTraceNode x nNodes
+//   LearnWaypoint x nWaypoints
+//
+// The waypoints of a node are contiguous and sorted by time, so playing a
+// node reads its part of the file front to back.
+//
+struct LearnMobilityTraceHeader
+{
+	//"LRNMOBI1"
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint64_t nNodes;
+	uint64_t nWaypoints;
+};
+
+struct LearnMobilityTraceNode
+{
+	//index of the node's first waypoint, and how many it has
+	uint64_t first;
+	uint64_t count;
+};
+
+struct LearnWaypoint
+{
+	//seconds
+	double time;
+	double x;
+	double y;
+	double z;
+};
+
+//read-only view of a mobility trace file mapped in memory, waypoints are read in place
+class LearnMobilityTrace : public SimpleRefCount<LearnMobilityTrace>
+{
+  public:
+	//map the mobility trace file
+	LearnMobilityTrace(std::string filename);
+	~LearnMobilityTrace();
+
+	uint64_t GetNNodes(void) const;
+	//waypoints of node
+	uint64_t GetNWaypoints(uint64_t node) const;
+
+	const LearnWaypoint &GetWaypoint(uint64_t node, uint64_t k) const;
+	//hand the pages holding waypoints from to to of node back to the kernel, they are read again if needed
+	void Release(uint64_t node, uint64_t from, uint64_t to);
+	//convert an ns-2 movement file, "$node_(i) set X_ x" and "$ns_ at t "$node_(i) setdest x y speed"" lines
+	static void ConvertNs2(std::string ns2, std::string filename);
+	//convert "time,node,x,y[,z]" lines, such as a SUMO FCD output exported to csv
+	static void ConvertCsv(std::string csv, std::string filename);
+
+  private:
+	LearnMobilityTrace &operator=(const LearnMobilityTrace &o);
+	LearnMobilityTrace(const LearnMobilityTrace &o);
+	//mapped file
+	void *m_map;
+	//size of the mapping
+	std::size_t m_size;
+	//views into the mapping
+	const LearnMobilityTraceHeader *m_header;
+	const LearnMobilityTraceNode *m_nodes;
+	const LearnWaypoint *m_waypoints;
+};
+
+//
+// Moves LearnNetDevices along the nodes of a mobility trace. One event per
+// Interval samples every device's position, linear between waypoints. Each
+// device keeps a cursor into its waypoints, so an update only reads the
+// waypoints passed since the last one, and the pages behind the cursors are
+// released: memory stays bounded by the number of devices, not by the
+// length of the trace.
+//
+class LearnMobilityTracePlayer : public Object
+{
+  public:
+	static TypeId GetTypeId(void);
+
+	LearnMobilityTracePlayer();
+
+	virtual ~LearnMobilityTracePlayer();
+	//trace to play
+	void SetTrace(Ptr<LearnMobilityTrace> trace);
+	//move device along node of the trace
+	void Add(Ptr<LearnNetDevice> device, uint64_t node);
+	//move the i-th device of devices along node i of the trace
+	void Add(const NetDeviceContainer &devices);
+	//place the devices and start playing at the current time
+	void Start(void);
+	//position changes handed to the devices
+	uint64_t GetNMoves(void) const;
+
+  protected:
+	virtual void DoDispose(void);
+
+  private:
+	//sample the trace and move the devices that moved
+	void Update(void);
+
+	Ptr<LearnMobilityTrace> m_trace;
+	//a device and where it is in its node's waypoints
+	struct Track
+	{
+		Ptr<LearnNetDevice> device;
+		uint64_t node;
+		uint64_t cursor;
+	};
+	std::vector<Track> m_tracks;
+	Time m_interval;
+	EventId m_event;
+	uint64_t m_nMoves;
+};
+
+} // namespace ns3
+
+#endif /* LEARN_MOBILITY_TRACE_H */
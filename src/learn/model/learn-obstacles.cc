@@ -0,0 +1,260 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include "ns3/abort.h"
+#include "ns3/log.h"
+#include "learn-obstacles.h"
+
+namespace ns3
+{
+NS_LOG_COMPONENT_DEFINE("LearnObstacles");
+
+namespace
+{
+//obstacles per hierarchy leaf
+const uint32_t LEAF_SIZE = 4;
+} // namespace
+
+LearnObstacleMap::LearnObstacleMap()
+	: m_version(0), m_nExactTests(0)
+{
+}
+
+void LearnObstacleMap::Load(std::string filename)
+{
+	NS_LOG_FUNCTION(this << filename);
+	std::ifstream is(filename.c_str());
+	NS_ABORT_MSG_IF(!is, "Cannot open obstacle file " << filename);
+	std::string line;
+	uint32_t lineNo = 0;
+	while (std::getline(is, line))
+	{
+		++lineNo;
+		std::string::size_type start = line.find_first_not_of(" \t");
+		if (start == std::string::npos || line[start] == '#')
+		{
+			continue;
+		}
+		std::istringstream ls(line);
+		double height;
+		ls >> height;
+		Footprint footprint;
+		double x, y;
+		while (ls >> x >> y)
+		{
+			footprint.push_back(std::make_pair(x, y));
+		}
+		NS_ABORT_MSG_IF(!ls.eof(), filename << ":" << lineNo << ": bad obstacle");
+		AddObstacle(footprint, height);
+	}
+}
+
+void LearnObstacleMap::AddObstacle(const Footprint &footprint, double height)
+{
+	NS_ABORT_MSG_IF(footprint.size() < 3, "An obstacle footprint needs at least three vertices");
+	Obstacle obstacle;
+	obstacle.footprint = footprint;
+	obstacle.height = height;
+	obstacle.box.minX = obstacle.box.maxX = footprint[0].first;
+	obstacle.box.minY = obstacle.box.maxY = footprint[0].second;
+	for (std::size_t k = 1; k < footprint.size(); ++k)
+	{
+		obstacle.box.minX = std::min(obstacle.box.minX, footprint[k].first);
+		obstacle.box.maxX = std::max(obstacle.box.maxX, footprint[k].first);
+		obstacle.box.minY = std::min(obstacle.box.minY, footprint[k].second);
+		obstacle.box.maxY = std::max(obstacle.box.maxY, footprint[k].second);
+	}
+	m_obstacles.push_back(obstacle);
+	m_nodes.clear();
+	++m_version;
+}
+
+std::size_t
+LearnObstacleMap::GetNObstacles(void) const
+{
+	return m_obstacles.size();
+}
+
+uint32_t
+LearnObstacleMap::GetVersion(void) const
+{
+	return m_version;
+}
+
+uint64_t
+LearnObstacleMap::GetNExactTests(void) const
+{
+	return m_nExactTests;
+}
+
+//
+// Median split along the longer side of the node's box, by box centres. Each
+// level halves the obstacles, so a query visits O(log n) boxes per obstacle
+// near the segment.
+//
+uint32_t
+LearnObstacleMap::Build(uint32_t first, uint32_t count)
+{
+	uint32_t index = m_nodes.size();
+	m_nodes.push_back(BvhNode());
+	Box box = m_obstacles[m_order[first]].box;
+	for (uint32_t k = first + 1; k < first + count; ++k)
+	{
+		const Box &b = m_obstacles[m_order[k]].box;
+		box.minX = std::min(box.minX, b.minX);
+		box.maxX = std::max(box.maxX, b.maxX);
+		box.minY = std::min(box.minY, b.minY);
+		box.maxY = std::max(box.maxY, b.maxY);
+	}
+	m_nodes[index].box = box;
+	m_nodes[index].left = 0;
+	m_nodes[index].right = 0;
+	m_nodes[index].first = first;
+	m_nodes[index].count = count;
+	if (count <= LEAF_SIZE)
+	{
+		return index;
+	}
+	const std::vector<Obstacle> &obstacles = m_obstacles;
+	bool splitX = box.maxX - box.minX >= box.maxY - box.minY;
+	std::nth_element(m_order.begin() + first, m_order.begin() + first + count / 2, m_order.begin() + first + count,
+					 [&obstacles, splitX](uint32_t a, uint32_t b) {
+						 const Box &ba = obstacles[a].box;
+						 const Box &bb = obstacles[b].box;
+						 return splitX ? ba.minX + ba.maxX < bb.minX + bb.maxX : ba.minY + ba.maxY < bb.minY + bb.maxY;
+					 });
+	//
+	// Indexed again: the recursion may move the nodes.
+	//
+	uint32_t left = Build(first, count / 2);
+	uint32_t right = Build(first + count / 2, count - count / 2);
+	m_nodes[index].left = left;
+	m_nodes[index].right = right;
+	m_nodes[index].count = 0;
+	return index;
+}
+
+bool LearnObstacleMap::Crosses(const Box &box, double x1, double y1, double dx, double dy)
+{
+	double tMin = 0;
+	double tMax = 1;
+	double lo[2] = {box.minX, box.minY};
+	double hi[2] = {box.maxX, box.maxY};
+	double origin[2] = {x1, y1};
+	double dir[2] = {dx, dy};
+	for (int axis = 0; axis < 2; ++axis)
+	{
+		if (dir[axis] == 0)
+		{
+			if (origin[axis] < lo[axis] || origin[axis] > hi[axis])
+			{
+				return false;
+			}
+			continue;
+		}
+		double t1 = (lo[axis] - origin[axis]) / dir[axis];
+		double t2 = (hi[axis] - origin[axis]) / dir[axis];
+		if (t1 > t2)
+		{
+			std::swap(t1, t2);
+		}
+		tMin = std::max(tMin, t1);
+		tMax = std::min(tMax, t2);
+		if (tMin > tMax)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+//
+// The segment is blocked where it crosses an edge of the footprint below the
+// obstacle's height. Devices inside the same footprint see each other.
+//
+bool LearnObstacleMap::Blocks(const Obstacle &obstacle, double x1, double y1, double z1, double x2, double y2, double z2)
+{
+	double dx = x2 - x1;
+	double dy = y2 - y1;
+	const Footprint &f = obstacle.footprint;
+	for (std::size_t k = 0; k < f.size(); ++k)
+	{
+		const std::pair<double, double> &a = f[k];
+		const std::pair<double, double> &b = f[(k + 1) % f.size()];
+		double ex = b.first - a.first;
+		double ey = b.second - a.second;
+		double denom = dx * ey - dy * ex;
+		if (denom == 0)
+		{
+			continue;
+		}
+		double ax = a.first - x1;
+		double ay = a.second - y1;
+		double t = (ax * ey - ay * ex) / denom;
+		double u = (ax * dy - ay * dx) / denom;
+		if (t >= 0 && t <= 1 && u >= 0 && u <= 1 && z1 + t * (z2 - z1) < obstacle.height)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool LearnObstacleMap::IsBlocked(double x1, double y1, double z1, double x2, double y2, double z2)
+{
+	if (m_obstacles.empty())
+	{
+		return false;
+	}
+	if (m_nodes.empty())
+	{
+		m_order.resize(m_obstacles.size());
+		for (uint32_t k = 0; k < m_order.size(); ++k)
+		{
+			m_order[k] = k;
+		}
+		Build(0, m_order.size());
+	}
+	double dx = x2 - x1;
+	double dy = y2 - y1;
+	//
+	// Depth first with an explicit stack; median splits keep the depth near
+	// log2 of the number of leaves.
+	//
+	uint32_t stack[64];
+	uint32_t top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const BvhNode &node = m_nodes[stack[--top]];
+		if (!Crosses(node.box, x1, y1, dx, dy))
+		{
+			continue;
+		}
+		if (node.count == 0)
+		{
+			stack[top++] = node.left;
+			stack[top++] = node.right;
+			continue;
+		}
+		for (uint32_t k = node.first; k < node.first + node.count; ++k)
+		{
+			const Obstacle &obstacle = m_obstacles[m_order[k]];
+			if (!Crosses(obstacle.box, x1, y1, dx, dy))
+			{
+				continue;
+			}
+			++m_nExactTests;
+			if (Blocks(obstacle, x1, y1, z1, x2, y2, z2))
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+} // namespace ns3
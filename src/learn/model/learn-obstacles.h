@@ -0,0 +1,86 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef LEARN_OBSTACLES_H
+#define LEARN_OBSTACLES_H
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include "ns3/simple-ref-count.h"
+
+namespace ns3
+{
+
+//
+// Building and obstacle footprints: polygons in the x, y plane extruded from
+// the ground up to a height. A link is blocked when the segment between its
+// ends passes through a footprint below the obstacle's height.
+//
+// Segment queries walk a bounding volume hierarchy over the footprints, so
+// only the obstacles whose boxes the segment crosses are tested exactly.
+//
+// Text file format, '#' starts a comment line, one obstacle per line:
+//
+//   height x1 y1 x2 y2 x3 y3 ...
+//
+class LearnObstacleMap : public SimpleRefCount<LearnObstacleMap>
+{
+  public:
+	typedef std::vector<std::pair<double, double>> Footprint;
+
+	LearnObstacleMap();
+	//add obstacles from a file
+	void Load(std::string filename);
+	//add a footprint with at least three vertices, in order around the polygon
+	void AddObstacle(const Footprint &footprint, double height);
+
+	std::size_t GetNObstacles(void) const;
+	//changes every time an obstacle is added
+	uint32_t GetVersion(void) const;
+	//true if an obstacle stands between (x1, y1, z1) and (x2, y2, z2)
+	bool IsBlocked(double x1, double y1, double z1, double x2, double y2, double z2);
+	//exact segment-footprint tests done so far, to gauge the hierarchy
+	uint64_t GetNExactTests(void) const;
+
+  private:
+	struct Box
+	{
+		double minX;
+		double minY;
+		double maxX;
+		double maxY;
+	};
+	struct Obstacle
+	{
+		Footprint footprint;
+		double height;
+		Box box;
+	};
+	//hierarchy node: a box with either two children or a range of m_order
+	struct BvhNode
+	{
+		Box box;
+		uint32_t left;
+		uint32_t right;
+		//leaf range in m_order, count is 0 for inner nodes
+		uint32_t first;
+		uint32_t count;
+	};
+	//build the hierarchy over m_order[first, first + count), return the node index
+	uint32_t Build(uint32_t first, uint32_t count);
+	//true if segment from (x1, y1, z1) to (x2, y2, z2) crosses obstacle below its height
+	static bool Blocks(const Obstacle &obstacle, double x1, double y1, double z1, double x2, double y2, double z2);
+	//true if the segment from (x1, y1) along (dx, dy) meets box
+	static bool Crosses(const Box &box, double x1, double y1, double dx, double dy);
+	std::vector<Obstacle> m_obstacles;
+	//obstacle indices, grouped by leaf
+	std::vector<uint32_t> m_order;
+	//hierarchy nodes, node 0 is the root; empty until the first query after a change
+	std::vector<BvhNode> m_nodes;
+	uint32_t m_version;
+	uint64_t m_nExactTests;
+};
+
+} // namespace ns3
+
+#endif /* LEARN_OBSTACLES_H */
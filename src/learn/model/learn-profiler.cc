@@ -0,0 +1,197 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <vector>
+#include <time.h>
+#include "ns3/abort.h"
+#include "ns3/log.h"
+#include "learn-profiler.h"
+
+namespace ns3
+{
+NS_LOG_COMPONENT_DEFINE("LearnProfiler");
+
+namespace
+{
+//node of the call tree, node 0 is the root
+struct ProfileNode
+{
+	const char *name;
+	uint32_t parent;
+	uint64_t totalNs;
+	uint64_t calls;
+	//children by frame name pointer, few per node so a vector beats a map
+	std::vector<std::pair<const char *, uint32_t>> children;
+};
+
+std::vector<ProfileNode> &GetNodes(void)
+{
+	static std::vector<ProfileNode> nodes(1, ProfileNode{"root", 0, 0, 0, {}});
+	return nodes;
+}
+
+uint32_t g_current = 0;
+
+uint64_t NowNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t GetSelfNs(const ProfileNode &node)
+{
+	const std::vector<ProfileNode> &nodes = GetNodes();
+	uint64_t children = 0;
+	for (std::size_t k = 0; k < node.children.size(); ++k)
+	{
+		children += nodes[node.children[k].second].totalNs;
+	}
+	return node.totalNs > children ? node.totalNs - children : 0;
+}
+
+void WritePath(std::ostream &os, uint32_t index)
+{
+	const std::vector<ProfileNode> &nodes = GetNodes();
+	if (nodes[index].parent != 0)
+	{
+		WritePath(os, nodes[index].parent);
+		os << ";";
+	}
+	os << nodes[index].name;
+}
+} // namespace
+
+bool LearnProfiler::s_enabled = false;
+
+void LearnProfiler::Enable(void)
+{
+	s_enabled = true;
+}
+
+void LearnProfiler::Disable(void)
+{
+	s_enabled = false;
+}
+
+bool LearnProfiler::IsEnabled(void)
+{
+	return s_enabled;
+}
+
+void LearnProfiler::Reset(void)
+{
+	NS_ABORT_MSG_IF(g_current != 0, "LearnProfiler::Reset inside a profiled scope");
+	std::vector<ProfileNode> &nodes = GetNodes();
+	nodes.resize(1);
+	nodes[0].totalNs = 0;
+	nodes[0].calls = 0;
+	nodes[0].children.clear();
+}
+
+uint64_t
+LearnProfiler::Enter(const char *name)
+{
+	std::vector<ProfileNode> &nodes = GetNodes();
+	std::vector<std::pair<const char *, uint32_t>> &children = nodes[g_current].children;
+	uint32_t child = 0;
+	for (std::size_t k = 0; k < children.size(); ++k)
+	{
+		if (children[k].first == name)
+		{
+			child = children[k].second;
+			break;
+		}
+	}
+	if (child == 0)
+	{
+		child = nodes.size();
+		ProfileNode node = {name, g_current, 0, 0, {}};
+		//
+		// Indexed again: push_back below may move the nodes.
+		//
+		nodes[g_current].children.push_back(std::make_pair(name, child));
+		nodes.push_back(node);
+	}
+	g_current = child;
+	return NowNs();
+}
+
+void LearnProfiler::Exit(uint64_t start)
+{
+	uint64_t end = NowNs();
+	ProfileNode &node = GetNodes()[g_current];
+	node.totalNs += end - start;
+	++node.calls;
+	g_current = node.parent;
+}
+
+void LearnProfiler::WriteFolded(std::ostream &os)
+{
+	const std::vector<ProfileNode> &nodes = GetNodes();
+	for (uint32_t i = 1; i < nodes.size(); ++i)
+	{
+		uint64_t self = GetSelfNs(nodes[i]);
+		if (self == 0)
+		{
+			continue;
+		}
+		WritePath(os, i);
+		os << " " << self << std::endl;
+	}
+}
+
+void LearnProfiler::WriteFolded(std::string filename)
+{
+	std::ofstream os(filename.c_str());
+	NS_ABORT_MSG_IF(!os, "Cannot open " << filename);
+	WriteFolded(os);
+}
+
+void LearnProfiler::Print(std::ostream &os)
+{
+	//
+	// Recursive frames would be counted once per level in the totals, the
+	// learn handlers do not recurse.
+	//
+	struct Summary
+	{
+		uint64_t totalNs;
+		uint64_t selfNs;
+		uint64_t calls;
+	};
+	std::map<std::string, Summary> byName;
+	const std::vector<ProfileNode> &nodes = GetNodes();
+	for (uint32_t i = 1; i < nodes.size(); ++i)
+	{
+		Summary &s = byName[nodes[i].name];
+		s.totalNs += nodes[i].totalNs;
+		s.selfNs += GetSelfNs(nodes[i]);
+		s.calls += nodes[i].calls;
+	}
+	for (std::map<std::string, Summary>::const_iterator it = byName.begin(); it != byName.end(); ++it)
+	{
+		const Summary &s = it->second;
+		os << it->first << " calls=" << s.calls << " total=" << s.totalNs / 1e9 << "s self=" << s.selfNs / 1e9
+		   << "s per-call=" << (s.calls > 0 ? s.totalNs / s.calls : 0) << "ns" << std::endl;
+	}
+}
+
+const char *
+LearnProfiler::GetProtocolFrame(uint16_t protocol)
+{
+	static std::map<uint16_t, std::string> frames;
+	std::string &frame = frames[protocol];
+	if (frame.empty())
+	{
+		char buf[32];
+		snprintf(buf, sizeof(buf), "RxCallback(0x%04x)", protocol);
+		frame = buf;
+	}
+	return frame.c_str();
+}
+
+} // namespace ns3
@@ -0,0 +1,72 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef LEARN_PROFILER_H
+#define LEARN_PROFILER_H
+
+#include <stdint.h>
+#include <iostream>
+#include <string>
+
+namespace ns3
+{
+
+//
+// Opt-in wall clock profiler of the learn event handlers. Scopes nest into a
+// call tree; each node accumulates its wall time and number of calls. When
+// the profiler is off a scope costs one test of a flag.
+//
+class LearnProfiler
+{
+  public:
+	//time the enclosing block as frame name, name must outlive the profiler
+	class Scope
+	{
+	  public:
+		Scope(const char *name)
+			: m_active(s_enabled)
+		{
+			if (m_active)
+			{
+				m_start = Enter(name);
+			}
+		}
+		~Scope()
+		{
+			if (m_active)
+			{
+				Exit(m_start);
+			}
+		}
+
+	  private:
+		bool m_active;
+		uint64_t m_start;
+	};
+
+	static void Enable(void);
+	//stop recording, the collected profile is kept
+	static void Disable(void);
+
+	static bool IsEnabled(void);
+	//forget the collected profile, not to be called from inside a scope
+	static void Reset(void);
+	//one "frame;frame;frame self-ns" line per call path, the folded format of flame graph tools
+	static void WriteFolded(std::ostream &os);
+	static void WriteFolded(std::string filename);
+	//total and self time and calls of each frame name, summed over its call paths
+	static void Print(std::ostream &os);
+	//frame name of the upper-layer receive callback for protocol
+	static const char *GetProtocolFrame(uint16_t protocol);
+
+  private:
+	//enter frame name below the current one, return the start time
+	static uint64_t Enter(const char *name);
+	//leave the current frame entered at start
+	static void Exit(uint64_t start);
+	static bool s_enabled;
+};
+
+} // namespace ns3
+
+#define LEARN_PROFILE_SCOPE(name) ns3::LearnProfiler::Scope learnProfileScope(name)
+
+#endif /* LEARN_PROFILER_H */
@@ -0,0 +1,248 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "ns3/abort.h"
+#include "ns3/log.h"
+#include "learn-stats.h"
+
+namespace ns3
+{
+NS_LOG_COMPONENT_DEFINE("LearnStats");
+
+/////////////////////////////////////////////////////////////
+
+LearnHistogram::LearnHistogram()
+{
+	Reset();
+}
+
+//
+// Values below SUB_BUCKETS ns have a bucket each. Above, every power of two
+// is split in SUB_BUCKETS equal buckets, found from the leading bit and the
+// SUB_BITS bits after it.
+//
+int LearnHistogram::GetBucket(uint64_t v)
+{
+	if (v < static_cast<uint64_t>(SUB_BUCKETS))
+	{
+		return static_cast<int>(v);
+	}
+	int e = 63 - __builtin_clzll(v);
+	if (e >= MAX_EXP)
+	{
+		return N_BUCKETS - 1;
+	}
+	int sub = static_cast<int>((v >> (e - SUB_BITS)) & (SUB_BUCKETS - 1));
+	return SUB_BUCKETS + (e - SUB_BITS) * SUB_BUCKETS + sub;
+}
+
+uint64_t
+LearnHistogram::GetBucketLow(int b)
+{
+	if (b < SUB_BUCKETS)
+	{
+		return b;
+	}
+	int e = (b - SUB_BUCKETS) / SUB_BUCKETS + SUB_BITS;
+	int sub = (b - SUB_BUCKETS) % SUB_BUCKETS;
+	return static_cast<uint64_t>(SUB_BUCKETS + sub) << (e - SUB_BITS);
+}
+
+void LearnHistogram::Add(Time t)
+{
+	int64_t ns = t.GetNanoSeconds();
+	uint64_t v = ns > 0 ? static_cast<uint64_t>(ns) : 0;
+	++m_buckets[GetBucket(v)];
+	++m_count;
+	m_sum += v;
+	m_min = std::min(m_min, v);
+	m_max = std::max(m_max, v);
+}
+
+void LearnHistogram::Merge(const LearnHistogram &o)
+{
+	for (int b = 0; b < N_BUCKETS; ++b)
+	{
+		m_buckets[b] += o.m_buckets[b];
+	}
+	m_count += o.m_count;
+	m_sum += o.m_sum;
+	m_min = std::min(m_min, o.m_min);
+	m_max = std::max(m_max, o.m_max);
+}
+
+void LearnHistogram::Reset(void)
+{
+	memset(m_buckets, 0, sizeof(m_buckets));
+	m_count = 0;
+	m_sum = 0;
+	m_min = ~static_cast<uint64_t>(0);
+	m_max = 0;
+}
+
+uint64_t
+LearnHistogram::GetCount(void) const
+{
+	return m_count;
+}
+
+Time LearnHistogram::GetMin(void) const
+{
+	return m_count == 0 ? Time(0) : NanoSeconds(m_min);
+}
+
+Time LearnHistogram::GetMax(void) const
+{
+	return NanoSeconds(m_max);
+}
+
+Time LearnHistogram::GetMean(void) const
+{
+	return m_count == 0 ? Time(0) : NanoSeconds(m_sum / m_count);
+}
+
+Time LearnHistogram::GetPercentile(double q) const
+{
+	if (m_count == 0)
+	{
+		return Time(0);
+	}
+	uint64_t rank = static_cast<uint64_t>(std::ceil(q * m_count));
+	rank = std::max<uint64_t>(rank, 1);
+	uint64_t seen = 0;
+	for (int b = 0; b < N_BUCKETS; ++b)
+	{
+		seen += m_buckets[b];
+		if (seen >= rank)
+		{
+			//
+			// Report the middle of the bucket, kept within the exact extremes.
+			//
+			uint64_t low = GetBucketLow(b);
+			uint64_t high = (b + 1 < N_BUCKETS) ? GetBucketLow(b + 1) : m_max + 1;
+			uint64_t mid = low + (high - 1 - low) / 2;
+			return NanoSeconds(std::min(std::max(mid, m_min), m_max));
+		}
+	}
+	return NanoSeconds(m_max);
+}
+
+void LearnHistogram::Print(std::ostream &os) const
+{
+	os << "count=" << m_count << " mean=" << GetMean().GetSeconds() << "s min=" << GetMin().GetSeconds()
+	   << "s p50=" << GetPercentile(0.5).GetSeconds() << "s p90=" << GetPercentile(0.9).GetSeconds()
+	   << "s p99=" << GetPercentile(0.99).GetSeconds() << "s max=" << GetMax().GetSeconds() << "s";
+}
+
+void LearnHistogram::Serialize(std::ostream &os) const
+{
+	os.write(reinterpret_cast<const char *>(m_buckets), sizeof(m_buckets));
+	os.write(reinterpret_cast<const char *>(&m_count), sizeof(m_count));
+	os.write(reinterpret_cast<const char *>(&m_sum), sizeof(m_sum));
+	os.write(reinterpret_cast<const char *>(&m_min), sizeof(m_min));
+	os.write(reinterpret_cast<const char *>(&m_max), sizeof(m_max));
+}
+
+void LearnHistogram::Deserialize(std::istream &is)
+{
+	is.read(reinterpret_cast<char *>(m_buckets), sizeof(m_buckets));
+	is.read(reinterpret_cast<char *>(&m_count), sizeof(m_count));
+	is.read(reinterpret_cast<char *>(&m_sum), sizeof(m_sum));
+	is.read(reinterpret_cast<char *>(&m_min), sizeof(m_min));
+	is.read(reinterpret_cast<char *>(&m_max), sizeof(m_max));
+	NS_ABORT_MSG_IF(!is, "Truncated histogram");
+}
+
+/////////////////////////////////////////////////////////////
+
+void LearnLatencyStats::Print(std::ostream &os) const
+{
+	os << "  total       ";
+	total.Print(os);
+	os << std::endl << "  queueing    ";
+	queueing.Print(os);
+	os << std::endl << "  airtime     ";
+	airtime.Print(os);
+	os << std::endl << "  propagation ";
+	propagation.Print(os);
+	os << std::endl;
+}
+
+/////////////////////////////////////////////////////////////
+
+NS_OBJECT_ENSURE_REGISTERED(LearnTimestampTag);
+
+TypeId
+LearnTimestampTag::GetTypeId(void)
+{
+	static TypeId tid = TypeId("ns3::LearnTimestampTag")
+							.SetParent<Tag>()
+							.SetGroupName("Learn")
+							.AddConstructor<LearnTimestampTag>();
+	return tid;
+}
+
+TypeId
+LearnTimestampTag::GetInstanceTypeId(void) const
+{
+	return GetTypeId();
+}
+
+LearnTimestampTag::LearnTimestampTag()
+{
+}
+
+void LearnTimestampTag::SetSendTime(Time t)
+{
+	m_send = t;
+}
+
+Time LearnTimestampTag::GetSendTime(void) const
+{
+	return m_send;
+}
+
+void LearnTimestampTag::SetTransmission(Time start, Time duration)
+{
+	m_txStart = start;
+	m_txTime = duration;
+}
+
+Time LearnTimestampTag::GetTxStart(void) const
+{
+	return m_txStart;
+}
+
+Time LearnTimestampTag::GetTxTime(void) const
+{
+	return m_txTime;
+}
+
+uint32_t
+LearnTimestampTag::GetSerializedSize(void) const
+{
+	return 3 * sizeof(int64_t);
+}
+
+void LearnTimestampTag::Serialize(TagBuffer i) const
+{
+	i.WriteU64(m_send.GetTimeStep());
+	i.WriteU64(m_txStart.GetTimeStep());
+	i.WriteU64(m_txTime.GetTimeStep());
+}
+
+void LearnTimestampTag::Deserialize(TagBuffer i)
+{
+	m_send = TimeStep(i.ReadU64());
+	m_txStart = TimeStep(i.ReadU64());
+	m_txTime = TimeStep(i.ReadU64());
+}
+
+void LearnTimestampTag::Print(std::ostream &os) const
+{
+	os << "send=" << m_send << " txStart=" << m_txStart << " txTime=" << m_txTime;
+}
+
+} // namespace ns3
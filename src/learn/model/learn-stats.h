@@ -0,0 +1,105 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef LEARN_STATS_H
+#define LEARN_STATS_H
+
+#include <stdint.h>
+#include <iostream>
+#include "ns3/nstime.h"
+#include "ns3/tag.h"
+
+namespace ns3
+{
+
+//fixed memory histogram of durations with log spaced buckets, about 12% resolution
+class LearnHistogram
+{
+  public:
+	LearnHistogram();
+	//add one sample, negative samples count as zero
+	void Add(Time t);
+	//add all the samples of another histogram
+	void Merge(const LearnHistogram &o);
+	//forget all samples
+	void Reset(void);
+
+	uint64_t GetCount(void) const;
+
+	Time GetMin(void) const;
+
+	Time GetMax(void) const;
+
+	Time GetMean(void) const;
+	//value below which a fraction q of the samples fall, q in [0, 1]
+	Time GetPercentile(double q) const;
+	//one line: count, mean, min, p50, p90, p99, max
+	void Print(std::ostream &os) const;
+	//raw dump and load, used to ship histograms between processes
+	void Serialize(std::ostream &os) const;
+	void Deserialize(std::istream &is);
+
+  private:
+	//sub buckets per power of two
+	static const int SUB_BITS = 3;
+	static const int SUB_BUCKETS = 1 << SUB_BITS;
+	//largest power of two tracked, larger samples go to the last bucket (about 18 minutes in ns)
+	static const int MAX_EXP = 40;
+	static const int N_BUCKETS = SUB_BUCKETS + (MAX_EXP - SUB_BITS) * SUB_BUCKETS;
+	//bucket of a value in ns
+	static int GetBucket(uint64_t v);
+	//smallest value in ns of a bucket
+	static uint64_t GetBucketLow(int b);
+	uint64_t m_buckets[N_BUCKETS];
+	uint64_t m_count;
+	uint64_t m_sum;
+	uint64_t m_min;
+	uint64_t m_max;
+};
+
+//latency of the packets received over a link or by a device, split in components
+struct LearnLatencyStats
+{
+	//from Send to the end of reception
+	LearnHistogram total;
+	//from Send to the start of transmission
+	LearnHistogram queueing;
+	//transmission time of the packet
+	LearnHistogram airtime;
+	//from the end of transmission to the end of reception
+	LearnHistogram propagation;
+
+	void Print(std::ostream &os) const;
+};
+
+//time stamps carried by a packet from Send to Receive
+class LearnTimestampTag : public Tag
+{
+  public:
+	static TypeId GetTypeId(void);
+	virtual TypeId GetInstanceTypeId(void) const;
+
+	LearnTimestampTag();
+
+	void SetSendTime(Time t);
+
+	Time GetSendTime(void) const;
+	//start and duration of the transmission
+	void SetTransmission(Time start, Time duration);
+
+	Time GetTxStart(void) const;
+
+	Time GetTxTime(void) const;
+
+	virtual uint32_t GetSerializedSize(void) const;
+	virtual void Serialize(TagBuffer i) const;
+	virtual void Deserialize(TagBuffer i);
+	virtual void Print(std::ostream &os) const;
+
+  private:
+	Time m_send;
+	Time m_txStart;
+	Time m_txTime;
+};
+
+} // namespace ns3
+
+#endif /* LEARN_STATS_H */
@@ -0,0 +1,182 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include <algorithm>
+#include <cstring>
+#include "ns3/assert.h"
+#include "ns3/log.h"
+#include "learn-timing-wheel.h"
+
+namespace ns3
+{
+NS_LOG_COMPONENT_DEFINE("LearnTimingWheel");
+
+namespace
+{
+//true if a comes out after b
+bool Later(const LearnArrival &a, const LearnArrival &b)
+{
+	return a.time > b.time || (a.time == b.time && a.seq > b.seq);
+}
+} // namespace
+
+LearnTimingWheel::LearnTimingWheel(int64_t resolution)
+	: m_resolution(resolution), m_cursor(0), m_seq(0), m_size(0)
+{
+	NS_ASSERT_MSG(resolution > 0, "The tick must be at least one time step");
+	memset(m_occupied, 0, sizeof(m_occupied));
+}
+
+void LearnTimingWheel::Insert(const LearnArrival &arrival)
+{
+	NS_ASSERT(arrival.time >= 0);
+	LearnArrival a = arrival;
+	a.seq = m_seq++;
+	++m_size;
+	if (static_cast<uint64_t>(a.time / m_resolution) <= m_cursor)
+	{
+		//
+		// Due in the cursor's slot or before it, which happens when the cursor
+		// went ahead to the next arrival: straight into the sorted list.
+		//
+		m_ready.insert(std::lower_bound(m_ready.begin(), m_ready.end(), a, Later), a);
+		return;
+	}
+	Place(a);
+}
+
+bool LearnTimingWheel::IsEmpty(void) const
+{
+	return m_size == 0;
+}
+
+std::size_t
+LearnTimingWheel::GetSize(void) const
+{
+	return m_size;
+}
+
+const LearnArrival &
+LearnTimingWheel::Peek(void)
+{
+	NS_ASSERT_MSG(m_size > 0, "Empty timing wheel");
+	if (m_ready.empty())
+	{
+		Refill();
+	}
+	return m_ready.back();
+}
+
+void LearnTimingWheel::Pop(LearnArrival &arrival)
+{
+	Peek();
+	LearnArrival &last = m_ready.back();
+	arrival.time = last.time;
+	arrival.seq = last.seq;
+	arrival.dst = last.dst;
+	arrival.src = last.src;
+	arrival.context = last.context;
+	arrival.packet = 0;
+	std::swap(arrival.packet, last.packet);
+	m_ready.pop_back();
+	--m_size;
+}
+
+//
+// The level is the lowest one above which tick and cursor agree, so the slot
+// is always ahead of the cursor's slot on that level.
+//
+void LearnTimingWheel::Place(LearnArrival &arrival)
+{
+	uint64_t tick = arrival.time / m_resolution;
+	uint64_t diff = tick ^ m_cursor;
+	for (uint32_t level = 0; level < LEVELS; ++level)
+	{
+		if ((diff >> (BITS * (level + 1))) == 0)
+		{
+			uint32_t slot = (tick >> (BITS * level)) & (SLOTS - 1);
+			m_slots[level][slot].push_back(LearnArrival());
+			std::swap(m_slots[level][slot].back(), arrival);
+			m_occupied[level][slot / 64] |= uint64_t(1) << (slot % 64);
+			return;
+		}
+	}
+	m_overflow.push_back(LearnArrival());
+	std::swap(m_overflow.back(), arrival);
+}
+
+uint32_t
+LearnTimingWheel::FindSlot(uint32_t level, uint32_t from) const
+{
+	for (uint32_t word = from / 64; word < SLOTS / 64; ++word)
+	{
+		uint64_t bits = m_occupied[level][word];
+		if (word == from / 64)
+		{
+			bits &= ~uint64_t(0) << (from % 64);
+		}
+		if (bits != 0)
+		{
+			return word * 64 + __builtin_ctzll(bits);
+		}
+	}
+	return SLOTS;
+}
+
+void LearnTimingWheel::Refill(void)
+{
+	std::vector<LearnArrival> moved;
+	while (m_ready.empty())
+	{
+		uint32_t level = 0;
+		uint32_t slot = SLOTS;
+		for (; level < LEVELS; ++level)
+		{
+			uint32_t current = (m_cursor >> (BITS * level)) & (SLOTS - 1);
+			uint32_t from = level == 0 ? current : current + 1;
+			slot = from < SLOTS ? FindSlot(level, from) : SLOTS;
+			if (slot < SLOTS)
+			{
+				break;
+			}
+		}
+		if (slot == SLOTS)
+		{
+			//
+			// Every level is empty: jump to the earliest overflow arrival and
+			// place the overflow again from there.
+			//
+			NS_ASSERT_MSG(!m_overflow.empty(), "Timing wheel lost arrivals");
+			int64_t first = m_overflow[0].time;
+			for (std::size_t k = 1; k < m_overflow.size(); ++k)
+			{
+				first = std::min(first, m_overflow[k].time);
+			}
+			m_cursor = first / m_resolution;
+			moved.swap(m_overflow);
+		}
+		else
+		{
+			//
+			// The cursor moves to the start of the slot, lower levels are empty
+			// up to there.
+			//
+			uint64_t high = m_cursor >> (BITS * (level + 1)) << (BITS * (level + 1));
+			m_cursor = high | (uint64_t(slot) << (BITS * level));
+			moved.swap(m_slots[level][slot]);
+			m_occupied[level][slot / 64] &= ~(uint64_t(1) << (slot % 64));
+			if (level == 0)
+			{
+				m_ready.swap(moved);
+				std::sort(m_ready.begin(), m_ready.end(), Later);
+				continue;
+			}
+		}
+		for (std::size_t k = 0; k < moved.size(); ++k)
+		{
+			Place(moved[k]);
+		}
+		moved.clear();
+	}
+}
+
+} // namespace ns3
@@ -0,0 +1,83 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef LEARN_TIMING_WHEEL_H
+#define LEARN_TIMING_WHEEL_H
+
+#include <stdint.h>
+#include <vector>
+#include "ns3/simple-ref-count.h"
+#include "ns3/ptr.h"
+#include "ns3/packet.h"
+
+namespace ns3
+{
+
+//reception waiting in a LearnTimingWheel
+struct LearnArrival
+{
+	//arrival time in time steps
+	int64_t time;
+	//insertion order, set by the wheel, orders arrivals at the same time
+	uint64_t seq;
+	//receiver and sender channel indices
+	uint32_t dst;
+	uint32_t src;
+	//context the reception runs in
+	uint32_t context;
+	//0 for a compact receiver
+	Ptr<Packet> packet;
+};
+
+//
+// Hierarchical timing wheel of pending arrivals: four levels of 256 slots,
+// each slot of a level as wide as the whole level below. An arrival goes
+// into the lowest level whose range holds it, in constant time. When the
+// cursor reaches a slot of a higher level the slot is spread over the levels
+// below, so each arrival moves at most three times. Arrivals more than
+// 2^32 ticks away wait in an overflow list.
+//
+// Arrivals come out by time, then in the order they were inserted, the same
+// order in which the simulator runs events of equal time.
+//
+class LearnTimingWheel : public SimpleRefCount<LearnTimingWheel>
+{
+  public:
+	//ticks of resolution time steps
+	LearnTimingWheel(int64_t resolution);
+	//add an arrival, not before the last one taken out
+	void Insert(const LearnArrival &arrival);
+
+	bool IsEmpty(void) const;
+	//arrivals held
+	std::size_t GetSize(void) const;
+	//earliest arrival, the wheel must not be empty
+	const LearnArrival &Peek(void);
+	//take the earliest arrival out into arrival
+	void Pop(LearnArrival &arrival);
+
+  private:
+	static const uint32_t LEVELS = 4;
+	static const uint32_t BITS = 8;
+	static const uint32_t SLOTS = 1 << BITS;
+	//put arrival into the slot for its tick, or the overflow list
+	void Place(LearnArrival &arrival);
+	//first non empty slot of level from slot on, SLOTS if none
+	uint32_t FindSlot(uint32_t level, uint32_t from) const;
+	//move the cursor to the next arrivals and sort them into m_ready
+	void Refill(void);
+
+	int64_t m_resolution;
+	//tick of the slot m_ready came from, every arrival in a slot is later
+	uint64_t m_cursor;
+	uint64_t m_seq;
+	std::size_t m_size;
+	std::vector<LearnArrival> m_slots[LEVELS][SLOTS];
+	//non empty slots of each level
+	uint64_t m_occupied[LEVELS][SLOTS / 64];
+	std::vector<LearnArrival> m_overflow;
+	//arrivals up to the cursor, sorted latest first
+	std::vector<LearnArrival> m_ready;
+};
+
+} // namespace ns3
+
+#endif /* LEARN_TIMING_WHEEL_H */
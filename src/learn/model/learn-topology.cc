@@ -0,0 +1,214 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ns3/abort.h"
+#include "ns3/assert.h"
+#include "ns3/log.h"
+#include "learn-topology.h"
+
+namespace ns3
+{
+NS_LOG_COMPONENT_DEFINE("LearnTopology");
+
+namespace
+{
+const char TOPOLOGY_MAGIC[8] = {'L', 'R', 'N', 'T', 'O', 'P', 'O', '1'};
+const uint32_t TOPOLOGY_VERSION = 1;
+
+//
+// Parse up to max comma separated numbers of a csv line, return how many were
+// found. Empty lines and lines starting with '#' have none.
+//
+int ParseCsvLine(const std::string &line, double *fields, int max)
+{
+	const char *c = line.c_str();
+	while (*c == ' ' || *c == '\t')
+	{
+		++c;
+	}
+	if (*c == '#')
+	{
+		return 0;
+	}
+	int n = 0;
+	while (n < max)
+	{
+		char *end;
+		double v = strtod(c, &end);
+		if (end == c)
+		{
+			break;
+		}
+		fields[n++] = v;
+		c = end;
+		while (*c == ' ' || *c == '\t')
+		{
+			++c;
+		}
+		if (*c != ',')
+		{
+			break;
+		}
+		++c;
+	}
+	return n;
+}
+} // namespace
+
+LearnTopology::LearnTopology(std::string filename)
+	: m_map(MAP_FAILED), m_size(0), m_header(0), m_devices(0), m_links(0)
+{
+	NS_LOG_FUNCTION(this << filename);
+	int fd = open(filename.c_str(), O_RDONLY);
+	NS_ABORT_MSG_IF(fd < 0, "Cannot open topology " << filename);
+	struct stat st;
+	NS_ABORT_MSG_IF(fstat(fd, &st) != 0, "Cannot stat topology " << filename);
+	m_size = st.st_size;
+	NS_ABORT_MSG_IF(m_size < sizeof(LearnTopologyHeader), "Topology " << filename << " is truncated");
+
+	//
+	// The records are used in place, straight from the page cache, and read
+	// once front to back.
+	//
+	m_map = mmap(0, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	NS_ABORT_MSG_IF(m_map == MAP_FAILED, "Cannot map topology " << filename);
+	madvise(m_map, m_size, MADV_SEQUENTIAL);
+
+	const char *base = static_cast<const char *>(m_map);
+	m_header = reinterpret_cast<const LearnTopologyHeader *>(base);
+	NS_ABORT_MSG_IF(memcmp(m_header->magic, TOPOLOGY_MAGIC, sizeof(TOPOLOGY_MAGIC)) != 0,
+					"Not a topology file " << filename);
+	NS_ABORT_MSG_IF(m_header->version != TOPOLOGY_VERSION,
+					"Unsupported topology version " << m_header->version);
+	std::size_t room = m_size - sizeof(LearnTopologyHeader);
+	NS_ABORT_MSG_IF(m_header->nDevices > room / sizeof(LearnTopologyDevice) ||
+						m_header->nLinks > (room - m_header->nDevices * sizeof(LearnTopologyDevice)) / sizeof(LearnTopologyLink),
+					"Topology " << filename << " is truncated");
+	m_devices = reinterpret_cast<const LearnTopologyDevice *>(base + sizeof(LearnTopologyHeader));
+	m_links = reinterpret_cast<const LearnTopologyLink *>(m_devices + m_header->nDevices);
+	//
+	// Links are checked once here, so that installing can index devices with
+	// them. A hand made or damaged file aborts instead of reaching past the
+	// devices.
+	//
+	for (uint64_t k = 0; k < m_header->nLinks; ++k)
+	{
+		const LearnTopologyLink &l = m_links[k];
+		NS_ABORT_MSG_IF(l.src >= m_header->nDevices || l.dst >= m_header->nDevices,
+						"Link " << k << " of topology " << filename << " to unknown device");
+		NS_ABORT_MSG_IF(!(l.loss >= 0.0 && l.loss <= 1.0),
+						"Link " << k << " of topology " << filename << " has loss " << l.loss);
+	}
+	NS_LOG_INFO("Mapped " << m_header->nDevices << " devices and " << m_header->nLinks << " links");
+}
+
+LearnTopology::~LearnTopology()
+{
+	NS_LOG_FUNCTION(this);
+	if (m_map != MAP_FAILED)
+	{
+		munmap(m_map, m_size);
+	}
+}
+
+uint64_t
+LearnTopology::GetNDevices(void) const
+{
+	return m_header->nDevices;
+}
+
+const LearnTopologyDevice &
+LearnTopology::GetDevice(uint64_t i) const
+{
+	NS_ASSERT(i < m_header->nDevices);
+	return m_devices[i];
+}
+
+uint64_t
+LearnTopology::GetNLinks(void) const
+{
+	return m_header->nLinks;
+}
+
+const LearnTopologyLink &
+LearnTopology::GetLink(uint64_t i) const
+{
+	NS_ASSERT(i < m_header->nLinks);
+	return m_links[i];
+}
+
+void LearnTopology::ConvertCsv(std::string devicesCsv, std::string linksCsv, std::string filename)
+{
+	NS_LOG_FUNCTION(devicesCsv << linksCsv << filename);
+	std::ofstream os(filename.c_str(), std::ios::binary);
+	NS_ABORT_MSG_IF(!os, "Cannot open " << filename);
+
+	//
+	// The counts are only known at the end, so the header is written twice.
+	//
+	LearnTopologyHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TOPOLOGY_MAGIC, sizeof(TOPOLOGY_MAGIC));
+	header.version = TOPOLOGY_VERSION;
+	os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+	std::string line;
+	double f[4];
+	std::ifstream devices(devicesCsv.c_str());
+	NS_ABORT_MSG_IF(!devices, "Cannot open " << devicesCsv);
+	while (std::getline(devices, line))
+	{
+		int n = ParseCsvLine(line, f, 4);
+		if (n == 0)
+		{
+			continue;
+		}
+		NS_ABORT_MSG_IF(n < 2, "Bad device line in " << devicesCsv << ": " << line);
+		LearnTopologyDevice d;
+		d.x = f[0];
+		d.y = f[1];
+		d.dataRate = n > 2 ? static_cast<uint64_t>(f[2]) : 0;
+		d.group = n > 3 ? static_cast<uint32_t>(f[3]) : 0;
+		d.reserved = 0;
+		os.write(reinterpret_cast<const char *>(&d), sizeof(d));
+		++header.nDevices;
+	}
+
+	if (!linksCsv.empty())
+	{
+		std::ifstream links(linksCsv.c_str());
+		NS_ABORT_MSG_IF(!links, "Cannot open " << linksCsv);
+		while (std::getline(links, line))
+		{
+			int n = ParseCsvLine(line, f, 3);
+			if (n == 0)
+			{
+				continue;
+			}
+			NS_ABORT_MSG_IF(n < 3, "Bad link line in " << linksCsv << ": " << line);
+			LearnTopologyLink l;
+			l.src = static_cast<uint32_t>(f[0]);
+			l.dst = static_cast<uint32_t>(f[1]);
+			l.loss = f[2];
+			NS_ABORT_MSG_IF(l.src >= header.nDevices || l.dst >= header.nDevices,
+							"Link to unknown device in " << linksCsv << ": " << line);
+			NS_ABORT_MSG_IF(!(l.loss >= 0.0 && l.loss <= 1.0), "Loss out of [0, 1] in " << linksCsv << ": " << line);
+			os.write(reinterpret_cast<const char *>(&l), sizeof(l));
+			++header.nLinks;
+		}
+	}
+
+	os.seekp(0);
+	os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	NS_ABORT_MSG_IF(!os, "Failed to write " << filename);
+	NS_LOG_INFO("Wrote " << header.nDevices << " devices and " << header.nLinks << " links");
+}
+
+} // namespace ns3
@@ -0,0 +1,83 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef LEARN_TOPOLOGY_H
+#define LEARN_TOPOLOGY_H
+
+#include <stdint.h>
+#include <string>
+#include "ns3/simple-ref-count.h"
+
+namespace ns3
+{
+
+//
+// Binary topology file, native endian, all records 8 byte aligned:
+//
+//   LearnTopologyHeader
+//   LearnTopologyDevice x nDevices
+//   LearnTopologyLink x nLinks
+//
+struct LearnTopologyHeader
+{
+	//"LRNTOPO1"
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint64_t nDevices;
+	uint64_t nLinks;
+};
+
+struct LearnTopologyDevice
+{
+	//position
+	double x;
+	double y;
+	//data rate in bit/s, 0 keeps the device default
+	uint64_t dataRate;
+	//devices of the same group share a channel
+	uint32_t group;
+	uint32_t reserved;
+};
+
+struct LearnTopologyLink
+{
+	//device numbers in the file
+	uint32_t src;
+	uint32_t dst;
+	//loss probability of the link from src to dst
+	double loss;
+};
+
+//read-only view of a topology file mapped in memory, records are read in place
+class LearnTopology : public SimpleRefCount<LearnTopology>
+{
+  public:
+	//map the topology file
+	LearnTopology(std::string filename);
+	~LearnTopology();
+
+	uint64_t GetNDevices(void) const;
+
+	const LearnTopologyDevice &GetDevice(uint64_t i) const;
+
+	uint64_t GetNLinks(void) const;
+
+	const LearnTopologyLink &GetLink(uint64_t i) const;
+	//convert "x,y[,rate[,group]]" device lines and "src,dst,loss" link lines to a topology file
+	static void ConvertCsv(std::string devicesCsv, std::string linksCsv, std::string filename);
+
+  private:
+	LearnTopology &operator=(const LearnTopology &o);
+	LearnTopology(const LearnTopology &o);
+	//mapped file
+	void *m_map;
+	//size of the mapping
+	std::size_t m_size;
+	//views into the mapping
+	const LearnTopologyHeader *m_header;
+	const LearnTopologyDevice *m_devices;
+	const LearnTopologyLink *m_links;
+};
+
+} // namespace ns3
+
+#endif /* LEARN_TOPOLOGY_H */
@@ -1,16 +1,281 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
 
 #include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <typeinfo>
 #include "ns3/abort.h"
 #include "ns3/assert.h"
 #include "ns3/log.h"
 #include "ns3/header.h"
+#include "ns3/enum.h"
+#include "ns3/boolean.h"
+#include "ns3/socket.h"
+#include "ns3/string.h"
+#include "ns3/double.h"
+#include "ns3/event-impl.h"
+#include "ns3/pointer.h"
+#include "ns3/constant-position-mobility-model.h"
 #include "learn.h"
+#include "learn-profiler.h"
 
 namespace ns3
 {
 NS_LOG_COMPONENT_DEFINE("Learn");
 
+namespace
+{
+//
+// Checkpoints are raw native-endian dumps, meant to be read back on the same
+// kind of machine by the same build.
+//
+const char CHECKPOINT_MAGIC[8] = {'L', 'R', 'N', 'C', 'K', 'P', 'T', '7'};
+
+template <typename T>
+void WriteRaw(std::ostream &os, const T &v)
+{
+	os.write(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+
+template <typename T>
+T ReadRaw(std::istream &is)
+{
+	T v;
+	is.read(reinterpret_cast<char *>(&v), sizeof(T));
+	NS_ABORT_MSG_IF(!is, "Truncated checkpoint");
+	return v;
+}
+
+void WriteTime(std::ostream &os, Time t)
+{
+	WriteRaw<int64_t>(os, t.GetTimeStep());
+}
+
+Time ReadTime(std::istream &is)
+{
+	return TimeStep(ReadRaw<int64_t>(is));
+}
+
+void WriteBytes(std::ostream &os, const std::vector<uint8_t> &bytes)
+{
+	WriteRaw<uint32_t>(os, bytes.size());
+	os.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+}
+
+std::vector<uint8_t> ReadBytes(std::istream &is)
+{
+	std::vector<uint8_t> bytes(ReadRaw<uint32_t>(is));
+	is.read(reinterpret_cast<char *>(bytes.data()), bytes.size());
+	NS_ABORT_MSG_IF(!is, "Truncated checkpoint");
+	return bytes;
+}
+
+//
+// Packet::Serialize leaves out the packet tags, which carry the link layer
+// addressing, the priority and the time stamps of a frame. They follow the
+// bytes, each under its TypeId name. The time stamps are written apart,
+// relative to now like every other time of a checkpoint.
+//
+void WritePacket(std::ostream &os, Ptr<const Packet> p)
+{
+	std::vector<uint8_t> buffer(p->GetSerializedSize());
+	NS_ABORT_MSG_IF(buffer.empty() || p->Serialize(&buffer[0], buffer.size()) == 0,
+					"Packet " << p->GetUid() << " does not serialize");
+	WriteBytes(os, buffer);
+
+	Time now = Simulator::Now();
+	LearnTimestampTag timestamp;
+	bool stamped = p->PeekPacketTag(timestamp);
+	WriteRaw<uint8_t>(os, stamped);
+	if (stamped)
+	{
+		WriteTime(os, timestamp.GetSendTime() - now);
+		WriteTime(os, timestamp.GetTxStart() - now);
+		WriteTime(os, timestamp.GetTxTime());
+	}
+	uint32_t nTags = 0;
+	for (PacketTagIterator it = p->GetPacketTagIterator(); it.HasNext();)
+	{
+		nTags += it.Next().GetTypeId() != LearnTimestampTag::GetTypeId();
+	}
+	WriteRaw(os, nTags);
+	for (PacketTagIterator it = p->GetPacketTagIterator(); it.HasNext();)
+	{
+		PacketTagIterator::Item item = it.Next();
+		TypeId tid = item.GetTypeId();
+		if (tid == LearnTimestampTag::GetTypeId())
+		{
+			continue;
+		}
+		NS_ABORT_MSG_IF(!tid.HasConstructor(), "Packet tag " << tid.GetName() << " has no constructor to restore it");
+		ObjectBase *base = tid.GetConstructor()();
+		Tag *tag = dynamic_cast<Tag *>(base);
+		item.GetTag(*tag);
+		std::vector<uint8_t> bytes(tag->GetSerializedSize());
+		tag->Serialize(TagBuffer(bytes.data(), bytes.data() + bytes.size()));
+		delete base;
+		std::string name = tid.GetName();
+		WriteBytes(os, std::vector<uint8_t>(name.begin(), name.end()));
+		WriteBytes(os, bytes);
+	}
+}
+
+Ptr<Packet> ReadPacket(std::istream &is)
+{
+	std::vector<uint8_t> buffer = ReadBytes(is);
+	NS_ABORT_MSG_IF(buffer.empty(), "Corrupt checkpoint, empty packet");
+	Ptr<Packet> p = Create<Packet>(&buffer[0], buffer.size(), true);
+
+	Time now = Simulator::Now();
+	if (ReadRaw<uint8_t>(is) != 0)
+	{
+		LearnTimestampTag timestamp;
+		timestamp.SetSendTime(now + ReadTime(is));
+		Time txStart = now + ReadTime(is);
+		timestamp.SetTransmission(txStart, ReadTime(is));
+		p->AddPacketTag(timestamp);
+	}
+	uint32_t nTags = ReadRaw<uint32_t>(is);
+	for (uint32_t k = 0; k < nTags; ++k)
+	{
+		std::vector<uint8_t> name = ReadBytes(is);
+		std::vector<uint8_t> bytes = ReadBytes(is);
+		TypeId tid;
+		NS_ABORT_MSG_IF(!TypeId::LookupByNameFailSafe(std::string(name.begin(), name.end()), &tid) ||
+							!tid.HasConstructor(),
+						"Unknown packet tag " << std::string(name.begin(), name.end()) << " in checkpoint");
+		ObjectBase *base = tid.GetConstructor()();
+		Tag *tag = dynamic_cast<Tag *>(base);
+		NS_ABORT_MSG_IF(tag == 0, tid.GetName() << " is not a tag");
+		tag->Deserialize(TagBuffer(bytes.data(), bytes.data() + bytes.size()));
+		p->AddPacketTag(*tag);
+		delete base;
+	}
+	return p;
+}
+} // namespace
+
+/////////////////////////////////////////////////////////////
+
+NS_OBJECT_ENSURE_REGISTERED(LearnMacTag);
+
+TypeId
+LearnMacTag::GetTypeId(void)
+{
+	static TypeId tid = TypeId("ns3::LearnMacTag")
+							.SetParent<Tag>()
+							.SetGroupName("Learn")
+							.AddConstructor<LearnMacTag>();
+	return tid;
+}
+
+TypeId
+LearnMacTag::GetInstanceTypeId(void) const
+{
+	return GetTypeId();
+}
+
+LearnMacTag::LearnMacTag()
+	: m_protocol(0), m_hopLimit(0)
+{
+}
+
+void LearnMacTag::SetDestination(Mac48Address dest)
+{
+	m_destination = dest;
+}
+
+Mac48Address
+LearnMacTag::GetDestination(void) const
+{
+	return m_destination;
+}
+
+void LearnMacTag::SetSource(Mac48Address source)
+{
+	m_source = source;
+}
+
+Mac48Address
+LearnMacTag::GetSource(void) const
+{
+	return m_source;
+}
+
+void LearnMacTag::SetNextHop(Mac48Address nextHop)
+{
+	m_nextHop = nextHop;
+}
+
+Mac48Address
+LearnMacTag::GetNextHop(void) const
+{
+	return m_nextHop;
+}
+
+void LearnMacTag::SetProtocol(uint16_t protocol)
+{
+	m_protocol = protocol;
+}
+
+uint16_t
+LearnMacTag::GetProtocol(void) const
+{
+	return m_protocol;
+}
+
+void LearnMacTag::SetHopLimit(uint8_t hops)
+{
+	m_hopLimit = hops;
+}
+
+uint8_t
+LearnMacTag::GetHopLimit(void) const
+{
+	return m_hopLimit;
+}
+
+uint32_t
+LearnMacTag::GetSerializedSize(void) const
+{
+	return 3 * 6 + 2 + 1;
+}
+
+void LearnMacTag::Serialize(TagBuffer i) const
+{
+	uint8_t buf[6];
+	m_destination.CopyTo(buf);
+	i.Write(buf, 6);
+	m_source.CopyTo(buf);
+	i.Write(buf, 6);
+	m_nextHop.CopyTo(buf);
+	i.Write(buf, 6);
+	i.WriteU16(m_protocol);
+	i.WriteU8(m_hopLimit);
+}
+
+void LearnMacTag::Deserialize(TagBuffer i)
+{
+	uint8_t buf[6];
+	i.Read(buf, 6);
+	m_destination.CopyFrom(buf);
+	i.Read(buf, 6);
+	m_source.CopyFrom(buf);
+	i.Read(buf, 6);
+	m_nextHop.CopyFrom(buf);
+	m_protocol = i.ReadU16();
+	m_hopLimit = i.ReadU8();
+}
+
+void LearnMacTag::Print(std::ostream &os) const
+{
+	os << "dest=" << m_destination << " src=" << m_source << " nextHop=" << m_nextHop
+	   << " protocol=" << m_protocol << " hopLimit=" << static_cast<uint32_t>(m_hopLimit);
+}
+
 /////////////////////////////////////////////////////////////
 
 NS_OBJECT_ENSURE_REGISTERED(LearnChannel);
@@ -25,341 +290,2663 @@ LearnChannel::GetTypeId(void)
 			.AddConstructor<LearnChannel>()
 			.AddAttribute("DelayFac", "Propagation delay through the channel",
 						  TimeValue(Seconds(0)), MakeTimeAccessor(&LearnChannel::m_delay_fac),
-						  MakeTimeChecker());
+						  MakeTimeChecker())
+			.AddAttribute("MaxRange", "Distance beyond which devices do not hear each other, 0 for no limit",
+						  DoubleValue(0), MakeDoubleAccessor(&LearnChannel::m_maxRange),
+						  MakeDoubleChecker<double>(0))
+			.AddTraceSource("LinkLoss",
+							"Trace source indicating a packet has been lost "
+							"on the link from the sender to one receiver",
+							MakeTraceSourceAccessor(&LearnChannel::m_linkLossTrace),
+							"ns3::LearnChannel::LinkLossTracedCallback")
+			.AddAttribute("NlosDelay", "Extra delay of a link blocked by an obstacle",
+						  TimeValue(Seconds(0)), MakeTimeAccessor(&LearnChannel::m_nlosDelay),
+						  MakeTimeChecker())
+			.AddAttribute("NlosLoss", "Loss probability of a link blocked by an obstacle",
+						  DoubleValue(1), MakeDoubleAccessor(&LearnChannel::m_nlosLoss),
+						  MakeDoubleChecker<double>(0, 1))
+			.AddAttribute("PropagationDelayModel",
+						  "Delay model used instead of DelayFac, memoized per link so it must be deterministic",
+						  PointerValue(),
+						  MakePointerAccessor(&LearnChannel::SetPropagationDelayModel,
+											  &LearnChannel::GetPropagationDelayModel),
+						  MakePointerChecker<PropagationDelayModel>())
+			.AddAttribute("PropagationLossModel", "Deterministic loss model, memoized per link",
+						  PointerValue(),
+						  MakePointerAccessor(&LearnChannel::SetPropagationLossModel,
+											  &LearnChannel::GetPropagationLossModel),
+						  MakePointerChecker<PropagationLossModel>())
+			.AddAttribute("FadingLossModel", "Stochastic loss model applied to every packet after the deterministic one",
+						  PointerValue(),
+						  MakePointerAccessor(&LearnChannel::SetFadingLossModel, &LearnChannel::GetFadingLossModel),
+						  MakePointerChecker<PropagationLossModel>())
+			.AddAttribute("TxPower", "Transmit power in dBm, for the loss models",
+						  DoubleValue(16.0206), MakeDoubleAccessor(&LearnChannel::m_txPower),
+						  MakeDoubleChecker<double>())
+			.AddAttribute("RxSensitivity", "Power in dBm below which a packet is not heard, with a loss model",
+						  DoubleValue(-101), MakeDoubleAccessor(&LearnChannel::m_rxSensitivity),
+						  MakeDoubleChecker<double>())
+			.AddAttribute("SlotTime",
+						  "Slot length of the slotted mode, where a central scheduler grants the slots, 0 to disable",
+						  TimeValue(Seconds(0)), MakeTimeAccessor(&LearnChannel::m_slotTime), MakeTimeChecker())
+			.AddAttribute("GrantsPerSlot", "Devices granted each slot by the default round robin scheduler",
+						  UintegerValue(1), MakeUintegerAccessor(&LearnChannel::m_grantsPerSlot),
+						  MakeUintegerChecker<uint32_t>(1))
+			.AddAttribute("SpecializedFanOut",
+						  "Send through a fan-out compiled for the channel's configuration, false for the generic one",
+						  BooleanValue(true), MakeBooleanAccessor(&LearnChannel::m_specializedFanOut),
+						  MakeBooleanChecker())
+			.AddAttribute("ArrivalWheel",
+						  "Keep pending receptions in a timing wheel of the channel. The simulator holds one small "
+						  "pooled event per arrival time and context of a frame, so receptions run in the same order "
+						  "as without the wheel",
+						  BooleanValue(false), MakeBooleanAccessor(&LearnChannel::m_arrivalWheel),
+						  MakeBooleanChecker())
+			.AddAttribute("WheelTick", "Slot width of the lowest level of the arrival wheel",
+						  TimeValue(MicroSeconds(1)), MakeTimeAccessor(&LearnChannel::m_wheelTick),
+						  MakeTimeChecker(TimeStep(1)))
+			.AddAttribute("TrackInFlight",
+						  "Keep the packets in flight so that checkpoints can capture them",
+						  BooleanValue(false), MakeBooleanAccessor(&LearnChannel::m_trackInFlight),
+						  MakeBooleanChecker());
 	return tid;
 }
 
 //
 // By default, you get a channel that
 // has an "infitely" fast transmission speed and zero delay.
-LearnChannel::LearnChannel() : Channel(), m_delay_fac(Seconds(0.)), m_nDevices(0)
+LearnChannel::LearnChannel()
+	: Channel(), m_delay_fac(Seconds(0.)), m_maxRange(0), m_nDevices(0), m_nAntennas(0), m_nlosDelay(Seconds(0.)), m_nlosLoss(1),
+	  m_losVersion(0), m_txPower(16.0206), m_rxSensitivity(-101), m_fluidLoad(0),
+	  m_fluidSecondMoment(0), m_fluidWait(Seconds(0.)), m_fluidStale(false), m_trackInFlight(false), m_inFlightSeq(0),
+	  m_connectivityBuilt(false), m_topologyEpoch(0), m_freeRxEvents(0), m_slotTime(Seconds(0.)),
+	  m_grantsPerSlot(1), m_slotRunning(false), m_slot(0), m_nSlots(0), m_roundRobin(0), m_specializedFanOut(true),
+	  m_nRaised(0), m_arrivalWheel(false), m_wheelTick(MicroSeconds(1)), m_freeWheelEvents(0), m_wheelGroup(0),
+	  m_wheelGroupTime(0), m_wheelGroupContext(0)
 {
 	NS_LOG_FUNCTION_NOARGS();
-	memset(m_dist, 0, sizeof(m_dist));
+	m_lossRng = CreateObject<UniformRandomVariable>();
+	m_fluidRng = CreateObject<UniformRandomVariable>();
 }
 
-void LearnChannel::Attach(Ptr<LearnNetDevice> device)
+std::size_t
+LearnChannel::Attach(Ptr<LearnNetDevice> device)
 {
 	NS_LOG_FUNCTION(this << device);
-	NS_ASSERT_MSG(m_nDevices < N_DEVICES, "Too much devices");
 	NS_ASSERT(device != 0);
 
-	m_devices[m_nDevices] = device;
-
-	for (decltype(m_nDevices) i = 0; i < m_nDevices; ++i)
+	//
+	// Distances are not cached per pair any more: an n x n table does not fit
+	// large channels, and the fan-out computes them anyway.
+	//
+	m_devices.push_back(device);
+	m_posX.push_back(device->GetX());
+	m_posY.push_back(device->GetY());
+	m_posZ.push_back(device->GetZ());
+	if (device->GetZ() != 0)
+	{
+		++m_nRaised;
+	}
+	m_posEpoch.push_back(1);
+	m_rxCount.push_back(0);
+	m_linkLoss.push_back(LinkLossRow());
+	m_listenerPos.push_back(NOT_LISTENING);
+	m_busyUntil.push_back(Seconds(0.));
+	m_addressIndex[Mac48Address::ConvertFrom(device->GetAddress())] = m_nDevices;
+	if (device->GetRadioState() == LearnNetDevice::LISTEN)
+	{
+		SetListening(m_nDevices, true);
+	}
+	std::size_t index = m_nDevices++;
+	if (!m_antennas.empty())
+	{
+		m_antennas.push_back(AntennaState());
+	}
+	if (m_connectivityBuilt)
 	{
-		m_dist[m_nDevices][i] = m_dist[i][m_nDevices] = GetDist(m_devices[i], m_devices[m_nDevices]);
+		m_cells.push_back(Cell());
+		m_neighbours.push_back(std::vector<std::size_t>());
+		AddToConnectivity(index);
 	}
-	++m_nDevices;
+	return index;
 }
 
-bool LearnChannel::TransmitStart(Ptr<const Packet> p, Ptr<LearnNetDevice> src, Time txTime)
+//
+// A compact device costs one entry in each dense array, about 80 bytes
+// with its empty loss row, against several KB for a LearnNetDevice with its
+// queue, callbacks and traces. It always listens and only counts what
+// it receives.
+//
+std::size_t
+LearnChannel::AddCompactDevice(double x, double y)
 {
-	NS_LOG_FUNCTION(this << p << src);
-	NS_LOG_LOGIC("UID is " << p->GetUid() << ")");
-	for (decltype(m_nDevices) i = 0; i < m_nDevices; ++i)
+	m_devices.push_back(0);
+	m_posX.push_back(x);
+	m_posY.push_back(y);
+	m_posZ.push_back(0);
+	m_posEpoch.push_back(1);
+	m_rxCount.push_back(0);
+	m_linkLoss.push_back(LinkLossRow());
+	m_listenerPos.push_back(NOT_LISTENING);
+	m_busyUntil.push_back(Seconds(0.));
+	SetListening(m_nDevices, true);
+	std::size_t index = m_nDevices++;
+	if (!m_antennas.empty())
 	{
-		if (m_devices[i] == src)
-		{
-			continue;
-		}
-		Simulator::ScheduleWithContext(
-			m_devices[i]->GetNode()->GetId(), txTime + GetDelay(src, m_devices[i]),
-			&LearnNetDevice::Receive, m_devices[i], p->Copy(), m_devices[i]);
+		m_antennas.push_back(AntennaState());
+	}
+	if (m_connectivityBuilt)
+	{
+		m_cells.push_back(Cell());
+		m_neighbours.push_back(std::vector<std::size_t>());
+		AddToConnectivity(index);
 	}
+	return index;
+}
 
-	return true;
+void LearnChannel::Materialize(std::size_t index, Ptr<LearnNetDevice> device)
+{
+	NS_LOG_FUNCTION(this << index << device);
+	NS_ASSERT_MSG(IsCompact(index), "Device " << index << " is not compact");
+	m_devices[index] = device;
+	m_addressIndex[Mac48Address::ConvertFrom(device->GetAddress())] = index;
+	SetListening(index, device->GetRadioState() == LearnNetDevice::LISTEN);
+	//
+	// The device can relay from now on.
+	//
+	++m_topologyEpoch;
 }
 
-std::size_t
-LearnChannel::GetNDevices(void) const
+bool LearnChannel::IsCompact(std::size_t index) const
 {
-	NS_LOG_FUNCTION_NOARGS();
-	return m_nDevices;
+	NS_ASSERT(index < m_nDevices);
+	return m_devices[index] == 0;
 }
 
-Ptr<LearnNetDevice>
-LearnChannel::GetLearnDevice(std::size_t i) const
+uint32_t
+LearnChannel::GetRxCount(std::size_t index) const
 {
-	NS_LOG_FUNCTION_NOARGS();
-	NS_ASSERT(i < N_DEVICES);
-	return m_devices[i];
+	NS_ASSERT(index < m_nDevices);
+	return m_rxCount[index];
 }
 
-Ptr<NetDevice>
-LearnChannel::GetDevice(std::size_t i) const
+void LearnChannel::CompactReceive(std::size_t index)
 {
-	NS_LOG_FUNCTION_NOARGS();
-	return GetLearnDevice(i);
+	LEARN_PROFILE_SCOPE("LearnChannel::CompactReceive");
+	++m_rxCount[index];
 }
 
-Time LearnChannel::GetDelay(Ptr<LearnNetDevice> n1, Ptr<LearnNetDevice> n2) const
+void LearnChannel::Reserve(std::size_t n)
 {
-	return m_delay_fac * GetDist(n1, n2);
+	NS_LOG_FUNCTION(this << n);
+	m_devices.reserve(n);
+	m_posX.reserve(n);
+	m_posY.reserve(n);
+	m_posZ.reserve(n);
+	m_posEpoch.reserve(n);
+	m_rxCount.reserve(n);
+	m_linkLoss.reserve(n);
+	m_listenerPos.reserve(n);
+	m_listeners.reserve(n);
+	m_busyUntil.reserve(n);
 }
 
-Time LearnChannel::GetDelayFac(void) const
+void LearnChannel::SetListening(std::size_t index, bool listening)
 {
-	return m_delay_fac;
+	NS_LOG_FUNCTION(this << index << listening);
+	NS_ASSERT_MSG(index < m_nDevices, "No such device on the channel");
+	bool isListening = (m_listenerPos[index] != NOT_LISTENING);
+	if (listening == isListening)
+	{
+		return;
+	}
+	if (listening)
+	{
+		m_listenerPos[index] = m_listeners.size();
+		m_listeners.push_back(index);
+	}
+	else
+	{
+		//
+		// Swap the last listener into the hole so leaving is constant time.
+		//
+		std::size_t pos = m_listenerPos[index];
+		std::size_t last = m_listeners.back();
+		m_listeners[pos] = last;
+		m_listenerPos[last] = pos;
+		m_listeners.pop_back();
+		m_listenerPos[index] = NOT_LISTENING;
+	}
 }
 
-double
-LearnChannel::GetDist(Ptr<LearnNetDevice> n1, Ptr<LearnNetDevice> n2) const
+std::size_t
+LearnChannel::GetNListeners(void) const
 {
-	double x1 = n1->GetX();
-	double x2 = n2->GetX();
-	double y1 = n1->GetY();
-	double y2 = n2->GetY();
-	return sqrt((x1 - x2) * (x1 - x2) + (y1 - y2) * (y1 - y2));
+	return m_listeners.size();
 }
 
-/////////////////////////////////////////////////////////////
+std::size_t
+LearnChannel::GetListener(std::size_t k) const
+{
+	NS_ASSERT(k < m_listeners.size());
+	return m_listeners[k];
+}
 
-NS_OBJECT_ENSURE_REGISTERED(LearnNetDevice);
+Time LearnChannel::GetBusyUntil(std::size_t index) const
+{
+	NS_ASSERT_MSG(index < m_nDevices, "No such device on the channel");
+	return m_busyUntil[index];
+}
 
-TypeId
-LearnNetDevice::GetTypeId(void)
+bool LearnChannel::TransmitStart(Ptr<const Packet> p, Ptr<LearnNetDevice> src, Time txTime)
 {
-	static TypeId tid =
-		TypeId("ns3::LearnNetDevice")
-			.SetParent<NetDevice>()
-			.SetGroupName("Learn")
-			.AddConstructor<LearnNetDevice>()
-			.AddAttribute("Mtu", "The MAC-level Maximum Transmission Unit",
-						  UintegerValue(DEFAULT_MTU),
-						  MakeUintegerAccessor(&LearnNetDevice::SetMtu, &LearnNetDevice::GetMtu),
-						  MakeUintegerChecker<uint16_t>())
-			.AddAttribute("Address", "The MAC address of this device.",
-						  Mac48AddressValue(Mac48Address("ff:ff:ff:ff:ff:ff")),
-						  MakeMac48AddressAccessor(&LearnNetDevice::m_address),
-						  MakeMac48AddressChecker())
-			.AddAttribute("DataRate", "The default data rate for point to point links",
-						  DataRateValue(DataRate("32768b/s")),
-						  MakeDataRateAccessor(&LearnNetDevice::m_bps), MakeDataRateChecker())
-			.AddAttribute("ReceiveErrorModel",
-						  "The receiver error model used to simulate packet loss", PointerValue(),
-						  MakePointerAccessor(&LearnNetDevice::m_receiveErrorModel),
-						  MakePointerChecker<ErrorModel>())
-			.AddAttribute("InterframeGap", "The time to wait between packet (frame) transmissions",
-						  TimeValue(Seconds(0.0)),
-						  MakeTimeAccessor(&LearnNetDevice::m_tInterframeGap), MakeTimeChecker())
+	LEARN_PROFILE_SCOPE("LearnChannel::TransmitStart");
+	NS_LOG_FUNCTION(this << p << src);
+	NS_LOG_LOGIC("UID is " << p->GetUid() << ")");
+	//
+	// Frames to a group reach its members only, a group nobody joined reaches
+	// nobody.
+	//
+	const std::vector<std::size_t> *receivers = &m_listeners;
+	LearnMacTag tag;
+	if (p->PeekPacketTag(tag) && tag.GetDestination().IsGroup() && !tag.GetDestination().IsBroadcast())
+	{
+		std::map<Mac48Address, std::vector<std::size_t>>::const_iterator group = m_groups.find(tag.GetDestination());
+		receivers = group == m_groups.end() ? &m_noMembers : &group->second;
+	}
+	if (!m_arrivalWheel)
+	{
+		return (this->*SelectFanOut())(p, src, txTime, *receivers);
+	}
+	//
+	// Receptions of this frame may share an event, those of a frame sent from
+	// within the fan-out or earlier may not.
+	//
+	m_wheelGroup = 0;
+	bool sent = (this->*SelectFanOut())(p, src, txTime, *receivers);
+	m_wheelGroup = 0;
+	return sent;
+}
 
+//
+// The configuration is read once per packet, the loop below runs once per
+// receiver. Subclasses may override GetDist, so they get the generic loop.
+//
+LearnChannel::FanOutFn
+LearnChannel::SelectFanOut(void) const
+{
+	if (!m_specializedFanOut || m_nAntennas > 0 || m_obstacles != 0 || typeid(*this) != typeid(LearnChannel))
+	{
+		return &LearnChannel::FanOut<true, true, true, true>;
+	}
+	static const FanOutFn fanOuts[2][2][2] = {
+		{{&LearnChannel::FanOut<false, false, false, false>, &LearnChannel::FanOut<false, false, true, false>},
+		 {&LearnChannel::FanOut<false, true, false, false>, &LearnChannel::FanOut<false, true, true, false>}},
+		{{&LearnChannel::FanOut<true, false, false, false>, &LearnChannel::FanOut<true, false, true, false>},
+		 {&LearnChannel::FanOut<true, true, false, false>, &LearnChannel::FanOut<true, true, true, false>}}};
+	bool models = m_delayModel != 0 || m_lossModel != 0 || m_fadingModel != 0;
+	return fanOuts[m_nRaised > 0][models][IsSlotted()];
+}
+
+//
+// Each flag that is false removes its branch at compile time; a flag that is
+// true still checks the configuration at run time, so the generic
+// instantiation handles every case.
+//
+template <bool THREE_D, bool MODELS, bool SLOTTED, bool GENERIC>
+bool LearnChannel::FanOut(Ptr<const Packet> p, Ptr<LearnNetDevice> src, Time txTime,
+						  const std::vector<std::size_t> &receivers)
+{
+	std::size_t srcIndex = src->GetChannelIndex();
+	//
+	// Only listening devices are on the fan-out list, sleeping and
+	// transmitting devices cost nothing here. Senders without lossy links never look up the loss row nor
+	// draw from the random variable.
+	//
+	const LinkLossRow &lossRow = m_linkLoss[srcIndex];
+	Time now = Simulator::Now();
+	double x = m_posX[srcIndex];
+	double y = m_posY[srcIndex];
+	double z = m_posZ[srcIndex];
+	bool members = &receivers != &m_listeners;
+	for (std::vector<std::size_t>::const_iterator it = receivers.begin(); it != receivers.end(); ++it)
+	{
+		std::size_t i = *it;
+		if (i == srcIndex || (members && m_listenerPos[i] == NOT_LISTENING))
+		{
+			continue;
+		}
+		//
+		// The medium is busy for the receiver until the end of the signal, lost
+		// or not. Carrier sense reads this back, no event is needed.
+		//
+		double dist;
+		if (GENERIC)
+		{
+			dist = GetDist(srcIndex, i);
+		}
+		else
+		{
+			double dx = m_posX[i] - x;
+			double dy = m_posY[i] - y;
+			double dz = THREE_D ? m_posZ[i] - z : 0;
+			dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+		}
+		if (m_maxRange > 0 &&
+			(!GENERIC || m_nAntennas == 0 ? dist : dist * std::pow(10.0, -GetLinkGain(srcIndex, i) / 20)) > m_maxRange)
+		{
+			continue;
+		}
+		Time delay = txTime;
+		if (!MODELS || (m_delayModel == 0 && m_lossModel == 0 && m_fadingModel == 0))
+		{
+			delay += m_delay_fac * dist;
+		}
+		else
+		{
 			//
-			// Transmit queueing discipline for the device which includes its own set
-			// of trace hooks.
+			// Only the fading model runs per packet, the rest comes from the
+			// link's memo.
 			//
-			.AddAttribute("TxQueue", "A queue to use as the transmit queue in the device.",
-						  PointerValue(), MakePointerAccessor(&LearnNetDevice::m_queue),
-						  MakePointerChecker<Queue<Packet>>())
-
+			const Propagation &propagation = GetPropagation(srcIndex, i);
+			double rxPower = propagation.rxPower;
+			if (m_fadingModel != 0)
+			{
+				SetMobility(srcIndex, i);
+				rxPower = m_fadingModel->CalcRxPower(rxPower, m_srcMobility, m_dstMobility);
+			}
+			if ((m_lossModel != 0 || m_fadingModel != 0) && rxPower < m_rxSensitivity)
+			{
+				continue;
+			}
+			delay += propagation.delay;
+		}
+		bool nlos = GENERIC && m_obstacles != 0 && !IsLineOfSight(srcIndex, i);
+		if (nlos)
+		{
+			delay += m_nlosDelay;
+		}
+		if (now + delay > m_busyUntil[i])
+		{
+			m_busyUntil[i] = now + delay;
+		}
+		if (nlos && m_nlosLoss > 0.0 && (m_nlosLoss >= 1.0 || m_lossRng->GetValue() < m_nlosLoss))
+		{
+			NS_LOG_LOGIC("Packet lost on blocked link " << srcIndex << "->" << i);
+			m_linkLossTrace(p, src, m_devices[i]);
+			m_wheelGroup = 0;
+			continue;
+		}
+		if (!lossRow.empty())
+		{
+			double prob = FindLinkLoss(lossRow, i);
+			if (prob > 0.0 && (prob >= 1.0 || m_lossRng->GetValue() < prob))
+			{
+				NS_LOG_LOGIC("Packet lost on link " << srcIndex << "->" << i);
+				m_linkLossTrace(p, src, m_devices[i]);
+				m_wheelGroup = 0;
+				continue;
+			}
+		}
+		if (SLOTTED && m_slotTime > Seconds(0.))
+		{
 			//
-			// Trace sources at the "top" of the net device, where packets transition
-			// to/from higher layers.
+			// Slotted: collected here, delivered at a slot boundary.
 			//
-			.AddTraceSource("MacTx",
-							"Trace source indicating a packet has arrived "
-							"for transmission by this device",
-							MakeTraceSourceAccessor(&LearnNetDevice::m_macTxTrace),
-							"ns3::Packet::TracedCallback")
-			.AddTraceSource("MacTxDrop",
-							"Trace source indicating a packet has been dropped "
-							"by the device before transmission",
-							MakeTraceSourceAccessor(&LearnNetDevice::m_macTxDropTrace),
-							"ns3::Packet::TracedCallback")
-			.AddTraceSource("MacPromiscRx",
-							"A packet has been received by this device, "
-							"has been passed up from the physical layer "
-							"and is being forwarded up the local protocol stack.  "
-							"This is a promiscuous trace,",
-							MakeTraceSourceAccessor(&LearnNetDevice::m_macPromiscRxTrace),
-							"ns3::Packet::TracedCallback")
-			.AddTraceSource("MacRx",
-							"A packet has been received by this device, "
-							"has been passed up from the physical layer "
-							"and is being forwarded up the local protocol stack.  "
-							"This is a non-promiscuous trace,",
-							MakeTraceSourceAccessor(&LearnNetDevice::m_macRxTrace),
-							"ns3::Packet::TracedCallback")
-
+			SlotRx rx = {now + delay, static_cast<uint32_t>(i), static_cast<uint32_t>(srcIndex),
+						 m_devices[i] == 0 ? Ptr<Packet>(0) : p->Copy()};
+			m_slotRx.push_back(rx);
+			continue;
+		}
+		if (m_devices[i] == 0)
+		{
 			//
-			// Trace sources at the "bottom" of the net device, where packets transition
-			// to/from the channel.
+			// Compact receivers need neither a copy of the packet nor a context.
+			// Their arrivals are not part of checkpoints.
 			//
-			.AddTraceSource("PhyTxBegin",
-							"Trace source indicating a packet has begun "
-							"transmitting over the channel",
-							MakeTraceSourceAccessor(&LearnNetDevice::m_phyTxBeginTrace),
-							"ns3::Packet::TracedCallback")
-			.AddTraceSource("PhyTxEnd",
-							"Trace source indicating a packet has been "
-							"completely transmitted over the channel",
-							MakeTraceSourceAccessor(&LearnNetDevice::m_phyTxEndTrace),
-							"ns3::Packet::TracedCallback")
-			.AddTraceSource("PhyTxDrop",
-							"Trace source indicating a packet has been "
-							"dropped by the device during transmission",
-							MakeTraceSourceAccessor(&LearnNetDevice::m_phyTxDropTrace),
-							"ns3::Packet::TracedCallback")
+			ScheduleRx(i, srcIndex, 0, delay, Simulator::GetContext());
+			continue;
+		}
+		ScheduleArrival(i, srcIndex, p->Copy(), delay);
+	}
 
-			.AddTraceSource("PhyRxEnd",
-							"Trace source indicating a packet has been "
-							"completely received by the device",
-							MakeTraceSourceAccessor(&LearnNetDevice::m_phyRxEndTrace),
-							"ns3::Packet::TracedCallback")
-			.AddTraceSource("PhyRxDrop",
-							"Trace source indicating a packet has been "
-							"dropped by the device during reception",
-							MakeTraceSourceAccessor(&LearnNetDevice::m_phyRxDropTrace),
-							"ns3::Packet::TracedCallback")
+	return true;
+}
+
+void LearnChannel::ScheduleArrival(std::size_t dst, std::size_t src, Ptr<Packet> p, Time delay)
+{
+	uint32_t context = m_devices[dst]->GetNode()->GetId();
+	if (!m_trackInFlight)
+	{
+		ScheduleRx(dst, src, p, delay, context);
+		return;
+	}
+	uint64_t id = m_inFlightSeq++;
+	InFlight &f = m_inFlight[id];
+	f.dst = dst;
+	f.src = src;
+	f.packet = p;
+	f.arrival = Simulator::Now() + delay;
+	Simulator::ScheduleWithContext(context, delay, &LearnChannel::DeliverInFlight, this, id);
+}
+
+//
+// Reception scheduled by the fan-out. The pool keeps one reference to each
+// event, so when the simulator releases its own after the event has run the
+// event survives and is found again on the free list. Steady state fan-out
+// allocates no events.
+//
+class LearnRxEvent : public EventImpl
+{
+  public:
+	LearnRxEvent(LearnChannel *channel)
+		: m_channel(channel), m_dst(0), m_src(0), m_next(0)
+	{
+	}
+	//0 once the channel is disposed
+	LearnChannel *m_channel;
+	//receiver and sender channel indices
+	uint32_t m_dst;
+	uint32_t m_src;
+	//0 for a compact receiver
+	Ptr<Packet> m_packet;
+	//next free event
+	LearnRxEvent *m_next;
+
+  protected:
+	virtual void Notify(void)
+	{
+		if (m_channel == 0)
+		{
+			return;
+		}
+		//
+		// Back on the free list before delivering: the receiver may forward the
+		// packet, and the fan-out may take this very event again.
+		//
+		LearnChannel *channel = m_channel;
+		std::size_t dst = m_dst;
+		std::size_t src = m_src;
+		Ptr<Packet> p = m_packet;
+		m_packet = 0;
+		m_next = channel->m_freeRxEvents;
+		channel->m_freeRxEvents = this;
+		channel->DeliverRx(dst, src, p);
+	}
+};
+
+//
+// Event for receptions held in the wheel: the next count arrivals, which are
+// due at its time in its context. It is scheduled when they are inserted, so
+// it takes the place among the simulator's events that one event per
+// reception would have. Pooled like LearnRxEvent.
+//
+class LearnWheelEvent : public EventImpl
+{
+  public:
+	LearnWheelEvent(LearnChannel *channel)
+		: m_channel(channel), m_count(0), m_next(0)
+	{
+	}
+	//0 once the channel is disposed
+	LearnChannel *m_channel;
+	//arrivals to deliver
+	uint32_t m_count;
+	//next free event
+	LearnWheelEvent *m_next;
+
+  protected:
+	virtual void Notify(void)
+	{
+		if (m_channel == 0)
+		{
+			return;
+		}
+		LearnChannel *channel = m_channel;
+		uint32_t count = m_count;
+		m_count = 0;
+		m_next = channel->m_freeWheelEvents;
+		channel->m_freeWheelEvents = this;
+		channel->WheelExpire(count);
+	}
+};
+
+void LearnChannel::ScheduleRx(std::size_t dst, std::size_t src, Ptr<Packet> p, Time delay, uint32_t context)
+{
+	if (m_arrivalWheel)
+	{
+		if (m_wheel == 0)
+		{
+			m_wheel = Create<LearnTimingWheel>(m_wheelTick.GetTimeStep());
+		}
+		LearnArrival arrival;
+		arrival.time = (Simulator::Now() + delay).GetTimeStep();
+		arrival.dst = dst;
+		arrival.src = src;
+		arrival.context = context;
+		arrival.packet = p;
+		m_wheel->Insert(arrival);
+		//
+		// Receptions of one frame due at the same time in the same context
+		// would be consecutive events, nothing can be scheduled between them,
+		// so they share one. Any other reception gets its own event now, in
+		// insertion order.
+		//
+		if (m_wheelGroup != 0 && m_wheelGroupTime == arrival.time && m_wheelGroupContext == context)
+		{
+			++m_wheelGroup->m_count;
+			return;
+		}
+		LearnWheelEvent *event = m_freeWheelEvents;
+		if (event == 0)
+		{
+			event = new LearnWheelEvent(this);
+			m_wheelEvents.push_back(event);
+		}
+		else
+		{
+			m_freeWheelEvents = event->m_next;
+		}
+		event->m_count = 1;
+		event->Ref();
+		Simulator::ScheduleWithContext(context, delay, event);
+		m_wheelGroup = event;
+		m_wheelGroupTime = arrival.time;
+		m_wheelGroupContext = context;
+		return;
+	}
+	LearnRxEvent *event = m_freeRxEvents;
+	if (event == 0)
+	{
+		event = new LearnRxEvent(this);
+		m_rxEvents.push_back(event);
+	}
+	else
+	{
+		m_freeRxEvents = event->m_next;
+	}
+	event->m_dst = dst;
+	event->m_src = src;
+	event->m_packet = p;
+	//
+	// The simulator takes over one reference and releases it after the run.
+	//
+	event->Ref();
+	Simulator::ScheduleWithContext(context, delay, event);
+}
+
+void LearnChannel::DeliverRx(std::size_t dst, std::size_t src, Ptr<Packet> p)
+{
+	if (p == 0)
+	{
+		CompactReceive(dst);
+		return;
+	}
+	m_devices[dst]->Receive(p, m_devices[src]);
+}
+
+//
+// Events run in the order they were scheduled, which is the order the
+// arrivals went into the wheel, so the wheel's next arrivals are the event's.
+//
+void LearnChannel::WheelExpire(uint32_t count)
+{
+	LEARN_PROFILE_SCOPE("LearnChannel::WheelExpire");
+	for (uint32_t k = 0; k < count; ++k)
+	{
+		LearnArrival arrival;
+		m_wheel->Pop(arrival);
+		NS_ASSERT_MSG(arrival.time == Simulator::Now().GetTimeStep() && arrival.context == Simulator::GetContext(),
+					  "Wheel arrival out of order");
+		DeliverRx(arrival.dst, arrival.src, arrival.packet);
+	}
+}
+
+void LearnChannel::DeliverSlotBatch(uint32_t node)
+{
+	std::map<uint32_t, std::vector<SlotRx>>::iterator it = m_slotBatches.find(node);
+	if (it == m_slotBatches.end())
+	{
+		return;
+	}
+	//
+	// The node's vector is kept for its next batch.
+	//
+	m_slotBatchScratch.swap(it->second);
+	for (std::size_t k = 0; k < m_slotBatchScratch.size(); ++k)
+	{
+		const SlotRx &rx = m_slotBatchScratch[k];
+		DeliverRx(rx.dst, rx.src, rx.packet);
+	}
+	m_slotBatchScratch.clear();
+	if (it->second.empty())
+	{
+		it->second.swap(m_slotBatchScratch);
+	}
+}
+
+std::size_t
+LearnChannel::GetNRxEvents(void) const
+{
+	return m_rxEvents.size();
+}
+
+//
+// A group costs one map entry and one index per member, whatever the number
+// of devices on the channel.
+//
+void LearnChannel::JoinGroup(std::size_t index, Mac48Address group)
+{
+	NS_LOG_FUNCTION(this << index << group);
+	NS_ASSERT_MSG(index < m_nDevices, "No device " << index);
+	NS_ABORT_MSG_IF(!group.IsGroup() || group.IsBroadcast(), group << " is not a multicast address");
+	std::vector<std::size_t> &members = m_groups[group];
+	if (std::find(members.begin(), members.end(), index) == members.end())
+	{
+		members.push_back(index);
+	}
+}
+
+void LearnChannel::LeaveGroup(std::size_t index, Mac48Address group)
+{
+	NS_LOG_FUNCTION(this << index << group);
+	std::map<Mac48Address, std::vector<std::size_t>>::iterator it = m_groups.find(group);
+	if (it == m_groups.end())
+	{
+		return;
+	}
+	std::vector<std::size_t> &members = it->second;
+	std::vector<std::size_t>::iterator member = std::find(members.begin(), members.end(), index);
+	if (member != members.end())
+	{
+		*member = members.back();
+		members.pop_back();
+	}
+	if (members.empty())
+	{
+		m_groups.erase(it);
+	}
+}
+
+std::size_t
+LearnChannel::GetNGroupMembers(Mac48Address group) const
+{
+	std::map<Mac48Address, std::vector<std::size_t>>::const_iterator it = m_groups.find(group);
+	return it == m_groups.end() ? 0 : it->second.size();
+}
+
+void LearnChannel::SetSlotScheduler(SlotScheduler scheduler)
+{
+	NS_LOG_FUNCTION(this);
+	m_slotScheduler = scheduler;
+}
+
+bool LearnChannel::IsSlotted(void) const
+{
+	return m_slotTime > Seconds(0.);
+}
+
+uint64_t
+LearnChannel::GetNSlots(void) const
+{
+	return m_nSlots;
+}
+
+void LearnChannel::NotifySlotDemand(std::size_t index)
+{
+	NS_LOG_FUNCTION(this << index);
+	NS_ASSERT_MSG(IsSlotted(), "SlotTime is not set");
+	if (m_slotDemandPos.size() < m_nDevices)
+	{
+		m_slotDemandPos.resize(m_nDevices, NOT_LISTENING);
+	}
+	if (m_slotDemandPos[index] == NOT_LISTENING)
+	{
+		m_slotDemandPos[index] = m_slotDemand.size();
+		m_slotDemand.push_back(index);
+	}
+	if (!m_slotRunning)
+	{
+		//
+		// Wake up at the next boundary; an idle channel costs no events.
+		//
+		int64_t now = Simulator::Now().GetTimeStep();
+		int64_t slot = m_slotTime.GetTimeStep();
+		m_slot = (now + slot - 1) / slot;
+		m_slotRunning = true;
+		m_slotEvent = Simulator::Schedule(TimeStep(m_slot * slot - now), &LearnChannel::SlotBoundary, this);
+	}
+}
+
+void LearnChannel::RemoveSlotDemand(std::size_t index)
+{
+	std::size_t pos = m_slotDemandPos[index];
+	std::size_t last = m_slotDemand.back();
+	m_slotDemand[pos] = last;
+	m_slotDemandPos[last] = pos;
+	m_slotDemand.pop_back();
+	m_slotDemandPos[index] = NOT_LISTENING;
+}
 
+void LearnChannel::RoundRobinGrants(uint64_t slot, const std::vector<std::size_t> &demand,
+									std::vector<std::size_t> &grants)
+{
+	std::size_t n = std::min<std::size_t>(m_grantsPerSlot, demand.size());
+	for (std::size_t k = 0; k < n; ++k)
+	{
+		grants.push_back(demand[(m_roundRobin + k) % demand.size()]);
+	}
+	m_roundRobin = demand.empty() ? 0 : (m_roundRobin + n) % demand.size();
+}
+
+//
+// One event per slot, plus one per receiving node, does the work that per
+// packet TransmitStart, TransmitComplete and receive events do otherwise.
+// Receptions are delivered in order of arrival at the first boundary after
+// they arrive; a slot longer than the airtime plus the largest delay delivers
+// each slot at the next boundary.
+//
+void LearnChannel::SlotBoundary(void)
+{
+	LEARN_PROFILE_SCOPE("LearnChannel::SlotBoundary");
+	NS_LOG_FUNCTION(this << m_slot);
+	++m_nSlots;
+	Time now = Simulator::Now();
+	if (!m_slotRx.empty())
+	{
+		std::stable_sort(m_slotRx.begin(), m_slotRx.end(),
+						 [](const SlotRx &a, const SlotRx &b) { return a.arrival < b.arrival; });
+		//
+		// Delivered from a copy: a receiver may send, which fills m_slotRx again.
+		//
+		std::vector<SlotRx> batch;
+		batch.swap(m_slotRx);
+		uint32_t context = Simulator::GetContext();
+		for (std::size_t k = 0; k < batch.size(); ++k)
+		{
+			const SlotRx &rx = batch[k];
+			if (rx.arrival > now)
+			{
+				m_slotRxLater.push_back(rx);
+				continue;
+			}
 			//
-			// Trace sources designed to simulate a packet sniffer facility (tcpdump).
-			// Note that there is really no difference between promiscuous and
-			// non-promiscuous traces in a point-to-point link.
+			// A node expects its receptions in its own context: those of other
+			// nodes go in one event per node and slot, in order of arrival.
 			//
-			.AddTraceSource("Sniffer",
-							"Trace source simulating a non-promiscuous packet sniffer "
-							"attached to the device",
-							MakeTraceSourceAccessor(&LearnNetDevice::m_snifferTrace),
-							"ns3::Packet::TracedCallback")
-			.AddTraceSource("PromiscSniffer",
-							"Trace source simulating a promiscuous packet sniffer "
-							"attached to the device",
-							MakeTraceSourceAccessor(&LearnNetDevice::m_promiscSnifferTrace),
-							"ns3::Packet::TracedCallback");
-	return tid;
+			Ptr<Node> node = rx.packet == 0 ? Ptr<Node>(0) : m_devices[rx.dst]->GetNode();
+			if (node == 0 || node->GetId() == context)
+			{
+				DeliverRx(rx.dst, rx.src, rx.packet);
+				continue;
+			}
+			std::vector<SlotRx> &nodeBatch = m_slotBatches[node->GetId()];
+			if (nodeBatch.empty())
+			{
+				Simulator::ScheduleWithContext(node->GetId(), Seconds(0), &LearnChannel::DeliverSlotBatch, this,
+											   node->GetId());
+			}
+			nodeBatch.push_back(rx);
+		}
+		m_slotRx.insert(m_slotRx.end(), m_slotRxLater.begin(), m_slotRxLater.end());
+		m_slotRxLater.clear();
+	}
+
+	m_grants.clear();
+	if (!m_slotDemand.empty())
+	{
+		if (m_slotScheduler.IsNull())
+		{
+			RoundRobinGrants(m_slot, m_slotDemand, m_grants);
+		}
+		else
+		{
+			m_slotScheduler(m_slot, m_slotDemand, m_grants);
+		}
+	}
+	for (std::size_t k = 0; k < m_grants.size(); ++k)
+	{
+		std::size_t i = m_grants[k];
+		NS_ASSERT_MSG(i < m_nDevices && m_devices[i] != 0, "Slot granted to a device that cannot send");
+		if (!m_devices[i]->TransmitSlot() && m_slotDemandPos[i] != NOT_LISTENING)
+		{
+			RemoveSlotDemand(i);
+		}
+	}
+
+	++m_slot;
+	if (m_slotDemand.empty() && m_slotRx.empty())
+	{
+		m_slotRunning = false;
+		return;
+	}
+	m_slotEvent = Simulator::Schedule(m_slotTime, &LearnChannel::SlotBoundary, this);
 }
 
-LearnNetDevice::LearnNetDevice()
-	: m_txMachineState(READY), m_channel(0), m_linkUp(false), m_currentPkt(0)
+void LearnChannel::DoDispose(void)
 {
 	NS_LOG_FUNCTION(this);
+	//
+	// Events still queued live on until the simulator releases them, but no
+	// longer reach the channel.
+	//
+	for (std::size_t k = 0; k < m_rxEvents.size(); ++k)
+	{
+		m_rxEvents[k]->m_channel = 0;
+		m_rxEvents[k]->m_packet = 0;
+		m_rxEvents[k]->Unref();
+	}
+	m_rxEvents.clear();
+	m_freeRxEvents = 0;
+	m_slotEvent.Cancel();
+	m_slotRx.clear();
+	m_slotBatches.clear();
+	for (std::size_t k = 0; k < m_wheelEvents.size(); ++k)
+	{
+		m_wheelEvents[k]->m_channel = 0;
+		m_wheelEvents[k]->Unref();
+	}
+	m_wheelEvents.clear();
+	m_freeWheelEvents = 0;
+	m_wheelGroup = 0;
+	m_wheel = 0;
+	m_fluidFlows.clear();
+	m_slotScheduler = SlotScheduler();
+	Channel::DoDispose();
 }
 
-LearnNetDevice::~LearnNetDevice()
+void LearnChannel::DeliverInFlight(uint64_t id)
 {
-	NS_LOG_FUNCTION(this);
+	std::map<uint64_t, InFlight>::iterator it = m_inFlight.find(id);
+	NS_ASSERT_MSG(it != m_inFlight.end(), "Unknown packet in flight");
+	InFlight f = it->second;
+	m_inFlight.erase(it);
+	m_devices[f.dst]->Receive(f.packet, m_devices[f.src]);
 }
 
-void LearnNetDevice::DoDispose()
+std::size_t
+LearnChannel::GetNDevices(void) const
 {
-	NS_LOG_FUNCTION(this);
-	m_node = 0;
-	m_channel = 0;
-	m_receiveErrorModel = 0;
-	m_currentPkt = 0;
-	m_queue = 0;
-	NetDevice::DoDispose();
+	NS_LOG_FUNCTION_NOARGS();
+	return m_nDevices;
+}
+
+Ptr<LearnNetDevice>
+LearnChannel::GetLearnDevice(std::size_t i) const
+{
+	NS_LOG_FUNCTION_NOARGS();
+	NS_ASSERT(i < m_nDevices);
+	return m_devices[i];
+}
+
+Ptr<NetDevice>
+LearnChannel::GetDevice(std::size_t i) const
+{
+	NS_LOG_FUNCTION_NOARGS();
+	return GetLearnDevice(i);
+}
+
+void LearnChannel::SetLinkLoss(std::size_t src, std::size_t dst, double p)
+{
+	NS_LOG_FUNCTION(this << src << dst << p);
+	NS_ASSERT_MSG(src < m_nDevices && dst < m_nDevices, "No such device on the channel");
+	NS_ASSERT_MSG(p >= 0.0 && p <= 1.0, "Loss probability must be in [0, 1]");
+
+	LinkLossRow &row = m_linkLoss[src];
+	LinkLossRow::iterator it = std::lower_bound(row.begin(), row.end(), std::make_pair(dst, 0.0));
+	bool found = (it != row.end() && it->first == dst);
+	double old = found ? it->second : 0.0;
+	if (p == 0.0)
+	{
+		//
+		// Lossless links are kept out of the row so they stay on the fast path.
+		//
+		if (found)
+		{
+			row.erase(it);
+		}
+	}
+	else if (found)
+	{
+		it->second = p;
+	}
+	else
+	{
+		row.insert(it, std::make_pair(dst, p));
+	}
+	//
+	// Lossy links stay usable for relaying, only dead ones change the paths.
+	//
+	if ((p >= 1.0) != (old >= 1.0))
+	{
+		++m_topologyEpoch;
+	}
+}
+
+void LearnChannel::SetLinkLoss(Ptr<LearnNetDevice> src, Ptr<LearnNetDevice> dst, double p)
+{
+	SetLinkLoss(src->GetChannelIndex(), dst->GetChannelIndex(), p);
+}
+
+double
+LearnChannel::GetLinkLoss(std::size_t src, std::size_t dst) const
+{
+	NS_ASSERT_MSG(src < m_nDevices && dst < m_nDevices, "No such device on the channel");
+	return FindLinkLoss(m_linkLoss[src], dst);
+}
+
+double
+LearnChannel::FindLinkLoss(const LinkLossRow &row, std::size_t dst)
+{
+	LinkLossRow::const_iterator it = std::lower_bound(row.begin(), row.end(), std::make_pair(dst, 0.0));
+	if (it != row.end() && it->first == dst)
+	{
+		return it->second;
+	}
+	return 0.0;
+}
+
+//
+// Background flows are not simulated packet by packet. Each one is a Poisson
+// stream of fixed size packets holding the medium for their airtime, and the
+// channel is treated as a single M/G/1 server: a foreground packet waits on
+// average sum(lambda * T^2) / (2 * (1 - rho)) for the medium (Pollaczek-Khinchine).
+//
+void LearnChannel::AddFluidFlow(Ptr<LearnNetDevice> src, DataRate rate, uint32_t packetSize)
+{
+	AddFluidFlow(src, 0, rate, packetSize);
+}
+
+void LearnChannel::AddFluidFlow(Ptr<LearnNetDevice> src, Ptr<LearnNetDevice> dst, DataRate rate, uint32_t packetSize)
+{
+	NS_LOG_FUNCTION(this << src << dst << rate << packetSize);
+	NS_ASSERT_MSG(packetSize > 0, "Fluid flow needs a packet size");
+	NS_ASSERT_MSG(src->GetChannel() == this && (dst == 0 || dst->GetChannel() == this),
+				  "Fluid flow between devices of another channel");
+	FluidFlow flow = {src, dst == 0 ? NO_DEVICE : dst->GetChannelIndex(), rate, packetSize};
+	m_fluidFlows.push_back(flow);
+	m_fluidStale = true;
+	SyncFluidLoad();
+}
+
+void LearnChannel::ClearFluidFlows(void)
+{
+	NS_LOG_FUNCTION(this);
+	m_fluidFlows.clear();
+	m_fluidStale = true;
+}
+
+void LearnChannel::NotifyRateChange(void)
+{
+	if (!m_fluidFlows.empty())
+	{
+		m_fluidStale = true;
+	}
+}
+
+//
+// The airtime of a flow follows the rate its sender uses now, so the load is
+// computed again after a change of rate, rate table or geometry, when next
+// needed.
+//
+void LearnChannel::SyncFluidLoad(void)
+{
+	if (!m_fluidStale)
+	{
+		return;
+	}
+	m_fluidStale = false;
+	m_fluidLoad = 0;
+	m_fluidSecondMoment = 0;
+	for (std::size_t k = 0; k < m_fluidFlows.size(); ++k)
+	{
+		const FluidFlow &flow = m_fluidFlows[k];
+		DataRate txRate = flow.dst == NO_DEVICE ? flow.src->GetBroadcastRate() : flow.src->GetLinkRate(flow.dst);
+		double airtime = txRate.CalculateBytesTxTime(flow.packetSize).GetSeconds();
+		double pktRate = flow.rate.GetBitRate() / (8.0 * flow.packetSize);
+		m_fluidLoad += pktRate * airtime;
+		m_fluidSecondMoment += pktRate * airtime * airtime;
+	}
+	NS_ABORT_MSG_IF(m_fluidLoad >= 1.0, "Fluid load " << m_fluidLoad << " saturates the channel");
+	m_fluidWait = Seconds(m_fluidSecondMoment / (2.0 * (1.0 - m_fluidLoad)));
+	NS_LOG_LOGIC("Fluid load " << m_fluidLoad << ", mean wait " << m_fluidWait.GetSeconds() << "s");
+}
+
+double
+LearnChannel::GetFluidLoad(void)
+{
+	SyncFluidLoad();
+	return m_fluidLoad;
+}
+
+Time LearnChannel::GetFluidWait(void)
+{
+	SyncFluidLoad();
+	return m_fluidWait;
+}
+
+//
+// A packet finds the medium free with probability 1 - rho. Otherwise it waits
+// an exponential time of mean W / rho, so that the mean over all packets is
+// the Pollaczek-Khinchine wait W. The split is exact for M/M/1 and keeps the
+// tail of the waits for the latency statistics. One draw per packet, none
+// without flows.
+//
+Time LearnChannel::DrawFluidWait(void)
+{
+	SyncFluidLoad();
+	if (m_fluidLoad <= 0)
+	{
+		return Seconds(0.);
+	}
+	double u = m_fluidRng->GetValue();
+	if (u >= m_fluidLoad)
+	{
+		return Seconds(0.);
+	}
+	return Seconds(-m_fluidWait.GetSeconds() / m_fluidLoad * std::log(1 - u / m_fluidLoad));
+}
+
+int64_t
+LearnChannel::AssignStreams(int64_t stream)
+{
+	NS_LOG_FUNCTION(this << stream);
+	m_lossRng->SetStream(stream);
+	m_fluidRng->SetStream(stream + 1);
+	int64_t n = 2;
+	if (m_lossModel != 0)
+	{
+		n += m_lossModel->AssignStreams(stream + n);
+	}
+	if (m_fadingModel != 0)
+	{
+		n += m_fadingModel->AssignStreams(stream + n);
+	}
+	if (m_delayModel != 0)
+	{
+		n += m_delayModel->AssignStreams(stream + n);
+	}
+	return n;
+}
+
+void LearnChannel::SaveCheckpoint(std::ostream &os)
+{
+	NS_LOG_FUNCTION(this);
+	if (!m_trackInFlight)
+	{
+		NS_LOG_WARN("TrackInFlight is off, packets in flight are not part of the checkpoint");
+	}
+	Time now = Simulator::Now();
+	os.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+	WriteRaw<uint64_t>(os, m_nDevices);
+	WriteTime(os, m_delay_fac);
+	WriteRaw<uint64_t>(os, m_fluidFlows.size());
+	for (std::size_t k = 0; k < m_fluidFlows.size(); ++k)
+	{
+		WriteRaw<uint64_t>(os, m_fluidFlows[k].src->GetChannelIndex());
+		WriteRaw<uint64_t>(os, m_fluidFlows[k].dst);
+		WriteRaw<uint64_t>(os, m_fluidFlows[k].rate.GetBitRate());
+		WriteRaw(os, m_fluidFlows[k].packetSize);
+	}
+	for (std::size_t i = 0; i < m_nDevices; ++i)
+	{
+		WriteRaw<uint64_t>(os, m_linkLoss[i].size());
+		for (LinkLossRow::const_iterator it = m_linkLoss[i].begin(); it != m_linkLoss[i].end(); ++it)
+		{
+			WriteRaw<uint64_t>(os, it->first);
+			WriteRaw(os, it->second);
+		}
+	}
+	for (std::size_t i = 0; i < m_nDevices; ++i)
+	{
+		WriteTime(os, std::max(m_busyUntil[i] - now, Seconds(0.)));
+	}
+	for (std::size_t i = 0; i < m_nDevices; ++i)
+	{
+		WriteRaw<uint8_t>(os, m_devices[i] == 0);
+		if (m_devices[i] == 0)
+		{
+			WriteRaw(os, m_posX[i]);
+			WriteRaw(os, m_posY[i]);
+			WriteRaw(os, m_rxCount[i]);
+		}
+		else
+		{
+			m_devices[i]->SaveState(os);
+		}
+	}
+	WriteRaw<uint64_t>(os, m_inFlight.size());
+	for (std::map<uint64_t, InFlight>::const_iterator it = m_inFlight.begin(); it != m_inFlight.end(); ++it)
+	{
+		WriteRaw<uint64_t>(os, it->second.dst);
+		WriteRaw<uint64_t>(os, it->second.src);
+		WriteTime(os, it->second.arrival - now);
+		WritePacket(os, it->second.packet);
+	}
+	NS_ABORT_MSG_IF(!os, "Failed to write checkpoint");
+}
+
+void LearnChannel::SaveCheckpoint(std::string filename)
+{
+	std::ofstream os(filename.c_str(), std::ios::binary);
+	NS_ABORT_MSG_IF(!os, "Cannot open checkpoint " << filename);
+	SaveCheckpoint(os);
+}
+
+void LearnChannel::RestoreCheckpoint(std::istream &is)
+{
+	NS_LOG_FUNCTION(this);
+	char magic[sizeof(CHECKPOINT_MAGIC)];
+	is.read(magic, sizeof(magic));
+	NS_ABORT_MSG_IF(!is || memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0, "Not a LearnChannel checkpoint");
+	uint64_t nDevices = ReadRaw<uint64_t>(is);
+	NS_ABORT_MSG_IF(nDevices != m_nDevices, "Checkpoint has " << nDevices << " devices, channel has " << m_nDevices);
+	m_delay_fac = ReadTime(is);
+	ClearPropagationCache();
+	m_fluidFlows.resize(ReadRaw<uint64_t>(is));
+	for (std::size_t k = 0; k < m_fluidFlows.size(); ++k)
+	{
+		FluidFlow &flow = m_fluidFlows[k];
+		uint64_t src = ReadRaw<uint64_t>(is);
+		flow.dst = ReadRaw<uint64_t>(is);
+		NS_ABORT_MSG_IF(src >= m_nDevices || m_devices[src] == 0 || (flow.dst != NO_DEVICE && flow.dst >= m_nDevices),
+						"Corrupt checkpoint");
+		flow.src = m_devices[src];
+		flow.rate = DataRate(ReadRaw<uint64_t>(is));
+		flow.packetSize = ReadRaw<uint32_t>(is);
+	}
+	m_fluidStale = true;
+	for (std::size_t i = 0; i < m_nDevices; ++i)
+	{
+		m_linkLoss[i].resize(ReadRaw<uint64_t>(is));
+		for (LinkLossRow::iterator it = m_linkLoss[i].begin(); it != m_linkLoss[i].end(); ++it)
+		{
+			it->first = ReadRaw<uint64_t>(is);
+			it->second = ReadRaw<double>(is);
+		}
+	}
+	//
+	// Restored losses can cut or open links, next hop trees are rebuilt.
+	//
+	++m_topologyEpoch;
+	//
+	// Busy until times are saved from now, a carrier sensed at the checkpoint
+	// stays sensed for the same time after the restore.
+	//
+	Time now = Simulator::Now();
+	for (std::size_t i = 0; i < m_nDevices; ++i)
+	{
+		m_busyUntil[i] = now + ReadTime(is);
+	}
+	for (std::size_t i = 0; i < m_nDevices; ++i)
+	{
+		bool compact = ReadRaw<uint8_t>(is) != 0;
+		NS_ABORT_MSG_IF(compact != (m_devices[i] == 0), "Device " << i << " is compact in only one of checkpoint and channel");
+		if (compact)
+		{
+			if (m_connectivityBuilt)
+			{
+				RemoveFromConnectivity(i);
+			}
+			m_posX[i] = ReadRaw<double>(is);
+			m_posY[i] = ReadRaw<double>(is);
+			++m_posEpoch[i];
+			m_rxCount[i] = ReadRaw<uint32_t>(is);
+			if (m_connectivityBuilt)
+			{
+				AddToConnectivity(i);
+			}
+		}
+		else
+		{
+			m_devices[i]->RestoreState(is);
+		}
+	}
+	//
+	// Packets in flight are rescheduled in their original order, so arrivals at
+	// the same time are delivered as they would have been.
+	//
+	uint64_t nInFlight = ReadRaw<uint64_t>(is);
+	for (uint64_t k = 0; k < nInFlight; ++k)
+	{
+		std::size_t dst = ReadRaw<uint64_t>(is);
+		std::size_t src = ReadRaw<uint64_t>(is);
+		Time delay = ReadTime(is);
+		NS_ABORT_MSG_IF(dst >= m_nDevices || src >= m_nDevices, "Corrupt checkpoint");
+		ScheduleArrival(dst, src, ReadPacket(is), delay);
+	}
+}
+
+void LearnChannel::RestoreCheckpoint(std::string filename)
+{
+	std::ifstream is(filename.c_str(), std::ios::binary);
+	NS_ABORT_MSG_IF(!is, "Cannot open checkpoint " << filename);
+	RestoreCheckpoint(is);
+}
+
+std::size_t
+LearnChannel::FindDevice(Mac48Address address) const
+{
+	std::map<Mac48Address, std::size_t>::const_iterator it = m_addressIndex.find(address);
+	return it == m_addressIndex.end() ? NO_DEVICE : it->second;
+}
+
+void LearnChannel::NotifyAddressChange(std::size_t index, Mac48Address oldAddress, Mac48Address newAddress)
+{
+	NS_LOG_FUNCTION(this << index << oldAddress << newAddress);
+	std::map<Mac48Address, std::size_t>::iterator it = m_addressIndex.find(oldAddress);
+	if (it != m_addressIndex.end() && it->second == index)
+	{
+		m_addressIndex.erase(it);
+	}
+	m_addressIndex[newAddress] = index;
+}
+
+LearnChannel::Cell
+LearnChannel::GetCell(std::size_t index) const
+{
+	return Cell(static_cast<int64_t>(std::floor(m_posX[index] / m_maxRange)),
+				static_cast<int64_t>(std::floor(m_posY[index] / m_maxRange)));
+}
+
+//
+// Devices in range of each other are at most one grid cell apart, so only
+// the 3 x 3 cells around a device are searched.
+//
+void LearnChannel::AddToConnectivity(std::size_t index)
+{
+	Cell cell = GetCell(index);
+	m_cells[index] = cell;
+	for (int64_t dx = -1; dx <= 1; ++dx)
+	{
+		for (int64_t dy = -1; dy <= 1; ++dy)
+		{
+			std::map<Cell, std::vector<std::size_t>>::const_iterator it =
+				m_grid.find(Cell(cell.first + dx, cell.second + dy));
+			if (it == m_grid.end())
+			{
+				continue;
+			}
+			for (std::size_t k = 0; k < it->second.size(); ++k)
+			{
+				std::size_t j = it->second[k];
+				if (GetDist(index, j) <= m_maxRange)
+				{
+					m_neighbours[index].push_back(j);
+					m_neighbours[j].push_back(index);
+				}
+			}
+		}
+	}
+	m_grid[cell].push_back(index);
+}
+
+void LearnChannel::RemoveFromConnectivity(std::size_t index)
+{
+	std::vector<std::size_t> &members = m_grid[m_cells[index]];
+	members.erase(std::find(members.begin(), members.end(), index));
+	for (std::size_t k = 0; k < m_neighbours[index].size(); ++k)
+	{
+		std::vector<std::size_t> &other = m_neighbours[m_neighbours[index][k]];
+		other.erase(std::find(other.begin(), other.end(), index));
+	}
+	m_neighbours[index].clear();
+}
+
+//
+// A moved device keeps its neighbour list unless devices came into or went
+// out of range. Only the links that changed are applied, and only the next
+// hop trees they can change are marked stale.
+//
+void LearnChannel::MoveInConnectivity(std::size_t index)
+{
+	Cell cell = GetCell(index);
+	if (cell != m_cells[index])
+	{
+		std::vector<std::size_t> &members = m_grid[m_cells[index]];
+		members.erase(std::find(members.begin(), members.end(), index));
+		m_grid[cell].push_back(index);
+		m_cells[index] = cell;
+	}
+	std::vector<std::size_t> &found = m_neighbourScratch;
+	found.clear();
+	for (int64_t dx = -1; dx <= 1; ++dx)
+	{
+		for (int64_t dy = -1; dy <= 1; ++dy)
+		{
+			std::map<Cell, std::vector<std::size_t>>::const_iterator it =
+				m_grid.find(Cell(cell.first + dx, cell.second + dy));
+			if (it == m_grid.end())
+			{
+				continue;
+			}
+			for (std::size_t k = 0; k < it->second.size(); ++k)
+			{
+				std::size_t j = it->second[k];
+				if (j != index && GetDist(index, j) <= m_maxRange)
+				{
+					found.push_back(j);
+				}
+			}
+		}
+	}
+	std::vector<std::size_t> &old = m_neighbours[index];
+	std::sort(found.begin(), found.end());
+	std::sort(old.begin(), old.end());
+	if (found == old)
+	{
+		return;
+	}
+	std::size_t a = 0;
+	std::size_t b = 0;
+	while (a < old.size() || b < found.size())
+	{
+		if (b == found.size() || (a < old.size() && old[a] < found[b]))
+		{
+			std::vector<std::size_t> &other = m_neighbours[old[a]];
+			other.erase(std::find(other.begin(), other.end(), index));
+			InvalidateNextHops(index, old[a], false);
+			++a;
+		}
+		else if (a == old.size() || found[b] < old[a])
+		{
+			m_neighbours[found[b]].push_back(index);
+			InvalidateNextHops(index, found[b], true);
+			++b;
+		}
+		else
+		{
+			++a;
+			++b;
+		}
+	}
+	old.swap(found);
+}
+
+//
+// Breadth first trees stay shortest path trees when a link off the tree goes
+// away, or when a new link joins devices whose depths differ by at most one.
+//
+void LearnChannel::InvalidateNextHops(std::size_t i, std::size_t j, bool added)
+{
+	const uint32_t unreached = ~static_cast<uint32_t>(0);
+	for (std::map<std::size_t, NextHopTree>::iterator it = m_nextHops.begin(); it != m_nextHops.end(); ++it)
+	{
+		NextHopTree &tree = it->second;
+		if (tree.stale || tree.nextHop.size() != m_nDevices)
+		{
+			continue;
+		}
+		if (!added)
+		{
+			tree.stale = tree.nextHop[i] == j || tree.nextHop[j] == i;
+			continue;
+		}
+		uint32_t di = tree.depth[i];
+		uint32_t dj = tree.depth[j];
+		tree.stale = (dj != unreached && m_devices[i] != 0 && (di == unreached || di > dj + 1)) ||
+					 (di != unreached && m_devices[j] != 0 && (dj == unreached || dj > di + 1));
+	}
+}
+
+void LearnChannel::NotifyPositionChange(std::size_t index)
+{
+	NS_ASSERT(m_devices[index] != 0);
+	m_posX[index] = m_devices[index]->GetX();
+	m_posY[index] = m_devices[index]->GetY();
+	m_nRaised -= m_posZ[index] != 0;
+	m_posZ[index] = m_devices[index]->GetZ();
+	m_nRaised += m_posZ[index] != 0;
+	++m_posEpoch[index];
+	NotifyRateChange();
+	if (m_connectivityBuilt)
+	{
+		MoveInConnectivity(index);
+	}
+}
+
+uint32_t
+LearnChannel::GetPositionEpoch(std::size_t index) const
+{
+	return m_posEpoch[index];
+}
+
+double
+LearnChannel::GetX(std::size_t index) const
+{
+	return m_posX[index];
+}
+
+double
+LearnChannel::GetY(std::size_t index) const
+{
+	return m_posY[index];
+}
+
+double
+LearnChannel::GetZ(std::size_t index) const
+{
+	return m_posZ[index];
+}
+
+void LearnChannel::NotifyAntennaChange(std::size_t index)
+{
+	NS_ASSERT(m_devices[index] != 0);
+	Ptr<const LearnAntennaPattern> pattern = m_devices[index]->GetAntenna();
+	if (m_antennas.empty())
+	{
+		if (pattern == 0)
+		{
+			return;
+		}
+		m_antennas.resize(m_nDevices);
+	}
+	AntennaState &antenna = m_antennas[index];
+	if (antenna.pattern == 0 && pattern != 0)
+	{
+		++m_nAntennas;
+	}
+	else if (antenna.pattern != 0 && pattern == 0)
+	{
+		--m_nAntennas;
+		std::vector<LinkAngles>().swap(antenna.angles);
+	}
+	antenna.pattern = pattern;
+	antenna.azimuth = m_devices[index]->GetAzimuth();
+	antenna.tilt = m_devices[index]->GetTilt();
+	++antenna.epoch;
+	NotifyRateChange();
+}
+
+uint32_t
+LearnChannel::GetGeometryEpoch(std::size_t index) const
+{
+	return m_posEpoch[index] + (m_antennas.empty() ? 0 : m_antennas[index].epoch);
+}
+
+//
+// Directions only depend on positions, so turning an antenna keeps every
+// cached direction and a beam sweep only redoes the table lookups. Rows are
+// kept for the devices with an antenna only.
+//
+const LearnChannel::LinkAngles &
+LearnChannel::GetLinkAngles(std::size_t from, std::size_t to)
+{
+	std::vector<LinkAngles> &row = m_antennas[from].angles;
+	if (row.size() < m_nDevices)
+	{
+		LinkAngles invalid = {0, 0, 0, 0};
+		row.resize(m_nDevices, invalid);
+	}
+	LinkAngles &angles = row[to];
+	if (angles.fromEpoch != m_posEpoch[from] || angles.toEpoch != m_posEpoch[to])
+	{
+		double dx = m_posX[to] - m_posX[from];
+		double dy = m_posY[to] - m_posY[from];
+		double dz = m_posZ[to] - m_posZ[from];
+		angles.fromEpoch = m_posEpoch[from];
+		angles.toEpoch = m_posEpoch[to];
+		angles.azimuth = std::atan2(dy, dx) * 180 / M_PI;
+		angles.elevation = std::atan2(dz, std::sqrt(dx * dx + dy * dy)) * 180 / M_PI;
+	}
+	return angles;
+}
+
+double
+LearnChannel::GetAntennaGain(std::size_t from, std::size_t to)
+{
+	const AntennaState &antenna = m_antennas[from];
+	if (antenna.pattern == 0)
+	{
+		return 0;
+	}
+	const LinkAngles &angles = GetLinkAngles(from, to);
+	double azimuth = std::fmod(angles.azimuth - antenna.azimuth, 360.0);
+	if (azimuth > 180)
+	{
+		azimuth -= 360;
+	}
+	else if (azimuth < -180)
+	{
+		azimuth += 360;
+	}
+	return antenna.pattern->GetGain(azimuth, angles.elevation - antenna.tilt);
+}
+
+double
+LearnChannel::GetLinkGain(std::size_t src, std::size_t dst)
+{
+	if (m_nAntennas == 0)
+	{
+		return 0;
+	}
+	return GetAntennaGain(src, dst) + GetAntennaGain(dst, src);
+}
+
+void LearnChannel::SetObstacles(Ptr<LearnObstacleMap> obstacles)
+{
+	NS_LOG_FUNCTION(this << obstacles);
+	m_obstacles = obstacles;
+	m_los.clear();
+	m_losVersion = obstacles != 0 ? obstacles->GetVersion() : 0;
+	++m_topologyEpoch;
+}
+
+Ptr<LearnObstacleMap>
+LearnChannel::GetObstacles(void) const
+{
+	return m_obstacles;
+}
+
+void LearnChannel::SyncLineOfSight(void)
+{
+	if (m_obstacles != 0 && m_losVersion != m_obstacles->GetVersion())
+	{
+		m_los.clear();
+		m_losVersion = m_obstacles->GetVersion();
+		++m_topologyEpoch;
+	}
+}
+
+//
+// Links are only tested when used, and the result kept until one end moves.
+// The cache holds the links used since, not all n^2 of them.
+//
+bool LearnChannel::IsLineOfSight(std::size_t i, std::size_t j)
+{
+	if (m_obstacles == 0 || i == j)
+	{
+		return true;
+	}
+	SyncLineOfSight();
+	std::size_t low = std::min(i, j);
+	std::size_t high = std::max(i, j);
+	std::pair<std::unordered_map<uint64_t, LosEntry>::iterator, bool> slot =
+		m_los.insert(std::make_pair(static_cast<uint64_t>(low) << 32 | high, LosEntry()));
+	LosEntry &entry = slot.first->second;
+	if (slot.second || entry.lowEpoch != m_posEpoch[low] || entry.highEpoch != m_posEpoch[high])
+	{
+		entry.lowEpoch = m_posEpoch[low];
+		entry.highEpoch = m_posEpoch[high];
+		entry.los = !m_obstacles->IsBlocked(m_posX[i], m_posY[i], m_posZ[i], m_posX[j], m_posY[j], m_posZ[j]);
+	}
+	return entry.los;
+}
+
+void LearnChannel::SetPropagationDelayModel(Ptr<PropagationDelayModel> model)
+{
+	NS_LOG_FUNCTION(this << model);
+	m_delayModel = model;
+	ClearPropagationCache();
+}
+
+Ptr<PropagationDelayModel>
+LearnChannel::GetPropagationDelayModel(void) const
+{
+	return m_delayModel;
+}
+
+void LearnChannel::SetPropagationLossModel(Ptr<PropagationLossModel> model)
+{
+	NS_LOG_FUNCTION(this << model);
+	m_lossModel = model;
+	ClearPropagationCache();
+}
+
+Ptr<PropagationLossModel>
+LearnChannel::GetPropagationLossModel(void) const
+{
+	return m_lossModel;
+}
+
+void LearnChannel::SetFadingLossModel(Ptr<PropagationLossModel> model)
+{
+	NS_LOG_FUNCTION(this << model);
+	m_fadingModel = model;
+}
+
+Ptr<PropagationLossModel>
+LearnChannel::GetFadingLossModel(void) const
+{
+	return m_fadingModel;
+}
+
+void LearnChannel::ClearPropagationCache(void)
+{
+	NS_LOG_FUNCTION(this);
+	m_propagation.clear();
+}
+
+void LearnChannel::SetMobility(std::size_t src, std::size_t dst)
+{
+	if (m_srcMobility == 0)
+	{
+		m_srcMobility = CreateObject<ConstantPositionMobilityModel>();
+		m_dstMobility = CreateObject<ConstantPositionMobilityModel>();
+	}
+	m_srcMobility->SetPosition(Vector(m_posX[src], m_posY[src], m_posZ[src]));
+	m_dstMobility->SetPosition(Vector(m_posX[dst], m_posY[dst], m_posZ[dst]));
+}
+
+//
+// The models take mobility models, so each evaluation first places two
+// stand-ins at the link's ends. A memo entry is redone when either end moves
+// or turns its antenna; a fixed topology evaluates each model once per link.
+//
+const LearnChannel::Propagation &
+LearnChannel::GetPropagation(std::size_t src, std::size_t dst)
+{
+	std::pair<std::unordered_map<uint64_t, Propagation>::iterator, bool> slot =
+		m_propagation.insert(std::make_pair(static_cast<uint64_t>(src) << 32 | dst, Propagation()));
+	Propagation &propagation = slot.first->second;
+	uint32_t srcEpoch = GetGeometryEpoch(src);
+	uint32_t dstEpoch = GetGeometryEpoch(dst);
+	if (slot.second || propagation.srcEpoch != srcEpoch || propagation.dstEpoch != dstEpoch)
+	{
+		SetMobility(src, dst);
+		propagation.srcEpoch = srcEpoch;
+		propagation.dstEpoch = dstEpoch;
+		propagation.delay = m_delayModel != 0 ? m_delayModel->GetDelay(m_srcMobility, m_dstMobility)
+											  : m_delay_fac * GetDist(src, dst);
+		propagation.rxPower =
+			(m_lossModel != 0 ? m_lossModel->CalcRxPower(m_txPower, m_srcMobility, m_dstMobility) : m_txPower) +
+			GetLinkGain(src, dst);
+	}
+	return propagation;
+}
+
+double
+LearnChannel::GetRxPower(std::size_t src, std::size_t dst)
+{
+	NS_ASSERT_MSG(src < m_nDevices && dst < m_nDevices, "No such device on the channel");
+	return GetPropagation(src, dst).rxPower;
+}
+
+//
+// Free space loss grows as 20 log10(d), so a gain of G dB has the effect of
+// dividing the distance by 10^(G/20). Range and rate decisions use this
+// distance; the propagation delay keeps the geometric one.
+//
+double
+LearnChannel::GetEffectiveDist(std::size_t src, std::size_t dst)
+{
+	double dist = GetDist(src, dst);
+	if (m_nAntennas == 0)
+	{
+		return dist;
+	}
+	return dist * std::pow(10.0, -GetLinkGain(src, dst) / 20);
+}
+
+std::size_t
+LearnChannel::GetNextHop(std::size_t src, std::size_t dst)
+{
+	NS_ASSERT_MSG(src < m_nDevices && dst < m_nDevices, "No such device on the channel");
+	if (src == dst || m_maxRange <= 0)
+	{
+		return dst;
+	}
+	if (!m_connectivityBuilt)
+	{
+		m_connectivityBuilt = true;
+		m_cells.resize(m_nDevices);
+		m_neighbours.resize(m_nDevices);
+		for (std::size_t i = 0; i < m_nDevices; ++i)
+		{
+			AddToConnectivity(i);
+		}
+	}
+
+	//
+	// One tree per destination, grown breadth first from the destination over
+	// the links that are not dead. A device's parent in the tree is its next
+	// hop. Moves that change links mark the trees they affect stale, other
+	// changes all of them; each is rebuilt when next used. Compact devices
+	// cannot relay and are left out.
+	//
+	SyncLineOfSight();
+	NextHopTree &tree = m_nextHops[dst];
+	if (tree.nextHop.size() != m_nDevices || tree.epoch != m_topologyEpoch || tree.stale)
+	{
+		const uint32_t unreached = ~static_cast<uint32_t>(0);
+		tree.epoch = m_topologyEpoch;
+		tree.stale = false;
+		tree.nextHop.assign(m_nDevices, unreached);
+		tree.depth.assign(m_nDevices, unreached);
+		tree.nextHop[dst] = dst;
+		tree.depth[dst] = 0;
+		std::vector<std::size_t> frontier(1, dst);
+		for (std::size_t head = 0; head < frontier.size(); ++head)
+		{
+			std::size_t v = frontier[head];
+			const std::vector<std::size_t> &neighbours = m_neighbours[v];
+			for (std::size_t k = 0; k < neighbours.size(); ++k)
+			{
+				std::size_t u = neighbours[k];
+				if (tree.nextHop[u] != unreached || m_devices[u] == 0 || FindLinkLoss(m_linkLoss[u], v) >= 1.0 ||
+					(m_nlosLoss >= 1.0 && !IsLineOfSight(u, v)))
+				{
+					continue;
+				}
+				tree.nextHop[u] = v;
+				tree.depth[u] = tree.depth[v] + 1;
+				frontier.push_back(u);
+			}
+		}
+	}
+	uint32_t hop = tree.nextHop[src];
+	return hop == ~static_cast<uint32_t>(0) ? NO_DEVICE : hop;
+}
+
+Time LearnChannel::GetDelay(Ptr<LearnNetDevice> n1, Ptr<LearnNetDevice> n2) const
+{
+	return m_delay_fac * GetDist(n1->GetChannelIndex(), n2->GetChannelIndex());
+}
+
+Time LearnChannel::GetDelayFac(void) const
+{
+	return m_delay_fac;
+}
+
+double
+LearnChannel::GetDist(std::size_t i, std::size_t j) const
+{
+	double x1 = m_posX[i];
+	double x2 = m_posX[j];
+	double y1 = m_posY[i];
+	double y2 = m_posY[j];
+	double z1 = m_posZ[i];
+	double z2 = m_posZ[j];
+	return sqrt((x1 - x2) * (x1 - x2) + (y1 - y2) * (y1 - y2) + (z1 - z2) * (z1 - z2));
+}
+
+/////////////////////////////////////////////////////////////
+
+NS_OBJECT_ENSURE_REGISTERED(LearnNetDevice);
+
+TypeId
+LearnNetDevice::GetTypeId(void)
+{
+	static TypeId tid =
+		TypeId("ns3::LearnNetDevice")
+			.SetParent<NetDevice>()
+			.SetGroupName("Learn")
+			.AddConstructor<LearnNetDevice>()
+			.AddAttribute("Mtu", "The MAC-level Maximum Transmission Unit",
+						  UintegerValue(DEFAULT_MTU),
+						  MakeUintegerAccessor(&LearnNetDevice::SetMtu, &LearnNetDevice::GetMtu),
+						  MakeUintegerChecker<uint16_t>())
+			.AddAttribute("Address", "The MAC address of this device.",
+						  Mac48AddressValue(Mac48Address("ff:ff:ff:ff:ff:ff")),
+						  MakeMac48AddressAccessor(&LearnNetDevice::m_address),
+						  MakeMac48AddressChecker())
+			.AddAttribute("DataRate", "The default data rate for point to point links",
+						  DataRateValue(DataRate("32768b/s")),
+						  MakeDataRateAccessor(&LearnNetDevice::SetDataRate, &LearnNetDevice::GetDataRate),
+						  MakeDataRateChecker())
+			.AddAttribute("RateTable",
+						  "Rate by receiver distance as \"distance:rate\" entries separated by commas, "
+						  "empty sends every frame at DataRate",
+						  StringValue(""),
+						  MakeStringAccessor(&LearnNetDevice::SetRateTable, &LearnNetDevice::GetRateTable),
+						  MakeStringChecker())
+			.AddAttribute("BroadcastRate", "Rate of broadcast frames when a rate table is set",
+						  EnumValue(LearnNetDevice::BROADCAST_BASIC),
+						  MakeEnumAccessor(&LearnNetDevice::m_broadcastRatePolicy),
+						  MakeEnumChecker(LearnNetDevice::BROADCAST_BASIC, "Basic",
+										  LearnNetDevice::BROADCAST_LOWEST_COMMON, "LowestCommon"))
+			.AddAttribute("L2Forwarding",
+						  "Relay unicast frames hop by hop within the channel MaxRange, "
+						  "along next hops computed by the channel",
+						  BooleanValue(false), MakeBooleanAccessor(&LearnNetDevice::m_forwarding),
+						  MakeBooleanChecker())
+			.AddAttribute("MaxHops", "Hops a relayed frame may take before it is dropped",
+						  UintegerValue(16), MakeUintegerAccessor(&LearnNetDevice::m_maxHops),
+						  MakeUintegerChecker<uint8_t>(1))
+			.AddAttribute("ReceiveErrorModel",
+						  "The receiver error model used to simulate packet loss", PointerValue(),
+						  MakePointerAccessor(&LearnNetDevice::m_receiveErrorModel),
+						  MakePointerChecker<ErrorModel>())
+			.AddAttribute("InterframeGap", "The time to wait between packet (frame) transmissions",
+						  TimeValue(Seconds(0.0)),
+						  MakeTimeAccessor(&LearnNetDevice::m_tInterframeGap), MakeTimeChecker())
+			.AddAttribute("RadioState", "The radio state outside of transmissions, "
+										"a sleeping device receives nothing",
+						  EnumValue(LearnNetDevice::LISTEN),
+						  MakeEnumAccessor(&LearnNetDevice::SetRadioState,
+										   &LearnNetDevice::GetRadioState),
+						  MakeEnumChecker(LearnNetDevice::SLEEP, "Sleep",
+										  LearnNetDevice::LISTEN, "Listen"))
+			.AddAttribute("CarrierSense",
+						  "Defer transmissions while the medium is busy, with random backoff",
+						  BooleanValue(false), MakeBooleanAccessor(&LearnNetDevice::m_carrierSense),
+						  MakeBooleanChecker())
+			.AddAttribute("SlotTime", "The backoff slot duration", TimeValue(MicroSeconds(20)),
+						  MakeTimeAccessor(&LearnNetDevice::m_slotTime), MakeTimeChecker())
+			.AddAttribute("CwMin", "The minimum contention window, in slots", UintegerValue(15),
+						  MakeUintegerAccessor(&LearnNetDevice::m_cwMin),
+						  MakeUintegerChecker<uint32_t>())
+			.AddAttribute("CwMax", "The maximum contention window, in slots", UintegerValue(1023),
+						  MakeUintegerAccessor(&LearnNetDevice::m_cwMax),
+						  MakeUintegerChecker<uint32_t>())
+			.AddAttribute("TxScheduler", "How the next packet is picked among the tx queues",
+						  EnumValue(LearnNetDevice::STRICT_PRIORITY),
+						  MakeEnumAccessor(&LearnNetDevice::m_txScheduler),
+						  MakeEnumChecker(LearnNetDevice::STRICT_PRIORITY, "StrictPriority",
+										  LearnNetDevice::DEFICIT_ROUND_ROBIN, "DeficitRoundRobin"))
+			.AddAttribute("DrrQuantum", "Bytes credited to a tx queue per deficit round robin round",
+						  UintegerValue(1500), MakeUintegerAccessor(&LearnNetDevice::m_drrQuantum),
+						  MakeUintegerChecker<uint32_t>(1))
+			.AddAttribute("LatencyStats",
+						  "Latency statistics kept for the received packets: none, for the "
+						  "device or for the device and each link",
+						  EnumValue(LearnNetDevice::STATS_NONE),
+						  MakeEnumAccessor(&LearnNetDevice::m_latencyStatsMode),
+						  MakeEnumChecker(LearnNetDevice::STATS_NONE, "None",
+										  LearnNetDevice::STATS_DEVICE, "Device",
+										  LearnNetDevice::STATS_LINK, "Link"))
+
+			//
+			// Transmit queueing discipline for the device which includes its own set
+			// of trace hooks.
+			//
+			.AddAttribute("TxQueue", "A queue to use as the transmit queue in the device.",
+						  PointerValue(),
+						  MakePointerAccessor(&LearnNetDevice::SetQueue, &LearnNetDevice::GetQueue),
+						  MakePointerChecker<Queue<Packet>>())
+
+			//
+			// Trace sources at the "top" of the net device, where packets transition
+			// to/from higher layers.
+			//
+			.AddTraceSource("MacTx",
+							"Trace source indicating a packet has arrived "
+							"for transmission by this device",
+							MakeTraceSourceAccessor(&LearnNetDevice::m_macTxTrace),
+							"ns3::Packet::TracedCallback")
+			.AddTraceSource("MacTxDrop",
+							"Trace source indicating a packet has been dropped "
+							"by the device before transmission",
+							MakeTraceSourceAccessor(&LearnNetDevice::m_macTxDropTrace),
+							"ns3::Packet::TracedCallback")
+			.AddTraceSource("MacForward",
+							"Trace source indicating a packet not addressed to this "
+							"device has been queued again toward its next hop",
+							MakeTraceSourceAccessor(&LearnNetDevice::m_forwardTrace),
+							"ns3::Packet::TracedCallback")
+			.AddTraceSource("MacPromiscRx",
+							"A packet has been received by this device, "
+							"has been passed up from the physical layer "
+							"and is being forwarded up the local protocol stack.  "
+							"This is a promiscuous trace,",
+							MakeTraceSourceAccessor(&LearnNetDevice::m_macPromiscRxTrace),
+							"ns3::Packet::TracedCallback")
+			.AddTraceSource("MacRx",
+							"A packet has been received by this device, "
+							"has been passed up from the physical layer "
+							"and is being forwarded up the local protocol stack.  "
+							"This is a non-promiscuous trace,",
+							MakeTraceSourceAccessor(&LearnNetDevice::m_macRxTrace),
+							"ns3::Packet::TracedCallback")
+			.AddTraceSource("MacRxDrop",
+							"Trace source indicating a relayed packet overheard by a "
+							"device that is not its next hop has been dropped",
+							MakeTraceSourceAccessor(&LearnNetDevice::m_macRxDropTrace),
+							"ns3::Packet::TracedCallback")
+
+			//
+			// Trace sources at the "bottom" of the net device, where packets transition
+			// to/from the channel.
+			//
+			.AddTraceSource("PhyTxBegin",
+							"Trace source indicating a packet has begun "
+							"transmitting over the channel",
+							MakeTraceSourceAccessor(&LearnNetDevice::m_phyTxBeginTrace),
+							"ns3::Packet::TracedCallback")
+			.AddTraceSource("PhyTxEnd",
+							"Trace source indicating a packet has been "
+							"completely transmitted over the channel",
+							MakeTraceSourceAccessor(&LearnNetDevice::m_phyTxEndTrace),
+							"ns3::Packet::TracedCallback")
+			.AddTraceSource("PhyTxDrop",
+							"Trace source indicating a packet has been "
+							"dropped by the device during transmission",
+							MakeTraceSourceAccessor(&LearnNetDevice::m_phyTxDropTrace),
+							"ns3::Packet::TracedCallback")
+
+			.AddTraceSource("PhyRxEnd",
+							"Trace source indicating a packet has been "
+							"completely received by the device",
+							MakeTraceSourceAccessor(&LearnNetDevice::m_phyRxEndTrace),
+							"ns3::Packet::TracedCallback")
+			.AddTraceSource("PhyRxDrop",
+							"Trace source indicating a packet has been "
+							"dropped by the device during reception",
+							MakeTraceSourceAccessor(&LearnNetDevice::m_phyRxDropTrace),
+							"ns3::Packet::TracedCallback")
+
+			//
+			// Trace sources designed to simulate a packet sniffer facility (tcpdump).
+			// Note that there is really no difference between promiscuous and
+			// non-promiscuous traces in a point-to-point link.
+			//
+			.AddTraceSource("Sniffer",
+							"Trace source simulating a non-promiscuous packet sniffer "
+							"attached to the device",
+							MakeTraceSourceAccessor(&LearnNetDevice::m_snifferTrace),
+							"ns3::Packet::TracedCallback")
+			.AddTraceSource("PromiscSniffer",
+							"Trace source simulating a promiscuous packet sniffer "
+							"attached to the device",
+							MakeTraceSourceAccessor(&LearnNetDevice::m_promiscSnifferTrace),
+							"ns3::Packet::TracedCallback");
+	return tid;
+}
+
+LearnNetDevice::LearnNetDevice()
+	: m_txMachineState(READY), m_radioState(LISTEN), m_idleRadioState(LISTEN),
+	  m_channel(0), m_channelIndex(0), m_linkUp(false), m_currentPkt(0),
+	  m_latencyStatsMode(STATS_NONE), m_carrierSense(false), m_cwMin(15), m_cwMax(1023), m_cw(15),
+	  m_txScheduler(STRICT_PRIORITY), m_drrQuantum(1500), m_deficits(1, 0), m_drrCurrent(0),
+	  m_drrCredited(false), m_forwarding(false), m_maxHops(16), m_broadcastRatePolicy(BROADCAST_BASIC), m_x(0), m_y(0),
+	  m_z(0), m_azimuth(0), m_tilt(0)
+{
+	NS_LOG_FUNCTION(this);
+	m_radioStateStart = Simulator::Now();
+	m_backoffRng = CreateObject<UniformRandomVariable>();
+}
+
+LearnNetDevice::~LearnNetDevice()
+{
+	NS_LOG_FUNCTION(this);
+}
+
+void LearnNetDevice::DoDispose()
+{
+	NS_LOG_FUNCTION(this);
+	m_node = 0;
+	m_channel = 0;
+	m_receiveErrorModel = 0;
+	m_currentPkt = 0;
+	m_backoffEvent.Cancel();
+	m_queues.clear();
+	m_queueSelector.Nullify();
+	NetDevice::DoDispose();
+}
+
+void LearnNetDevice::SetDataRate(DataRate bps)
+{
+	NS_LOG_FUNCTION(this);
+	m_bps = bps;
+	if (m_channel != 0)
+	{
+		m_channel->NotifyRateChange();
+	}
+}
+
+DataRate
+LearnNetDevice::GetDataRate(void) const
+{
+	return m_bps;
+}
+
+void LearnNetDevice::AddRate(double maxDistance, DataRate rate)
+{
+	NS_LOG_FUNCTION(this << maxDistance << rate);
+	std::pair<double, DataRate> entry(maxDistance, rate);
+	m_rateTable.insert(std::upper_bound(m_rateTable.begin(), m_rateTable.end(), entry,
+										[](const std::pair<double, DataRate> &a, const std::pair<double, DataRate> &b) {
+											return a.first < b.first;
+										}),
+					   entry);
+	m_linkRates.clear();
+	if (m_channel != 0)
+	{
+		m_channel->NotifyRateChange();
+	}
+}
+
+void LearnNetDevice::SetRateTable(std::string table)
+{
+	NS_LOG_FUNCTION(this << table);
+	m_rateTable.clear();
+	m_linkRates.clear();
+	if (m_channel != 0)
+	{
+		m_channel->NotifyRateChange();
+	}
+	std::istringstream is(table);
+	std::string entry;
+	while (std::getline(is, entry, ','))
+	{
+		std::string::size_type colon = entry.find(':');
+		NS_ABORT_MSG_IF(colon == std::string::npos, "Bad rate table entry \"" << entry << "\"");
+		AddRate(atof(entry.substr(0, colon).c_str()), DataRate(entry.substr(colon + 1)));
+	}
+}
+
+std::string
+LearnNetDevice::GetRateTable(void) const
+{
+	std::ostringstream os;
+	for (std::size_t k = 0; k < m_rateTable.size(); ++k)
+	{
+		os << (k == 0 ? "" : ",") << m_rateTable[k].first << ":" << m_rateTable[k].second.GetBitRate() << "bps";
+	}
+	return os.str();
+}
+
+//
+// The rate of a link only changes when one of its ends moves or turns its
+// antenna, so it is looked up in the table once and kept until either geometry
+// epoch changes.
+//
+DataRate
+LearnNetDevice::GetLinkRate(std::size_t dst)
+{
+	if (m_rateTable.empty())
+	{
+		return m_bps;
+	}
+	if (dst >= m_linkRates.size())
+	{
+		LinkRate invalid = {0, 0, m_bps};
+		m_linkRates.resize(m_channel->GetNDevices(), invalid);
+	}
+	LinkRate &cached = m_linkRates[dst];
+	uint32_t srcEpoch = m_channel->GetGeometryEpoch(m_channelIndex);
+	uint32_t dstEpoch = m_channel->GetGeometryEpoch(dst);
+	if (cached.srcEpoch != srcEpoch || cached.dstEpoch != dstEpoch)
+	{
+		double d = m_channel->GetEffectiveDist(m_channelIndex, dst);
+		std::size_t k = 0;
+		while (k + 1 < m_rateTable.size() && m_rateTable[k].first < d)
+		{
+			++k;
+		}
+		cached.srcEpoch = srcEpoch;
+		cached.dstEpoch = dstEpoch;
+		cached.rate = m_rateTable[k].second;
+	}
+	return cached.rate;
+}
+
+DataRate
+LearnNetDevice::GetTxRate(Ptr<const Packet> p)
+{
+	if (m_rateTable.empty())
+	{
+		return m_bps;
+	}
+	LearnMacTag tag;
+	std::size_t dst = LearnChannel::NO_DEVICE;
+	if (p->PeekPacketTag(tag) && !tag.GetNextHop().IsGroup())
+	{
+		dst = m_channel->FindDevice(tag.GetNextHop());
+	}
+	if (dst != LearnChannel::NO_DEVICE)
+	{
+		return GetLinkRate(dst);
+	}
+	return GetBroadcastRate();
+}
+
+DataRate
+LearnNetDevice::GetBroadcastRate(void)
+{
+	if (m_rateTable.empty() || m_broadcastRatePolicy == BROADCAST_BASIC)
+	{
+		return m_bps;
+	}
+
+	//
+	// Lowest common rate: the frame must be decodable by every listener.
+	//
+	DataRate rate;
+	bool found = false;
+	for (std::size_t k = 0; k < m_channel->GetNListeners(); ++k)
+	{
+		std::size_t i = m_channel->GetListener(k);
+		if (i == m_channelIndex)
+		{
+			continue;
+		}
+		DataRate r = GetLinkRate(i);
+		if (!found || r < rate)
+		{
+			rate = r;
+			found = true;
+		}
+	}
+	return found ? rate : m_bps;
+}
+
+void LearnNetDevice::SetInterframeGap(Time t)
+{
+	NS_LOG_FUNCTION(this << t.GetSeconds());
+	m_tInterframeGap = t;
+}
+
+bool LearnNetDevice::TransmitStart(Ptr<Packet> p)
+{
+	LEARN_PROFILE_SCOPE("LearnNetDevice::TransmitStart");
+	NS_LOG_FUNCTION(this << p);
+	NS_LOG_LOGIC("UID is " << p->GetUid() << ")");
+
+	//
+	// This function is called to start the process of transmitting a packet.
+	// We need to tell the channel that we've started wiggling the wire and
+	// schedule an event that will be executed when the transmission is complete.
+	//
+	NS_ASSERT_MSG(m_txMachineState == READY, "Must be READY to transmit");
+	m_txMachineState = BUSY;
+	m_cw = m_cwMin;
+	ChangeRadioState(TRANSMIT);
+	m_currentPkt = p;
+	m_phyTxBeginTrace(m_currentPkt);
+
+	Time txTime = GetTxRate(p).CalculateBytesTxTime(p->GetSize());
+	//
+	// Background flows declared as fluid on the channel hold the medium for a
+	// random time before this packet gets it. The wait is folded into the times
+	// handed to the scheduler, so it costs no extra event.
+	//
+	Time wait = m_channel->DrawFluidWait();
+	Time txCompleteTime = wait + txTime + m_tInterframeGap;
+
+	if (m_latencyStatsMode != STATS_NONE)
+	{
+		LearnTimestampTag tag;
+		if (p->RemovePacketTag(tag))
+		{
+			tag.SetTransmission(Simulator::Now() + wait, txTime);
+			p->AddPacketTag(tag);
+		}
+	}
+
+	NS_LOG_LOGIC("Schedule TransmitCompleteEvent in " << txCompleteTime.GetSeconds() << "sec");
+	m_txCompleteEvent = Simulator::Schedule(txCompleteTime, &LearnNetDevice::TransmitComplete, this);
+
+	bool result = m_channel->TransmitStart(p, this, wait + txTime);
+	if (result == false)
+	{
+		m_phyTxDropTrace(p);
+	}
+	return result;
+}
+
+void LearnNetDevice::TransmitComplete(void)
+{
+	LEARN_PROFILE_SCOPE("LearnNetDevice::TransmitComplete");
+	NS_LOG_FUNCTION(this);
+
+	//
+	// This function is called to when we're all done transmitting a packet.
+	// We try and pull another packet off of the transmit queue.  If the queue
+	// is empty, we are done, otherwise we need to start transmitting the
+	// next packet.
+	//
+	NS_ASSERT_MSG(m_txMachineState == BUSY, "Must be BUSY if transmitting");
+	m_txMachineState = READY;
+
+	NS_ASSERT_MSG(m_currentPkt != 0, "LearnNetDevice::TransmitComplete(): m_currentPkt zero");
+
+	m_phyTxEndTrace(m_currentPkt);
+	m_currentPkt = 0;
+
+	if (HasQueuedPackets() && !IsMediumIdle())
+	{
+		ChangeRadioState(m_idleRadioState);
+		StartBackoff();
+		return;
+	}
+
+	Ptr<Packet> p = DequeueNext();
+	if (p == 0)
+	{
+		NS_LOG_LOGIC("No pending packets in device queue after tx complete");
+		ChangeRadioState(m_idleRadioState);
+		return;
+	}
+
+	//
+	// Got another packet off of the queue, so start the transmit process again.
+	//
+	m_snifferTrace(p);
+	m_promiscSnifferTrace(p);
+	TransmitStart(p);
+}
+
+//
+// A slot has no transmit machine: the packet is handed to the channel, which
+// delivers it at a later slot boundary, and the device is ready again at
+// once. The radio state time is not accounted in slotted mode.
+//
+bool LearnNetDevice::TransmitSlot(void)
+{
+	LEARN_PROFILE_SCOPE("LearnNetDevice::TransmitSlot");
+	NS_LOG_FUNCTION(this);
+	Ptr<Packet> p = DequeueNext();
+	if (p == 0)
+	{
+		return false;
+	}
+	m_snifferTrace(p);
+	m_promiscSnifferTrace(p);
+	m_phyTxBeginTrace(p);
+	Time txTime = GetTxRate(p).CalculateBytesTxTime(p->GetSize());
+	if (m_latencyStatsMode != STATS_NONE)
+	{
+		LearnTimestampTag tag;
+		if (p->RemovePacketTag(tag))
+		{
+			tag.SetTransmission(Simulator::Now(), txTime);
+			p->AddPacketTag(tag);
+		}
+	}
+	if (!m_channel->TransmitStart(p, this, txTime))
+	{
+		m_phyTxDropTrace(p);
+	}
+	m_phyTxEndTrace(p);
+	return HasQueuedPackets();
+}
+
+bool LearnNetDevice::IsMediumIdle(void) const
+{
+	return !m_carrierSense || m_channel->GetBusyUntil(m_channelIndex) <= Simulator::Now();
+}
+
+void LearnNetDevice::StartBackoff(void)
+{
+	NS_LOG_FUNCTION(this);
+	//
+	// Wait for the end of the busy period, then a random number of slots. A
+	// single event covers the whole backoff, the medium is only checked again
+	// when it fires.
+	//
+	m_txMachineState = BACKOFF;
+	Time busy = m_channel->GetBusyUntil(m_channelIndex) - Simulator::Now();
+	uint32_t slots = m_backoffRng->GetInteger(0, m_cw);
+	NS_LOG_LOGIC("Backoff " << slots << " slots after " << busy.GetSeconds() << "s, cw " << m_cw);
+	m_backoffEvent = Simulator::Schedule(Max(busy, Seconds(0.)) + m_slotTime * static_cast<int64_t>(slots),
+										 &LearnNetDevice::TryTransmit, this);
+}
+
+void LearnNetDevice::TryTransmit(void)
+{
+	LEARN_PROFILE_SCOPE("LearnNetDevice::TryTransmit");
+	NS_LOG_FUNCTION(this);
+	NS_ASSERT_MSG(m_txMachineState != BUSY, "Already transmitting");
+	m_txMachineState = READY;
+	if (!IsMediumIdle())
+	{
+		m_cw = std::min(2 * m_cw + 1, m_cwMax);
+		StartBackoff();
+		return;
+	}
+	Ptr<Packet> p = DequeueNext();
+	if (p == 0)
+	{
+		return;
+	}
+	m_snifferTrace(p);
+	m_promiscSnifferTrace(p);
+	TransmitStart(p);
+}
+
+int64_t
+LearnNetDevice::AssignStreams(int64_t stream)
+{
+	NS_LOG_FUNCTION(this << stream);
+	m_backoffRng->SetStream(stream);
+	return 1;
+}
+
+bool LearnNetDevice::Attach(Ptr<LearnChannel> ch)
+{
+	NS_LOG_FUNCTION(this << &ch);
+
+	m_channel = ch;
+
+	m_channelIndex = m_channel->Attach(this);
+	if (m_antenna != 0)
+	{
+		m_channel->NotifyAntennaChange(m_channelIndex);
+	}
+
+	//
+	// This device is up whenever it is attached to a channel.  A better plan
+	// would be to have the link come up when both devices are attached, but this
+	// is not done for now.
+	//
+	NotifyLinkUp();
+	return true;
+}
+
+bool LearnNetDevice::Materialize(Ptr<LearnChannel> ch, std::size_t index)
+{
+	NS_LOG_FUNCTION(this << ch << index);
+	m_channel = ch;
+	m_channelIndex = index;
+	m_channel->Materialize(index, this);
+	m_z = m_channel->GetZ(index);
+	SetXY(m_channel->GetX(index), m_channel->GetY(index));
+	if (m_antenna != 0)
+	{
+		m_channel->NotifyAntennaChange(m_channelIndex);
+	}
+	NotifyLinkUp();
+	return true;
+}
+
+std::size_t
+LearnNetDevice::GetChannelIndex(void) const
+{
+	return m_channelIndex;
+}
+
+void LearnNetDevice::SetQueue(Ptr<Queue<Packet>> q)
+{
+	NS_LOG_FUNCTION(this << q);
+	if (m_queues.empty())
+	{
+		m_queues.push_back(q);
+	}
+	else
+	{
+		m_queues[0] = q;
+	}
+}
+
+std::size_t
+LearnNetDevice::AddTxQueue(Ptr<Queue<Packet>> q)
+{
+	NS_LOG_FUNCTION(this << q);
+	m_queues.push_back(q);
+	m_deficits.resize(m_queues.size(), 0);
+	return m_queues.size() - 1;
+}
+
+std::size_t
+LearnNetDevice::GetNTxQueues(void) const
+{
+	return m_queues.size();
+}
+
+Ptr<Queue<Packet>>
+LearnNetDevice::GetTxQueue(std::size_t i) const
+{
+	NS_ASSERT(i < m_queues.size());
+	return m_queues[i];
+}
+
+void LearnNetDevice::SetQueueSelector(Callback<std::size_t, Ptr<const Packet>> selector)
+{
+	m_queueSelector = selector;
+}
+
+//
+// Same mapping as the pfifo_fast queue disc: priority 6 and 7 go to the first
+// (highest priority) queue, best effort to the second and bulk to the third.
+// Devices with fewer queues fold the lower bands into their last queue.
+//
+std::size_t
+LearnNetDevice::SelectQueue(Ptr<const Packet> p) const
+{
+	static const uint8_t prio2band[16] = {1, 2, 2, 2, 1, 2, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1};
+	if (m_queues.size() == 1)
+	{
+		return 0;
+	}
+	std::size_t band;
+	if (!m_queueSelector.IsNull())
+	{
+		band = m_queueSelector(p);
+	}
+	else
+	{
+		SocketPriorityTag tag;
+		uint8_t prio = p->PeekPacketTag(tag) ? tag.GetPriority() : 0;
+		band = prio2band[prio & 0x0f];
+	}
+	return std::min(band, m_queues.size() - 1);
+}
+
+std::size_t
+LearnNetDevice::SelectTxQueue(Ptr<QueueItem> item) const
+{
+	return SelectQueue(item->GetPacket());
+}
+
+bool LearnNetDevice::HasQueuedPackets(void) const
+{
+	for (std::size_t i = 0; i < m_queues.size(); ++i)
+	{
+		if (!m_queues[i]->IsEmpty())
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+Ptr<Packet>
+LearnNetDevice::DequeueNext(void)
+{
+	if (m_queues.size() == 1)
+	{
+		return m_queues[0]->Dequeue();
+	}
+	if (m_txScheduler == STRICT_PRIORITY)
+	{
+		for (std::size_t i = 0; i < m_queues.size(); ++i)
+		{
+			if (!m_queues[i]->IsEmpty())
+			{
+				return m_queues[i]->Dequeue();
+			}
+		}
+		return 0;
+	}
+
+	//
+	// Deficit round robin: a queue gets a quantum of credit when its turn
+	// comes and sends while its head fits in the credit. Empty queues lose
+	// their credit. Some queue has packets, so credits grow until one fits.
+	//
+	if (!HasQueuedPackets())
+	{
+		return 0;
+	}
+	for (;;)
+	{
+		Ptr<Queue<Packet>> q = m_queues[m_drrCurrent];
+		if (q->IsEmpty())
+		{
+			m_deficits[m_drrCurrent] = 0;
+		}
+		else
+		{
+			if (!m_drrCredited)
+			{
+				m_deficits[m_drrCurrent] += m_drrQuantum;
+				m_drrCredited = true;
+			}
+			uint32_t size = q->Peek()->GetSize();
+			if (size <= m_deficits[m_drrCurrent])
+			{
+				m_deficits[m_drrCurrent] -= size;
+				return q->Dequeue();
+			}
+		}
+		m_drrCurrent = (m_drrCurrent + 1) % m_queues.size();
+		m_drrCredited = false;
+	}
+}
+
+void LearnNetDevice::SetReceiveErrorModel(Ptr<ErrorModel> em)
+{
+	NS_LOG_FUNCTION(this << em);
+	m_receiveErrorModel = em;
 }
 
-void LearnNetDevice::SetDataRate(DataRate bps)
+void LearnNetDevice::SetRadioState(RadioState state)
 {
-	NS_LOG_FUNCTION(this);
-	m_bps = bps;
+	NS_LOG_FUNCTION(this << state);
+	NS_ASSERT_MSG(state != TRANSMIT, "TRANSMIT is entered by the device itself");
+	m_idleRadioState = state;
+	if (m_radioState != TRANSMIT)
+	{
+		ChangeRadioState(state);
+	}
 }
 
-void LearnNetDevice::SetInterframeGap(Time t)
+LearnNetDevice::RadioState
+LearnNetDevice::GetRadioState(void) const
 {
-	NS_LOG_FUNCTION(this << t.GetSeconds());
-	m_tInterframeGap = t;
+	return m_radioState;
 }
 
-bool LearnNetDevice::TransmitStart(Ptr<Packet> p)
+Time LearnNetDevice::GetRadioStateTime(RadioState state) const
 {
-	NS_LOG_FUNCTION(this << p);
-	NS_LOG_LOGIC("UID is " << p->GetUid() << ")");
-
-	//
-	// This function is called to start the process of transmitting a packet.
-	// We need to tell the channel that we've started wiggling the wire and
-	// schedule an event that will be executed when the transmission is complete.
-	//
-	NS_ASSERT_MSG(m_txMachineState == READY, "Must be READY to transmit");
-	m_txMachineState = BUSY;
-	m_currentPkt = p;
-	m_phyTxBeginTrace(m_currentPkt);
-
-	Time txTime = m_bps.CalculateBytesTxTime(p->GetSize());
-	Time txCompleteTime = txTime + m_tInterframeGap;
-
-	NS_LOG_LOGIC("Schedule TransmitCompleteEvent in " << txCompleteTime.GetSeconds() << "sec");
-	Simulator::Schedule(txCompleteTime, &LearnNetDevice::TransmitComplete, this);
-
-	bool result = m_channel->TransmitStart(p, this, txTime);
-	if (result == false)
+	Time t = m_radioStateTime[state];
+	if (state == m_radioState)
 	{
-		m_phyTxDropTrace(p);
+		t += Simulator::Now() - m_radioStateStart;
 	}
-	return result;
+	return t;
 }
 
-void LearnNetDevice::TransmitComplete(void)
+void LearnNetDevice::ChangeRadioState(RadioState state)
 {
-	NS_LOG_FUNCTION(this);
-
-	//
-	// This function is called to when we're all done transmitting a packet.
-	// We try and pull another packet off of the transmit queue.  If the queue
-	// is empty, we are done, otherwise we need to start transmitting the
-	// next packet.
-	//
-	NS_ASSERT_MSG(m_txMachineState == BUSY, "Must be BUSY if transmitting");
-	m_txMachineState = READY;
-
-	NS_ASSERT_MSG(m_currentPkt != 0, "LearnNetDevice::TransmitComplete(): m_currentPkt zero");
-
-	m_phyTxEndTrace(m_currentPkt);
-	m_currentPkt = 0;
-
-	Ptr<Packet> p = m_queue->Dequeue();
-	if (p == 0)
+	NS_LOG_FUNCTION(this << state);
+	if (state == m_radioState)
 	{
-		NS_LOG_LOGIC("No pending packets in device queue after tx complete");
 		return;
 	}
-
+	Time now = Simulator::Now();
+	m_radioStateTime[m_radioState] += now - m_radioStateStart;
+	m_radioStateStart = now;
 	//
-	// Got another packet off of the queue, so start the transmit process again.
+	// The radio is half-duplex: a transmitting device is off the fan-out list
+	// like a sleeping one, and gets back on it when it listens again.
 	//
-	m_snifferTrace(p);
-	m_promiscSnifferTrace(p);
-	TransmitStart(p);
+	bool wasListening = (m_radioState == LISTEN);
+	m_radioState = state;
+	if (m_channel != 0 && wasListening != (state == LISTEN))
+	{
+		m_channel->SetListening(m_channelIndex, state == LISTEN);
+	}
 }
 
-bool LearnNetDevice::Attach(Ptr<LearnChannel> ch)
+void LearnNetDevice::SaveState(std::ostream &os)
 {
-	NS_LOG_FUNCTION(this << &ch);
-
-	m_channel = ch;
-
-	m_channel->Attach(this);
-
+	NS_LOG_FUNCTION(this);
+	WriteRaw(os, m_x);
+	WriteRaw(os, m_y);
+	WriteRaw(os, m_z);
+	WriteRaw(os, m_azimuth);
+	WriteRaw(os, m_tilt);
+	WriteRaw<uint64_t>(os, m_bps.GetBitRate());
+	WriteTime(os, m_tInterframeGap);
+	WriteRaw<uint8_t>(os, m_radioState);
+	WriteRaw<uint8_t>(os, m_idleRadioState);
+	for (int state = SLEEP; state <= TRANSMIT; ++state)
+	{
+		WriteTime(os, GetRadioStateTime(static_cast<RadioState>(state)));
+	}
 	//
-	// This device is up whenever it is attached to a channel.  A better plan
-	// would be to have the link come up when both devices are attached, but this
-	// is not done for now.
+	// A pending backoff is not saved, the restored device contends again.
 	//
-	NotifyLinkUp();
-	return true;
-}
-
-void LearnNetDevice::SetQueue(Ptr<Queue<Packet>> q)
-{
-	NS_LOG_FUNCTION(this << q);
-	m_queue = q;
+	WriteRaw<uint8_t>(os, m_txMachineState == BUSY ? BUSY : READY);
+	if (m_txMachineState == BUSY)
+	{
+		WriteTime(os, Simulator::GetDelayLeft(m_txCompleteEvent));
+		WritePacket(os, m_currentPkt);
+	}
+	//
+	// The queues cannot be walked, so they are drained and refilled in order.
+	// This fires their dequeue and enqueue traces once per packet.
+	//
+	WriteRaw<uint64_t>(os, m_queues.size());
+	for (std::size_t i = 0; i < m_queues.size(); ++i)
+	{
+		std::vector<Ptr<Packet>> queued;
+		for (Ptr<Packet> p = m_queues[i]->Dequeue(); p != 0; p = m_queues[i]->Dequeue())
+		{
+			queued.push_back(p);
+		}
+		WriteRaw<uint64_t>(os, queued.size());
+		for (std::vector<Ptr<Packet>>::const_iterator it = queued.begin(); it != queued.end(); ++it)
+		{
+			WritePacket(os, *it);
+			m_queues[i]->Enqueue(*it);
+		}
+	}
 }
 
-void LearnNetDevice::SetReceiveErrorModel(Ptr<ErrorModel> em)
+void LearnNetDevice::RestoreState(std::istream &is)
 {
-	NS_LOG_FUNCTION(this << em);
-	m_receiveErrorModel = em;
+	NS_LOG_FUNCTION(this);
+	NS_ABORT_MSG_IF(m_txMachineState != READY || HasQueuedPackets(),
+					"Device must be idle to restore a checkpoint");
+	m_backoffEvent.Cancel();
+	double x = ReadRaw<double>(is);
+	double y = ReadRaw<double>(is);
+	m_z = ReadRaw<double>(is);
+	SetXY(x, y);
+	double azimuth = ReadRaw<double>(is);
+	double tilt = ReadRaw<double>(is);
+	SetOrientation(azimuth, tilt);
+	SetDataRate(DataRate(ReadRaw<uint64_t>(is)));
+	m_tInterframeGap = ReadTime(is);
+	RadioState radioState = static_cast<RadioState>(ReadRaw<uint8_t>(is));
+	m_idleRadioState = static_cast<RadioState>(ReadRaw<uint8_t>(is));
+	ChangeRadioState(radioState);
+	for (int state = SLEEP; state <= TRANSMIT; ++state)
+	{
+		m_radioStateTime[state] = ReadTime(is);
+	}
+	m_radioStateStart = Simulator::Now();
+	if (static_cast<TxMachineState>(ReadRaw<uint8_t>(is)) == BUSY)
+	{
+		Time left = ReadTime(is);
+		m_currentPkt = ReadPacket(is);
+		m_txMachineState = BUSY;
+		m_txCompleteEvent = Simulator::Schedule(left, &LearnNetDevice::TransmitComplete, this);
+	}
+	uint64_t nQueues = ReadRaw<uint64_t>(is);
+	NS_ABORT_MSG_IF(nQueues != m_queues.size(), "Checkpoint has " << nQueues << " tx queues, device has " << m_queues.size());
+	for (std::size_t i = 0; i < m_queues.size(); ++i)
+	{
+		uint64_t nQueued = ReadRaw<uint64_t>(is);
+		for (uint64_t k = 0; k < nQueued; ++k)
+		{
+			m_queues[i]->Enqueue(ReadPacket(is));
+		}
+	}
+	if (m_txMachineState == READY && HasQueuedPackets())
+	{
+		m_backoffEvent = Simulator::ScheduleNow(&LearnNetDevice::TryTransmit, this);
+	}
 }
 
 void LearnNetDevice::Receive(Ptr<Packet> packet, Ptr<LearnNetDevice> src)
 {
+	LEARN_PROFILE_SCOPE("LearnNetDevice::Receive");
 	NS_LOG_FUNCTION(this << packet);
 	uint16_t protocol = 0x0800;
 
+	if (m_radioState == SLEEP)
+	{
+		//
+		// The packet was already in flight when the device fell asleep.
+		//
+		m_phyRxDropTrace(packet);
+		return;
+	}
+
 	if (m_receiveErrorModel && m_receiveErrorModel->IsCorrupt(packet))
 	{
 		//
@@ -370,6 +2957,71 @@ void LearnNetDevice::Receive(Ptr<Packet> packet, Ptr<LearnNetDevice> src)
 	}
 	else
 	{
+		Address from = src->GetAddress();
+		Address to = GetAddress();
+		NetDevice::PacketType packetType = NetDevice::PACKET_HOST;
+		LearnMacTag macTag;
+		if (packet->RemovePacketTag(macTag))
+		{
+			protocol = macTag.GetProtocol();
+			from = macTag.GetSource();
+			to = macTag.GetDestination();
+			if (macTag.GetDestination().IsBroadcast())
+			{
+				packetType = NetDevice::PACKET_BROADCAST;
+			}
+			else if (macTag.GetDestination().IsGroup())
+			{
+				packetType = NetDevice::PACKET_MULTICAST;
+			}
+			else if (macTag.GetDestination() != m_address)
+			{
+				packetType = NetDevice::PACKET_OTHERHOST;
+			}
+			if (m_forwarding && !macTag.GetDestination().IsGroup())
+			{
+				//
+				// Relayed unicast frames are only picked up by their next hop,
+				// which either delivers them or passes them on with their time
+				// stamps, so latency is measured end to end.
+				//
+				if (macTag.GetNextHop() != m_address)
+				{
+					m_promiscSnifferTrace(packet);
+					m_macRxDropTrace(packet);
+					return;
+				}
+				if (macTag.GetDestination() != m_address)
+				{
+					Forward(packet, macTag);
+					return;
+				}
+			}
+		}
+
+		//
+		// Packets stamped by a sender that keeps statistics carry their send and
+		// transmission times. The tags are removed in any case so that they do
+		// not reach the upper layers.
+		//
+		LearnTimestampTag tag;
+		if (packet->RemovePacketTag(tag) && m_latencyStatsMode != STATS_NONE)
+		{
+			Time now = Simulator::Now();
+			LearnLatencyStats *stats[2] = {&m_latencyStats, 0};
+			if (m_latencyStatsMode == STATS_LINK)
+			{
+				stats[1] = &m_linkLatencyStats[src->GetChannelIndex()];
+			}
+			for (int k = 0; k < 2 && stats[k] != 0; ++k)
+			{
+				stats[k]->total.Add(now - tag.GetSendTime());
+				stats[k]->queueing.Add(tag.GetTxStart() - tag.GetSendTime());
+				stats[k]->airtime.Add(tag.GetTxTime());
+				stats[k]->propagation.Add(now - tag.GetTxStart() - tag.GetTxTime());
+			}
+		}
+
 		//
 		// Hit the trace hooks.  All of these hooks are in the same place in this
 		// device because it is so simple, but this is not usually the case in
@@ -396,12 +3048,39 @@ void LearnNetDevice::Receive(Ptr<Packet> packet, Ptr<LearnNetDevice> src)
 		{
 			NS_LOG_LOGIC("call m_promiscCallback");
 			m_macPromiscRxTrace(originalPacket);
-			m_promiscCallback(this, packet, protocol, src->GetAddress(), GetAddress(),
-							  NetDevice::PACKET_HOST);
+			LEARN_PROFILE_SCOPE("PromiscCallback");
+			m_promiscCallback(this, packet, protocol, from, to, packetType);
 		}
-		NS_LOG_UNCOND("call m_rxCallback");
+		NS_LOG_LOGIC("call m_rxCallback");
 		m_macRxTrace(originalPacket);
-		m_rxCallback(this, packet, protocol, src->GetAddress());
+		LearnProfiler::Scope callbackScope(LearnProfiler::IsEnabled() ? LearnProfiler::GetProtocolFrame(protocol) : 0);
+		m_rxCallback(this, packet, protocol, from);
+	}
+}
+
+const LearnLatencyStats &
+LearnNetDevice::GetLatencyStats(void) const
+{
+	return m_latencyStats;
+}
+
+const LearnLatencyStats &
+LearnNetDevice::GetLinkLatencyStats(std::size_t src) const
+{
+	static const LearnLatencyStats empty;
+	std::map<std::size_t, LearnLatencyStats>::const_iterator it = m_linkLatencyStats.find(src);
+	return it == m_linkLatencyStats.end() ? empty : it->second;
+}
+
+void LearnNetDevice::PrintLatencyStats(std::ostream &os) const
+{
+	os << "device " << m_channelIndex << std::endl;
+	m_latencyStats.Print(os);
+	for (std::map<std::size_t, LearnLatencyStats>::const_iterator it = m_linkLatencyStats.begin();
+		 it != m_linkLatencyStats.end(); ++it)
+	{
+		os << "link " << it->first << "->" << m_channelIndex << std::endl;
+		it->second.Print(os);
 	}
 }
 
@@ -409,7 +3088,7 @@ Ptr<Queue<Packet>>
 LearnNetDevice::GetQueue(void) const
 {
 	NS_LOG_FUNCTION(this);
-	return m_queue;
+	return m_queues.empty() ? Ptr<Queue<Packet>>() : m_queues[0];
 }
 
 void LearnNetDevice::NotifyLinkUp(void)
@@ -440,7 +3119,12 @@ LearnNetDevice::GetChannel(void) const
 void LearnNetDevice::SetAddress(Address address)
 {
 	NS_LOG_FUNCTION(this << address);
+	Mac48Address old = m_address;
 	m_address = Mac48Address::ConvertFrom(address);
+	if (m_channel != 0)
+	{
+		m_channel->NotifyAddressChange(m_channelIndex, old, m_address);
+	}
 }
 
 Address
@@ -483,24 +3167,28 @@ LearnNetDevice::GetBroadcast(void) const
 	return Mac48Address("ff:ff:ff:ff:ff:ff");
 }
 
+//
+// Frames to a multicast address only reach the devices that joined it with
+// JoinGroup.
+//
 bool LearnNetDevice::IsMulticast(void) const
 {
 	NS_LOG_FUNCTION(this);
-	return false;
+	return true;
 }
 
 Address
 LearnNetDevice::GetMulticast(Ipv4Address multicastGroup) const
 {
-	NS_LOG_FUNCTION(this);
-	return Address();
+	NS_LOG_FUNCTION(this << multicastGroup);
+	return Mac48Address::GetMulticast(multicastGroup);
 }
 
 Address
 LearnNetDevice::GetMulticast(Ipv6Address addr) const
 {
 	NS_LOG_FUNCTION(this << addr);
-	return Address();
+	return Mac48Address::GetMulticast(addr);
 }
 
 bool LearnNetDevice::IsPointToPoint(void) const
@@ -517,6 +3205,14 @@ bool LearnNetDevice::IsBridge(void) const
 
 bool LearnNetDevice::Send(Ptr<Packet> packet, const Address &dest, uint16_t protocolNumber)
 {
+	return SendFrom(packet, m_address, dest, protocolNumber);
+}
+
+bool LearnNetDevice::SendFrom(Ptr<Packet> packet, const Address &source, const Address &dest,
+							  uint16_t protocolNumber)
+{
+	LEARN_PROFILE_SCOPE("LearnNetDevice::Send");
+	NS_LOG_FUNCTION(this << packet << source << dest << protocolNumber);
 	if (IsLinkUp() == false)
 	{
 		m_macTxDropTrace(packet);
@@ -524,29 +3220,172 @@ bool LearnNetDevice::Send(Ptr<Packet> packet, const Address &dest, uint16_t prot
 	}
 	m_macTxTrace(packet);
 
-	if (m_queue->Enqueue(packet))
+	Mac48Address to = Mac48Address::ConvertFrom(dest);
+	Mac48Address nextHop = to;
+	if (!FindNextHop(to, nextHop))
+	{
+		NS_LOG_LOGIC("No route to " << to);
+		m_macTxDropTrace(packet);
+		return false;
+	}
+
+	if (m_latencyStatsMode != STATS_NONE)
 	{
-		if (m_txMachineState == READY)
+		LearnTimestampTag tag;
+		tag.SetSendTime(Simulator::Now());
+		packet->AddPacketTag(tag);
+	}
+	LearnMacTag macTag;
+	macTag.SetDestination(to);
+	macTag.SetSource(Mac48Address::ConvertFrom(source));
+	macTag.SetNextHop(nextHop);
+	macTag.SetProtocol(protocolNumber);
+	macTag.SetHopLimit(m_maxHops);
+	packet->AddPacketTag(macTag);
+	return Enqueue(packet);
+}
+
+uint32_t
+LearnNetDevice::SendBatch(const std::vector<Ptr<Packet>> &packets, const Address &dest, uint16_t protocolNumber)
+{
+	return packets.empty() ? 0 : SendBatch(&packets[0], packets.size(), dest, protocolNumber);
+}
+
+//
+// What Send does per packet is done once per batch: the link check, the
+// route, the tags' contents and the look at the tx machine. The packets are
+// all queued before the first one goes out.
+//
+uint32_t
+LearnNetDevice::SendBatch(const Ptr<Packet> *packets, std::size_t n, const Address &dest, uint16_t protocolNumber)
+{
+	LEARN_PROFILE_SCOPE("LearnNetDevice::SendBatch");
+	NS_LOG_FUNCTION(this << n << dest << protocolNumber);
+	Mac48Address to = Mac48Address::ConvertFrom(dest);
+	Mac48Address nextHop = to;
+	if (!IsLinkUp() || !FindNextHop(to, nextHop))
+	{
+		NS_LOG_LOGIC("Link down or no route to " << to);
+		for (std::size_t k = 0; k < n; ++k)
 		{
-			NS_LOG_UNCOND("Net Device Send");
-			packet = m_queue->Dequeue();
-			m_snifferTrace(packet);
-			m_promiscSnifferTrace(packet);
-			bool ret = TransmitStart(packet);
-			return ret;
+			m_macTxDropTrace(packets[k]);
 		}
-		return true;
+		return 0;
+	}
+
+	LearnTimestampTag timestamp;
+	timestamp.SetSendTime(Simulator::Now());
+	LearnMacTag macTag;
+	macTag.SetDestination(to);
+	macTag.SetSource(m_address);
+	macTag.SetNextHop(nextHop);
+	macTag.SetProtocol(protocolNumber);
+	macTag.SetHopLimit(m_maxHops);
+	uint32_t accepted = 0;
+	for (std::size_t k = 0; k < n; ++k)
+	{
+		const Ptr<Packet> &packet = packets[k];
+		m_macTxTrace(packet);
+		if (m_latencyStatsMode != STATS_NONE)
+		{
+			packet->AddPacketTag(timestamp);
+		}
+		packet->AddPacketTag(macTag);
+		if (m_queues[SelectQueue(packet)]->Enqueue(packet))
+		{
+			++accepted;
+		}
+		else
+		{
+			m_macTxDropTrace(packet);
+		}
+	}
+	if (accepted > 0)
+	{
+		StartQueued();
+	}
+	return accepted;
+}
+
+bool LearnNetDevice::Enqueue(Ptr<Packet> packet)
+{
+	if (m_queues[SelectQueue(packet)]->Enqueue(packet))
+	{
+		return StartQueued();
 	}
 
 	m_macTxDropTrace(packet);
 	return false;
 }
 
-bool LearnNetDevice::SendFrom(Ptr<Packet> packet, const Address &source, const Address &dest,
-							  uint16_t protocolNumber)
+//
+// Packets were queued: send the head of the queue now if the device is idle,
+// otherwise it goes when the current transmission or backoff ends.
+//
+bool LearnNetDevice::StartQueued(void)
 {
-	NS_LOG_FUNCTION(this << packet << source << dest << protocolNumber);
-	return false;
+	if (m_channel->IsSlotted())
+	{
+		m_channel->NotifySlotDemand(m_channelIndex);
+		return true;
+	}
+	if (m_txMachineState == READY)
+	{
+		if (!IsMediumIdle())
+		{
+			StartBackoff();
+			return true;
+		}
+		NS_LOG_LOGIC("Net Device Send");
+		Ptr<Packet> packet = DequeueNext();
+		m_snifferTrace(packet);
+		m_promiscSnifferTrace(packet);
+		bool ret = TransmitStart(packet);
+		return ret;
+	}
+	return true;
+}
+
+//
+// Without forwarding, or for group addresses, frames go straight to their
+// destination. Otherwise the channel picks the first hop of a shortest path.
+//
+bool LearnNetDevice::FindNextHop(Mac48Address dest, Mac48Address &nextHop) const
+{
+	nextHop = dest;
+	if (!m_forwarding || dest.IsGroup())
+	{
+		return true;
+	}
+	std::size_t dst = m_channel->FindDevice(dest);
+	if (dst == LearnChannel::NO_DEVICE)
+	{
+		return false;
+	}
+	std::size_t hop = m_channel->GetNextHop(m_channelIndex, dst);
+	if (hop == LearnChannel::NO_DEVICE)
+	{
+		return false;
+	}
+	nextHop = Mac48Address::ConvertFrom(m_channel->GetLearnDevice(hop)->GetAddress());
+	return true;
+}
+
+void LearnNetDevice::Forward(Ptr<Packet> packet, LearnMacTag &macTag)
+{
+	NS_LOG_FUNCTION(this << packet);
+	Mac48Address nextHop;
+	if (macTag.GetHopLimit() <= 1 || !FindNextHop(macTag.GetDestination(), nextHop))
+	{
+		NS_LOG_LOGIC("Cannot relay to " << macTag.GetDestination());
+		m_macTxDropTrace(packet);
+		return;
+	}
+	macTag.SetNextHop(nextHop);
+	macTag.SetHopLimit(macTag.GetHopLimit() - 1);
+	packet->AddPacketTag(macTag);
+	m_forwardTrace(packet);
+	Enqueue(packet);
 }
 
 Ptr<Node>
@@ -581,7 +3420,7 @@ void LearnNetDevice::SetPromiscReceiveCallback(NetDevice::PromiscReceiveCallback
 bool LearnNetDevice::SupportsSendFrom(void) const
 {
 	NS_LOG_FUNCTION(this);
-	return false;
+	return true;
 }
 
 bool LearnNetDevice::SetMtu(uint16_t mtu)
@@ -611,15 +3450,98 @@ LearnNetDevice::GetY()
 void LearnNetDevice::SetX(double x)
 {
 	m_x = x;
+	if (m_channel != 0)
+	{
+		m_channel->NotifyPositionChange(m_channelIndex);
+	}
 }
 void LearnNetDevice::SetY(double y)
 {
 	m_y = y;
+	if (m_channel != 0)
+	{
+		m_channel->NotifyPositionChange(m_channelIndex);
+	}
 }
 void LearnNetDevice::SetXY(double x, double y)
 {
 	m_x = x;
 	m_y = y;
+	if (m_channel != 0)
+	{
+		m_channel->NotifyPositionChange(m_channelIndex);
+	}
+}
+double
+LearnNetDevice::GetZ(void) const
+{
+	return m_z;
+}
+void LearnNetDevice::SetZ(double z)
+{
+	m_z = z;
+	if (m_channel != 0)
+	{
+		m_channel->NotifyPositionChange(m_channelIndex);
+	}
+}
+void LearnNetDevice::JoinGroup(Mac48Address group)
+{
+	NS_LOG_FUNCTION(this << group);
+	NS_ABORT_MSG_IF(m_channel == 0, "Attach the device before joining a group");
+	m_channel->JoinGroup(m_channelIndex, group);
+}
+void LearnNetDevice::LeaveGroup(Mac48Address group)
+{
+	NS_LOG_FUNCTION(this << group);
+	if (m_channel != 0)
+	{
+		m_channel->LeaveGroup(m_channelIndex, group);
+	}
+}
+void LearnNetDevice::SetXYZ(double x, double y, double z)
+{
+	m_x = x;
+	m_y = y;
+	m_z = z;
+	if (m_channel != 0)
+	{
+		m_channel->NotifyPositionChange(m_channelIndex);
+	}
+}
+void LearnNetDevice::SetAntenna(Ptr<const LearnAntennaPattern> pattern)
+{
+	NS_LOG_FUNCTION(this << pattern);
+	m_antenna = pattern;
+	if (m_channel != 0)
+	{
+		m_channel->NotifyAntennaChange(m_channelIndex);
+	}
+}
+Ptr<const LearnAntennaPattern>
+LearnNetDevice::GetAntenna(void) const
+{
+	return m_antenna;
+}
+void LearnNetDevice::SetOrientation(double azimuth, double tilt)
+{
+	m_azimuth = azimuth;
+	m_tilt = tilt;
+	if (m_channel != 0)
+	{
+		m_channel->NotifyAntennaChange(m_channelIndex);
+	}
+}
+double
+LearnNetDevice::GetAzimuth(void) const
+{
+	return m_azimuth;
 }
+double
+LearnNetDevice::GetTilt(void) const
+{
+	return m_tilt;
+}
+
 
 } // namespace ns3
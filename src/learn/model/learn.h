@@ -23,58 +23,481 @@
 #include "ns3/pointer.h"
 #include "ns3/net-device-queue-interface.h"
 #include "ns3/header.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/event-id.h"
+#include "ns3/mobility-model.h"
+#include "ns3/propagation-delay-model.h"
+#include "ns3/propagation-loss-model.h"
+#include "learn-antenna.h"
+#include "learn-obstacles.h"
+#include "learn-stats.h"
+#include "learn-timing-wheel.h"
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace ns3
 {
 
 
 class LearnNetDevice;
+class LearnRxEvent;
+class LearnWheelEvent;
 class Packet;
 
+//link layer addressing of a frame, carried from Send to the receivers
+class LearnMacTag : public Tag
+{
+  public:
+	static TypeId GetTypeId(void);
+	virtual TypeId GetInstanceTypeId(void) const;
+
+	LearnMacTag();
+
+	void SetDestination(Mac48Address dest);
+
+	Mac48Address GetDestination(void) const;
+
+	void SetSource(Mac48Address source);
+
+	Mac48Address GetSource(void) const;
+	//device that should pick the frame up, the destination itself unless relayed
+	void SetNextHop(Mac48Address nextHop);
+
+	Mac48Address GetNextHop(void) const;
+
+	void SetProtocol(uint16_t protocol);
+
+	uint16_t GetProtocol(void) const;
+	//hops the frame may still take before it is dropped
+	void SetHopLimit(uint8_t hops);
+
+	uint8_t GetHopLimit(void) const;
+
+	virtual uint32_t GetSerializedSize(void) const;
+	virtual void Serialize(TagBuffer i) const;
+	virtual void Deserialize(TagBuffer i);
+	virtual void Print(std::ostream &os) const;
+
+  private:
+	Mac48Address m_destination;
+	Mac48Address m_source;
+	Mac48Address m_nextHop;
+	uint16_t m_protocol;
+	uint8_t m_hopLimit;
+};
+
 class LearnChannel : public Channel
 {
   public:
 	static TypeId GetTypeId(void);
+	//signature of the LinkLoss trace: the packet, the sender and the receiver
+	typedef void (*LinkLossTracedCallback)(Ptr<const Packet> packet, Ptr<NetDevice> src, Ptr<NetDevice> dst);
 	//construct the channel
 	LearnChannel();
-	//attach the device to this channel
-	void Attach(Ptr<LearnNetDevice> device);
+	//attach the device to this channel, return its index on the channel
+	std::size_t Attach(Ptr<LearnNetDevice> device);
+	//attach a compact device at x, y: a position and a reception count, with no NetDevice behind it
+	std::size_t AddCompactDevice(double x, double y);
+	//hand compact device index over to a full device, done by LearnNetDevice::Materialize
+	void Materialize(std::size_t index, Ptr<LearnNetDevice> device);
+	//true if device index has no NetDevice yet
+	bool IsCompact(std::size_t index) const;
+	//packets that reached compact device index
+	uint32_t GetRxCount(std::size_t index) const;
+	//reserve storage for n attached devices
+	void Reserve(std::size_t n);
 	//start to send packet to src at txTime
 	virtual bool TransmitStart(Ptr<const Packet> p, Ptr<LearnNetDevice> src, Time txTime);
 	//device number attached to this device
 	virtual std::size_t GetNDevices(void) const;
-	//get the i device of the attached learn devices
+	//get the i device of the attached learn devices, 0 for a compact device
 	Ptr<LearnNetDevice> GetLearnDevice(std::size_t i) const;
-	//get the i device of the attached devices
+	//get the i device of the attached devices, 0 for a compact device
 	virtual Ptr<NetDevice> GetDevice(std::size_t i) const;
+	//set the loss probability of the link from device src to device dst, 0 removes the entry
+	void SetLinkLoss(std::size_t src, std::size_t dst, double p);
+	void SetLinkLoss(Ptr<LearnNetDevice> src, Ptr<LearnNetDevice> dst, double p);
+	//get the loss probability of the link from device src to device dst
+	double GetLinkLoss(std::size_t src, std::size_t dst) const;
+	//channel index of the device with address, or NO_DEVICE
+	std::size_t FindDevice(Mac48Address address) const;
+	//keep the address lookup of device index up to date
+	void NotifyAddressChange(std::size_t index, Mac48Address oldAddress, Mac48Address newAddress);
+	//device index moved, read its new position
+	void NotifyPositionChange(std::size_t index);
+	//changes every time device index moves
+	uint32_t GetPositionEpoch(std::size_t index) const;
+	//position of device index
+	double GetX(std::size_t index) const;
+
+	double GetY(std::size_t index) const;
+
+	double GetZ(std::size_t index) const;
+	//device index receives the frames sent to multicast address group
+	void JoinGroup(std::size_t index, Mac48Address group);
+	//device index stops receiving the frames sent to group
+	void LeaveGroup(std::size_t index, Mac48Address group);
+	//devices that joined group
+	std::size_t GetNGroupMembers(Mac48Address group) const;
+	//get the distance between the devices with channel index i and j
+	virtual double GetDist(std::size_t i, std::size_t j) const;
+	//device index changed its antenna pattern or orientation, read them again
+	void NotifyAntennaChange(std::size_t index);
+	//changes every time device index moves or turns its antenna
+	uint32_t GetGeometryEpoch(std::size_t index) const;
+	//sum in dB of the antenna gains of src toward dst and of dst toward src
+	double GetLinkGain(std::size_t src, std::size_t dst);
+	//distance with the free space loss of the link from src to dst once the antenna gains are counted
+	double GetEffectiveDist(std::size_t src, std::size_t dst);
+	//obstacles that block links, 0 for none
+	void SetObstacles(Ptr<LearnObstacleMap> obstacles);
+
+	Ptr<LearnObstacleMap> GetObstacles(void) const;
+	//true if no obstacle stands between devices i and j
+	bool IsLineOfSight(std::size_t i, std::size_t j);
+	//delay model replacing DelayFac, memoized per link so it must be deterministic
+	void SetPropagationDelayModel(Ptr<PropagationDelayModel> model);
+
+	Ptr<PropagationDelayModel> GetPropagationDelayModel(void) const;
+	//deterministic loss model, memoized per link
+	void SetPropagationLossModel(Ptr<PropagationLossModel> model);
+
+	Ptr<PropagationLossModel> GetPropagationLossModel(void) const;
+	//stochastic loss model, applied to every packet after the deterministic one
+	void SetFadingLossModel(Ptr<PropagationLossModel> model);
+
+	Ptr<PropagationLossModel> GetFadingLossModel(void) const;
+	//forget the memoized propagation of every link, needed after changing the attributes of a model
+	void ClearPropagationCache(void);
+	//power in dBm received at dst from src with the deterministic loss and the antenna gains
+	double GetRxPower(std::size_t src, std::size_t dst);
+	//next device on a shortest path from src to dst within MaxRange, antennas taken as isotropic, NO_DEVICE if dst cannot be reached
+	std::size_t GetNextHop(std::size_t src, std::size_t dst);
+	//add or remove device index from the fan-out list of listening devices, neither asleep nor transmitting
+	void SetListening(std::size_t index, bool listening);
+	//number of devices currently listening to the channel
+	std::size_t GetNListeners(void) const;
+	//channel index of the k-th listening device, in no particular order
+	std::size_t GetListener(std::size_t k) const;
+	//returned by FindDevice for an unknown address
+	static const std::size_t NO_DEVICE = ~static_cast<std::size_t>(0);
+	//time until which device index senses the medium busy
+	Time GetBusyUntil(std::size_t index) const;
+	//declare a background broadcast flow from src offered at rate in packets of packetSize bytes, modelled as fluid load
+	void AddFluidFlow(Ptr<LearnNetDevice> src, DataRate rate, uint32_t packetSize);
+	//same for a flow from src to dst, sent at the rate of that link
+	void AddFluidFlow(Ptr<LearnNetDevice> src, Ptr<LearnNetDevice> dst, DataRate rate, uint32_t packetSize);
+	//remove all background flows
+	void ClearFluidFlows(void);
+	//fraction of airtime occupied by the background flows
+	double GetFluidLoad(void);
+	//mean time a packet waits for the medium because of the background flows
+	Time GetFluidWait(void);
+	//time the next packet waits for the medium because of the background flows
+	Time DrawFluidWait(void);
+	//a device changed its rate or rate table, the airtime of the background flows is computed again
+	void NotifyRateChange(void);
+	//use a fixed random variable stream for the link losses, return the number of streams used
+	int64_t AssignStreams(int64_t stream);
+	//write the channel and device state, with the packets in flight, to a binary snapshot
+	void SaveCheckpoint(std::ostream &os);
+	void SaveCheckpoint(std::string filename);
+	//restore a snapshot into a channel with the same devices attached, times are relative to now
+	void RestoreCheckpoint(std::istream &is);
+	void RestoreCheckpoint(std::string filename);
+	//receive events made by the pool so far, in flight or free
+	std::size_t GetNRxEvents(void) const;
+	//central scheduler of the slotted mode: add to grants the devices that send in slot, out of those with packets queued
+	typedef Callback<void, uint64_t, const std::vector<std::size_t> &, std::vector<std::size_t> &> SlotScheduler;
+	//replace the round robin scheduler of the slotted mode
+	void SetSlotScheduler(SlotScheduler scheduler);
+	//true when SlotTime is set, devices then only send in the slots granted to them
+	bool IsSlotted(void) const;
+	//device index has packets queued, called by the device in slotted mode
+	void NotifySlotDemand(std::size_t index);
+	//slot boundaries handled so far
+	uint64_t GetNSlots(void) const;
 
   protected:
+	virtual void DoDispose(void);
 	//get the delay of channel from n1 to n2
 	Time GetDelay(Ptr<LearnNetDevice> n1, Ptr<LearnNetDevice> n2) const;
 	//get the delay factor of the channel
 	Time GetDelayFac(void) const;
 
   private:
-	//get the distance from n1 to n2
-	virtual double GetDist(Ptr<LearnNetDevice> n1, Ptr<LearnNetDevice> n2) const;
-	//max attached device number for each channel
-	static const std::size_t N_DEVICES = 16;
+	//count a packet reaching compact device index
+	void CompactReceive(std::size_t index);
 	//the relationship between time and distance
 	Time m_delay_fac;
+	//devices farther apart do not hear each other, 0 for no limit
+	double m_maxRange;
 	//number of devices attached to this channel
 	std::size_t m_nDevices;
 
 	TracedCallback<Ptr<const Packet>, Ptr<NetDevice>, Ptr<NetDevice>, Time, Time> m_txrxLearn;
-	//devices attach to this channel
-	Ptr<LearnNetDevice> m_devices[N_DEVICES];
-	//the distance between the attached devices
-	double m_dist[N_DEVICES][N_DEVICES];
+	//packet lost on a link, fired with the packet, the sender and the receiver
+	TracedCallback<Ptr<const Packet>, Ptr<NetDevice>, Ptr<NetDevice>> m_linkLossTrace;
+	//devices attach to this channel, 0 for compact devices
+	std::vector<Ptr<LearnNetDevice>> m_devices;
+	//positions of all the devices, full ones mirror their own
+	std::vector<double> m_posX;
+	std::vector<double> m_posY;
+	std::vector<double> m_posZ;
+	std::vector<uint32_t> m_posEpoch;
+	//direction from one device to another in degrees, valid while both keep their position epochs
+	struct LinkAngles
+	{
+		uint32_t fromEpoch;
+		uint32_t toEpoch;
+		float azimuth;
+		float elevation;
+	};
+	//antenna of a device: pattern, orientation in degrees and the directions toward the other devices
+	struct AntennaState
+	{
+		Ptr<const LearnAntennaPattern> pattern;
+		double azimuth;
+		double tilt;
+		uint32_t epoch;
+		std::vector<LinkAngles> angles;
+	};
+	//antennas by device index, empty until a device sets one
+	std::vector<AntennaState> m_antennas;
+	//number of devices with an antenna pattern
+	std::size_t m_nAntennas;
+	//obstacles, and the extra delay and loss probability of the links they block
+	Ptr<LearnObstacleMap> m_obstacles;
+	Time m_nlosDelay;
+	double m_nlosLoss;
+	//line of sight of a link, valid while both ends keep their position epochs
+	struct LosEntry
+	{
+		uint32_t lowEpoch;
+		uint32_t highEpoch;
+		bool los;
+	};
+	//line of sight by link, keyed on the lower index in the high 32 bits and the higher one in the low ones
+	std::unordered_map<uint64_t, LosEntry> m_los;
+	//obstacle map version the line of sight cache was filled with
+	uint32_t m_losVersion;
+	//drop the line of sight cache if obstacles were added since it was filled
+	void SyncLineOfSight(void);
+	//propagation models, transmit power and the power below which nothing is received, in dBm
+	Ptr<PropagationDelayModel> m_delayModel;
+	Ptr<PropagationLossModel> m_lossModel;
+	Ptr<PropagationLossModel> m_fadingModel;
+	double m_txPower;
+	double m_rxSensitivity;
+	//memoized deterministic propagation of a link, valid while both ends keep their geometry epochs
+	struct Propagation
+	{
+		uint32_t srcEpoch;
+		uint32_t dstEpoch;
+		double rxPower;
+		Time delay;
+	};
+	//propagation by link, keyed on the sender index in the high 32 bits and the receiver's in the low ones
+	std::unordered_map<uint64_t, Propagation> m_propagation;
+	//stand-ins handed to the models, placed at the ends of the link being evaluated
+	Ptr<MobilityModel> m_srcMobility;
+	Ptr<MobilityModel> m_dstMobility;
+	//place the stand-ins at devices src and dst
+	void SetMobility(std::size_t src, std::size_t dst);
+	//propagation of the link from src to dst, from the cache
+	const Propagation &GetPropagation(std::size_t src, std::size_t dst);
+	//direction from device from toward device to, from the cache
+	const LinkAngles &GetLinkAngles(std::size_t from, std::size_t to);
+	//gain of the antenna of device from toward device to, 0 without a pattern
+	double GetAntennaGain(std::size_t from, std::size_t to);
+	//receptions of compact devices
+	std::vector<uint32_t> m_rxCount;
+	//sparse loss row of one sender: (receiver index, loss probability), sorted by receiver index
+	typedef std::vector<std::pair<std::size_t, double>> LinkLossRow;
+	//the lossy links of each sender, links not in the row never lose packets
+	std::vector<LinkLossRow> m_linkLoss;
+	//channel index of each device address
+	std::map<Mac48Address, std::size_t> m_addressIndex;
+	//random variable for the link loss decision
+	Ptr<UniformRandomVariable> m_lossRng;
+	//look up the loss probability of receiver dst in a loss row
+	static double FindLinkLoss(const LinkLossRow &row, std::size_t dst);
+	//marks a device that is not on the listener list
+	static const std::size_t NOT_LISTENING = ~static_cast<std::size_t>(0);
+	//background flow: sender, receiver or NO_DEVICE for a broadcast, offered rate and packet size
+	struct FluidFlow
+	{
+		Ptr<LearnNetDevice> src;
+		std::size_t dst;
+		DataRate rate;
+		uint32_t packetSize;
+	};
+	std::vector<FluidFlow> m_fluidFlows;
+	//background load: sum of rate * airtime, and of rate * airtime^2 in seconds
+	double m_fluidLoad;
+	double m_fluidSecondMoment;
+	//cached mean wait for the medium under the fluid load
+	Time m_fluidWait;
+	//true when a rate or the geometry changed since the load was computed
+	bool m_fluidStale;
+	//random variable for the waits
+	Ptr<UniformRandomVariable> m_fluidRng;
+	//compute the load of the flows again if it is stale
+	void SyncFluidLoad(void);
+	//indices of the devices that are neither asleep nor transmitting, in no particular order
+	std::vector<std::size_t> m_listeners;
+	//position of each device in m_listeners, or NOT_LISTENING
+	std::vector<std::size_t> m_listenerPos;
+	//end of the last signal heard by each device
+	std::vector<Time> m_busyUntil;
+	//schedule the arrival of p from device src at device dst after delay
+	void ScheduleArrival(std::size_t dst, std::size_t src, Ptr<Packet> p, Time delay);
+	//hand a tracked packet in flight to its receiver
+	void DeliverInFlight(uint64_t id);
+	//packet on its way to a receiver
+	struct InFlight
+	{
+		std::size_t dst;
+		std::size_t src;
+		Ptr<Packet> packet;
+		Time arrival;
+	};
+	//keep the packets in flight so that checkpoints can capture them
+	bool m_trackInFlight;
+	//id of the next tracked packet in flight
+	uint64_t m_inFlightSeq;
+	//tracked packets in flight, by id in scheduling order
+	std::map<uint64_t, InFlight> m_inFlight;
+	//grid cell of side MaxRange
+	typedef std::pair<int64_t, int64_t> Cell;
+	Cell GetCell(std::size_t index) const;
+	//add device index to the grid and link it with the devices in range
+	void AddToConnectivity(std::size_t index);
+	//remove device index from the grid and from the neighbour lists
+	void RemoveFromConnectivity(std::size_t index);
+	//update the grid cell and the neighbour lists of device index after a move
+	void MoveInConnectivity(std::size_t index);
+	//mark stale the next hop trees the link between i and j, added or removed, can change
+	void InvalidateNextHops(std::size_t i, std::size_t j, bool added);
+	//true once the grid and the neighbour lists exist, they are built on the first relay lookup
+	bool m_connectivityBuilt;
+	//devices of each grid cell
+	std::map<Cell, std::vector<std::size_t>> m_grid;
+	//grid cell of each device
+	std::vector<Cell> m_cells;
+	//devices within MaxRange of each device
+	std::vector<std::vector<std::size_t>> m_neighbours;
+	//neighbours found for a moved device
+	std::vector<std::size_t> m_neighbourScratch;
+	//changes with link losses, line of sight and relays, trees of another epoch are rebuilt on use
+	uint64_t m_topologyEpoch;
+	//next hop and hop count of every device toward one destination
+	struct NextHopTree
+	{
+		NextHopTree()
+			: epoch(0), stale(true)
+		{
+		}
+		uint64_t epoch;
+		//a link the tree may depend on changed
+		bool stale;
+		std::vector<uint32_t> nextHop;
+		std::vector<uint32_t> depth;
+	};
+	//trees of the destinations relayed to so far
+	std::map<std::size_t, NextHopTree> m_nextHops;
+	friend class LearnRxEvent;
+	//schedule the reception at device dst of p from device src with a pooled event, p is 0 for a compact receiver
+	void ScheduleRx(std::size_t dst, std::size_t src, Ptr<Packet> p, Time delay, uint32_t context);
+	//run a pooled reception
+	void DeliverRx(std::size_t dst, std::size_t src, Ptr<Packet> p);
+	//head of the intrusive list of free receive events
+	LearnRxEvent *m_freeRxEvents;
+	//every receive event of the pool, each holding the pool's reference
+	std::vector<LearnRxEvent *> m_rxEvents;
+	//slot length, 0 when not slotted, and devices granted per slot by the round robin scheduler
+	Time m_slotTime;
+	uint32_t m_grantsPerSlot;
+	SlotScheduler m_slotScheduler;
+	//true while the slot boundary event is scheduled
+	bool m_slotRunning;
+	EventId m_slotEvent;
+	//number of the current slot, counted from time 0
+	uint64_t m_slot;
+	uint64_t m_nSlots;
+	//first device of the demand list in the next round robin turn
+	std::size_t m_roundRobin;
+	//devices with packets queued, and the position of each device in it or NOT_LISTENING
+	std::vector<std::size_t> m_slotDemand;
+	std::vector<std::size_t> m_slotDemandPos;
+	//grants of the current slot
+	std::vector<std::size_t> m_grants;
+	//reception collected during a slot, delivered at a later boundary
+	struct SlotRx
+	{
+		Time arrival;
+		uint32_t dst;
+		uint32_t src;
+		//0 for a compact receiver
+		Ptr<Packet> packet;
+	};
+	//receptions not delivered yet, and a buffer for the ones still on their way at a boundary
+	std::vector<SlotRx> m_slotRx;
+	std::vector<SlotRx> m_slotRxLater;
+	//receptions of a slot for each node other than the one of the slot event, delivered in the node's context
+	std::map<uint32_t, std::vector<SlotRx>> m_slotBatches;
+	std::vector<SlotRx> m_slotBatchScratch;
+	//slot boundary: deliver what arrived, then grant and send the next slot
+	void SlotBoundary(void);
+	//deliver the receptions of the slot batch of node
+	void DeliverSlotBatch(uint32_t node);
+	//default scheduler: the next grantsPerSlot devices of the demand list
+	void RoundRobinGrants(uint64_t slot, const std::vector<std::size_t> &demand, std::vector<std::size_t> &grants);
+	//take device index off the demand list
+	void RemoveSlotDemand(std::size_t index);
+	//fan-out of one transmission to the listening devices
+	typedef bool (LearnChannel::*FanOutFn)(Ptr<const Packet> p, Ptr<LearnNetDevice> src, Time txTime,
+										  const std::vector<std::size_t> &receivers);
+	//fan-out built for one configuration: distances in 3D or in the plane, delays from DelayFac or from
+	//the propagation models, deliveries by event or by slot; GENERIC keeps GetDist virtual and handles
+	//antennas and obstacles; receivers is m_listeners or the members of a group
+	template <bool THREE_D, bool MODELS, bool SLOTTED, bool GENERIC>
+	bool FanOut(Ptr<const Packet> p, Ptr<LearnNetDevice> src, Time txTime, const std::vector<std::size_t> &receivers);
+	//fan-out for the current configuration
+	FanOutFn SelectFanOut(void) const;
+	//use the fan-out built for the configuration, false for the generic one only
+	bool m_specializedFanOut;
+	//devices with a height other than 0
+	std::size_t m_nRaised;
+	//members of each multicast group that has any
+	std::map<Mac48Address, std::vector<std::size_t>> m_groups;
+	//no members: the receivers of a frame sent to a group nobody joined
+	std::vector<std::size_t> m_noMembers;
+	friend class LearnWheelEvent;
+	//hold pooled receptions in the channel's timing wheel rather than in their events, and its tick
+	bool m_arrivalWheel;
+	Time m_wheelTick;
+	//pending receptions, made on the first one
+	Ptr<LearnTimingWheel> m_wheel;
+	//every wheel event made, with the channel's reference, and the free ones
+	std::vector<LearnWheelEvent *> m_wheelEvents;
+	LearnWheelEvent *m_freeWheelEvents;
+	//event of the last reception of the current fan-out, with its time and context, 0 when none
+	LearnWheelEvent *m_wheelGroup;
+	int64_t m_wheelGroupTime;
+	uint32_t m_wheelGroupContext;
+	//deliver the next count arrivals of the wheel, due now in the current context
+	void WheelExpire(uint32_t count);
 };
 
 //////////////////////////////////////////////////////////////////////////
 
 template <typename Item>
 class Queue;
+class QueueItem;
 class LearnChannel;
 class ErrorModel;
 
@@ -82,21 +505,96 @@ class LearnNetDevice : public NetDevice
 {
   public:
 	static TypeId GetTypeId(void);
+	//radio state of the device, only listening devices receive packets
+	enum RadioState
+	{
+		SLEEP,
+		LISTEN,
+		TRANSMIT
+	};
+	//how the next packet is picked among the tx queues, queue 0 has the highest priority
+	enum TxScheduler
+	{
+		STRICT_PRIORITY,
+		DEFICIT_ROUND_ROBIN
+	};
+	//rate of broadcast frames when a rate table is set
+	enum BroadcastRatePolicy
+	{
+		BROADCAST_BASIC,
+		BROADCAST_LOWEST_COMMON
+	};
+	//which latency statistics the device keeps for the packets it receives
+	enum LatencyStatsMode
+	{
+		STATS_NONE,
+		STATS_DEVICE,
+		STATS_LINK
+	};
 
 	LearnNetDevice();
 	virtual ~LearnNetDevice();
 
 	void SetDataRate(DataRate bps);
 
+	DataRate GetDataRate(void) const;
+	//use rate for receivers up to maxDistance away, beyond the last entry the lowest rate is used
+	void AddRate(double maxDistance, DataRate rate);
+	//replace the rate table with "distance:rate" entries separated by commas, empty sends everything at the data rate
+	void SetRateTable(std::string table);
+
+	std::string GetRateTable(void) const;
+	//rate of a unicast frame to the device with channel index dst
+	DataRate GetLinkRate(std::size_t dst);
+	//rate used to send packet p to dest
+	DataRate GetTxRate(Ptr<const Packet> p);
+	//rate of broadcast frames, according to the BroadcastRate policy
+	DataRate GetBroadcastRate(void);
+
 	void SetInterframeGap(Time t);
+	//send one packet in a slot granted by a slotted channel, return true if more are queued
+	bool TransmitSlot(void);
 	//attach device to channel
 	bool Attach(Ptr<LearnChannel> ch);
+	//take the place of compact device index on channel ch, at its position
+	bool Materialize(Ptr<LearnChannel> ch, std::size_t index);
+	//index of this device on the attached channel
+	std::size_t GetChannelIndex(void) const;
 
+	//set the first tx queue
 	void SetQueue(Ptr<Queue<Packet>> queue);
-
+	//first tx queue
 	Ptr<Queue<Packet>> GetQueue(void) const;
+	//add a tx queue of lower priority than the existing ones, return its index
+	std::size_t AddTxQueue(Ptr<Queue<Packet>> queue);
+
+	std::size_t GetNTxQueues(void) const;
+
+	Ptr<Queue<Packet>> GetTxQueue(std::size_t i) const;
+	//pick the tx queue of a packet, by default from its SocketPriorityTag like pfifo_fast
+	void SetQueueSelector(Callback<std::size_t, Ptr<const Packet>> selector);
+	//tx queue of a queue item, for NetDeviceQueueInterface::SetSelectQueueCallback
+	std::size_t SelectTxQueue(Ptr<QueueItem> item) const;
 
 	void SetReceiveErrorModel(Ptr<ErrorModel> em);
+	//put the radio to SLEEP or LISTEN, a transmission in progress finishes first
+	void SetRadioState(RadioState state);
+	//current radio state
+	RadioState GetRadioState(void) const;
+	//total time spent in state, including the current period
+	Time GetRadioStateTime(RadioState state) const;
+	//write the device state, with its queue and current packet, to a snapshot
+	void SaveState(std::ostream &os);
+	//restore the device state from a snapshot, the device must be idle
+	void RestoreState(std::istream &is);
+	//latency of all the packets received by this device
+	const LearnLatencyStats &GetLatencyStats(void) const;
+	//latency of the packets received from the device with channel index src, needs STATS_LINK
+	const LearnLatencyStats &GetLinkLatencyStats(std::size_t src) const;
+	//write the latency statistics of the device and of each link
+	void PrintLatencyStats(std::ostream &os) const;
+	//use a fixed random variable stream for the backoff, return the number of streams used
+	int64_t AssignStreams(int64_t stream);
 	//receive callback handler
 	void Receive(Ptr<Packet> p, Ptr<LearnNetDevice> src);
 
@@ -109,6 +607,26 @@ class LearnNetDevice : public NetDevice
 	virtual void SetY(double y);
 	
 	virtual void SetXY(double x, double y);
+	//height, 0 by default
+	double GetZ(void) const;
+
+	void SetZ(double z);
+	//move to x, y, z with a single position change
+	void SetXYZ(double x, double y, double z);
+	//receive the frames sent to multicast address group
+	void JoinGroup(Mac48Address group);
+	//stop receiving the frames sent to group
+	void LeaveGroup(Mac48Address group);
+	//directional antenna, 0 for an isotropic one
+	void SetAntenna(Ptr<const LearnAntennaPattern> pattern);
+
+	Ptr<const LearnAntennaPattern> GetAntenna(void) const;
+	//point the antenna boresight to azimuth (counterclockwise from the x axis) and tilt (up from horizontal), in degrees
+	void SetOrientation(double azimuth, double tilt);
+
+	double GetAzimuth(void) const;
+
+	double GetTilt(void) const;
 
 	////////////////////////////////////////////////////////////////
 
@@ -137,7 +655,7 @@ class LearnNetDevice : public NetDevice
 	virtual bool IsMulticast(void) const;
 	
 	virtual Address GetMulticast(Ipv4Address multicastGroup) const;
-	址
+	
 	virtual Address GetMulticast(Ipv6Address addr) const;
 	
 	virtual bool IsBridge(void) const;
@@ -147,6 +665,10 @@ class LearnNetDevice : public NetDevice
 	virtual bool Send(Ptr<Packet> packet, const Address &dest, uint16_t protocolNumber);
 
 	virtual bool SendFrom(Ptr<Packet> packet, const Address &source, const Address &dest, uint16_t protocolNumber);
+	//send n packets to dest as one burst, return how many were queued
+	uint32_t SendBatch(const Ptr<Packet> *packets, std::size_t n, const Address &dest, uint16_t protocolNumber);
+
+	uint32_t SendBatch(const std::vector<Ptr<Packet>> &packets, const Address &dest, uint16_t protocolNumber);
 
 	virtual Ptr<Node> GetNode(void) const;
 
@@ -171,25 +693,62 @@ class LearnNetDevice : public NetDevice
 	bool TransmitStart(Ptr<Packet> p);
 	void TransmitComplete(void);
 	void NotifyLinkUp(void);
+	//enter state and account the time spent in the previous one
+	void ChangeRadioState(RadioState state);
+	//tx queue a packet goes to
+	std::size_t SelectQueue(Ptr<const Packet> p) const;
+	//true if any tx queue holds a packet
+	bool HasQueuedPackets(void) const;
+	//next packet to transmit according to the tx scheduler
+	Ptr<Packet> DequeueNext(void);
+	//queue a tagged packet and start transmitting if idle
+	bool Enqueue(Ptr<Packet> packet);
+	//start transmitting the queued packets if idle
+	bool StartQueued(void);
+	//next hop toward dest, false if dest cannot be reached
+	bool FindNextHop(Mac48Address dest, Mac48Address &nextHop) const;
+	//pass on a frame addressed to another device
+	void Forward(Ptr<Packet> packet, LearnMacTag &macTag);
+	//carrier sense: true if the medium is idle or carrier sense is off
+	bool IsMediumIdle(void) const;
+	//defer the head of the queue by a random backoff after the busy period
+	void StartBackoff(void);
+	//end of backoff, transmit the head of the queue if the medium is idle
+	void TryTransmit(void);
 	enum TxMachineState
 	{
 		READY,
-		BUSY
+		BUSY,
+		BACKOFF
 	};
 	//tx state
 	TxMachineState m_txMachineState;
+	//radio state
+	RadioState m_radioState;
+	//radio state to go back to when not transmitting
+	RadioState m_idleRadioState;
+	//time the current radio state was entered
+	Time m_radioStateStart;
+	//accumulated time in each radio state
+	Time m_radioStateTime[TRANSMIT + 1];
 	//datarate
 	DataRate m_bps;
 	//interframe of this device
 	Time m_tInterframeGap;
 	//attached channel
 	Ptr<LearnChannel> m_channel;
-	//tx queue
-	Ptr<Queue<Packet>> m_queue;
+	//index on the attached channel
+	std::size_t m_channelIndex;
+	//tx queues, by decreasing priority
+	std::vector<Ptr<Queue<Packet>>> m_queues;
+	//optional tx queue classifier
+	Callback<std::size_t, Ptr<const Packet>> m_queueSelector;
 	Ptr<ErrorModel> m_receiveErrorModel;
 
 	TracedCallback<Ptr<const Packet>> m_macTxTrace;
 	TracedCallback<Ptr<const Packet>> m_macTxDropTrace;
+	//relayed toward the next hop
+	TracedCallback<Ptr<const Packet>> m_forwardTrace;
 	TracedCallback<Ptr<const Packet>> m_macPromiscRxTrace;
 	TracedCallback<Ptr<const Packet>> m_macRxTrace;
 	TracedCallback<Ptr<const Packet>> m_macRxDropTrace;
@@ -221,9 +780,55 @@ class LearnNetDevice : public NetDevice
 	uint32_t m_mtu;
 	//packet
 	Ptr<Packet> m_currentPkt;
+	//end of the current transmission
+	EventId m_txCompleteEvent;
+	//latency statistics kept
+	LatencyStatsMode m_latencyStatsMode;
+	//latency of all the received packets
+	LearnLatencyStats m_latencyStats;
+	//latency by sender channel index
+	std::map<std::size_t, LearnLatencyStats> m_linkLatencyStats;
+	//carrier sense and backoff
+	bool m_carrierSense;
+	Time m_slotTime;
+	uint32_t m_cwMin;
+	uint32_t m_cwMax;
+	//current contention window
+	uint32_t m_cw;
+	Ptr<UniformRandomVariable> m_backoffRng;
+	//pending TryTransmit, after a backoff or a restored checkpoint
+	EventId m_backoffEvent;
+	//tx scheduler
+	TxScheduler m_txScheduler;
+	//deficit round robin: quantum, credit of each queue, queue whose turn it is
+	uint32_t m_drrQuantum;
+	std::vector<uint32_t> m_deficits;
+	std::size_t m_drrCurrent;
+	//true once the current queue got its quantum for this turn
+	bool m_drrCredited;
+	//L2 relaying and the hop limit of frames sent
+	bool m_forwarding;
+	uint8_t m_maxHops;
+	//rate table: (max distance, rate) sorted by distance, the data rate is the basic rate
+	std::vector<std::pair<double, DataRate>> m_rateTable;
+	BroadcastRatePolicy m_broadcastRatePolicy;
+	//cached rate to a receiver, valid while both ends keep their geometry epochs
+	struct LinkRate
+	{
+		uint32_t srcEpoch;
+		uint32_t dstEpoch;
+		DataRate rate;
+	};
+	//cached rates by receiver channel index
+	std::vector<LinkRate> m_linkRates;
 	//position
 	double m_x;
 	double m_y;
+	double m_z;
+	//antenna pattern and orientation
+	Ptr<const LearnAntennaPattern> m_antenna;
+	double m_azimuth;
+	double m_tilt;
 };
 
 } // namespace ns3
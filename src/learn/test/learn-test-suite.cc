@@ -1,49 +1,1987 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
 
-// Include a header file from your module to test.
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <set>
+#include <sstream>
+#include <vector>
 #include "ns3/learn.h"
+#include "ns3/learn-helper.h"
+#include "ns3/learn-mobility-trace.h"
+#include "ns3/learn-replication.h"
+#include "ns3/learn-timing-wheel.h"
+#include "ns3/learn-topology.h"
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/propagation-module.h"
+#include "ns3/test.h"
+
+// Do not put your test classes in namespace ns3.  You may find it useful
+// to use the using directive to access the ns3 namespace directly
+using namespace ns3;
+
+//
+// Allocations are counted while g_countAllocations is set, which only
+// LearnAllocationBudgetTestCase does, so that it can bound the allocations
+// made on the transmit and receive paths. The replacement operator new is
+// linked into the whole test library, the count is not.
+//
+static bool g_countAllocations = false;
+static uint64_t g_allocations = 0;
+
+void *
+operator new (std::size_t size)
+{
+  if (g_countAllocations)
+    {
+      ++g_allocations;
+    }
+  void *p = std::malloc (size == 0 ? 1 : size);
+  if (p == 0)
+    {
+      throw std::bad_alloc ();
+    }
+  return p;
+}
+
+void
+operator delete (void *p) noexcept
+{
+  std::free (p);
+}
+
+//
+// Budgets of the hot path. A broadcast costs one event for the end of the
+// transmission and one per receiver, and each receiver gets one copy of the
+// packet. The allocation budgets are counted by LearnAllocationBudgetTestCase
+// on the ns-3 it is built against.
+//
+
+//
+// Devices on one channel at the given positions, 8 Mbps so that 1000 bytes
+// take 1 ms, and 1 us of propagation delay per meter.
+//
+static NetDeviceContainer
+CreateDevices (NodeContainer &nodes, const std::vector<double> &xs, const std::vector<double> &ys)
+{
+  LearnHelper learn;
+  learn.SetDeviceAttribute ("DataRate", StringValue ("8Mbps"));
+  learn.SetChannelAttribute ("DelayFac", TimeValue (MicroSeconds (1)));
+  for (std::size_t i = 0; i < xs.size (); ++i)
+    {
+      learn.AddPosition (xs[i], ys[i]);
+    }
+  nodes.Create (xs.size ());
+  return learn.Install (nodes);
+}
+
+//
+// Records what every device receives.
+//
+class LearnReceiveRecorder
+{
+public:
+  struct Reception
+  {
+    Ptr<NetDevice> device;
+    Ptr<const Packet> packet;
+    uint16_t protocol;
+    Address from;
+    Time time;
+  };
+
+  void Connect (NetDeviceContainer devices);
+  bool Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address &from);
+
+  std::vector<Reception> m_receptions;
+};
+
+void
+LearnReceiveRecorder::Connect (NetDeviceContainer devices)
+{
+  for (uint32_t i = 0; i < devices.GetN (); ++i)
+    {
+      devices.Get (i)->SetReceiveCallback (MakeCallback (&LearnReceiveRecorder::Receive, this));
+    }
+}
+
+bool
+LearnReceiveRecorder::Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address &from)
+{
+  Reception r;
+  r.device = device;
+  r.packet = packet;
+  r.protocol = protocol;
+  r.from = from;
+  r.time = Simulator::Now ();
+  m_receptions.push_back (r);
+  return true;
+}
+
+//
+// Counts the packets a channel's LinkLoss trace reports.
+//
+static void
+CountLinkLoss (uint32_t *count, Ptr<const Packet> packet, Ptr<NetDevice> src, Ptr<NetDevice> dst)
+{
+  ++*count;
+}
+
+//
+// Records when a packet trace fires.
+//
+static void
+RecordTime (std::vector<Time> *times, Ptr<const Packet> packet)
+{
+  times->push_back (Simulator::Now ());
+}
+
+//
+// Counts the packets of a packet trace.
+//
+static void
+CountPacket (uint32_t *count, Ptr<const Packet> packet)
+{
+  ++*count;
+}
+
+/////////////////////////////////////////////////////////////
+
+class LearnDeliveryTestCase : public TestCase
+{
+public:
+  LearnDeliveryTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LearnDeliveryTestCase::LearnDeliveryTestCase ()
+  : TestCase ("Broadcasts reach every other device after the tx time plus DelayFac times the distance")
+{
+}
+
+void
+LearnDeliveryTestCase::DoRun (void)
+{
+  std::vector<double> xs;
+  std::vector<double> ys;
+  xs.push_back (0);
+  ys.push_back (0);
+  xs.push_back (3);
+  ys.push_back (4);
+  xs.push_back (60);
+  ys.push_back (80);
+  NodeContainer nodes;
+  NetDeviceContainer devices = CreateDevices (nodes, xs, ys);
+  LearnReceiveRecorder recorder;
+  recorder.Connect (devices);
+
+  Ptr<Packet> sent = Create<Packet> (1000);
+  devices.Get (0)->Send (sent, devices.Get (0)->GetBroadcast (), 0x86dd);
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (recorder.m_receptions.size (), 2, "Every device but the sender receives once");
+  for (std::size_t k = 0; k < recorder.m_receptions.size (); ++k)
+    {
+      const LearnReceiveRecorder::Reception &r = recorder.m_receptions[k];
+      NS_TEST_ASSERT_MSG_NE (r.device, devices.Get (0), "The sender hears itself");
+      double dist = r.device == devices.Get (1) ? 5 : 100;
+      NS_TEST_ASSERT_MSG_EQ (r.time, MilliSeconds (1) + MicroSeconds (1) * dist, "Wrong delivery time");
+      NS_TEST_ASSERT_MSG_EQ (r.packet->GetSize (), 1000, "Wrong packet size");
+      NS_TEST_ASSERT_MSG_EQ (r.protocol, 0x86dd, "Wrong protocol");
+      NS_TEST_ASSERT_MSG_EQ (r.from, devices.Get (0)->GetAddress (), "Wrong source address");
+    }
+  NS_TEST_ASSERT_MSG_EQ (recorder.m_receptions[0].device, devices.Get (1), "The nearest device receives first");
+  Simulator::Destroy ();
+}
+
+/////////////////////////////////////////////////////////////
+
+class LearnEventBudgetTestCase : public TestCase
+{
+public:
+  LearnEventBudgetTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LearnEventBudgetTestCase::LearnEventBudgetTestCase ()
+  : TestCase ("A broadcast costs one event per receiver plus one, and one packet copy per receiver")
+{
+}
+
+void
+LearnEventBudgetTestCase::DoRun (void)
+{
+  const uint32_t nDevices = 10;
+  const uint32_t nPackets = 5;
+  std::vector<double> xs;
+  std::vector<double> ys;
+  for (uint32_t i = 0; i < nDevices; ++i)
+    {
+      xs.push_back (i);
+      ys.push_back (0);
+    }
+  NodeContainer nodes;
+  NetDeviceContainer devices = CreateDevices (nodes, xs, ys);
+  LearnReceiveRecorder recorder;
+  recorder.Connect (devices);
+
+  std::set<const Packet *> sent;
+  for (uint32_t k = 0; k < nPackets; ++k)
+    {
+      Ptr<Packet> p = Create<Packet> (100);
+      sent.insert (PeekPointer (p));
+      devices.Get (0)->Send (p, devices.Get (0)->GetBroadcast (), 0x0800);
+    }
+  uint64_t events = Simulator::GetEventCount ();
+  Simulator::Run ();
+  events = Simulator::GetEventCount () - events;
+
+  NS_TEST_ASSERT_MSG_EQ (events, nPackets * nDevices, "Events per transmission changed");
+  NS_TEST_ASSERT_MSG_EQ (recorder.m_receptions.size (), nPackets * (nDevices - 1), "Wrong number of receptions");
+  std::set<const Packet *> received;
+  for (std::size_t k = 0; k < recorder.m_receptions.size (); ++k)
+    {
+      const Packet *p = PeekPointer (recorder.m_receptions[k].packet);
+      NS_TEST_ASSERT_MSG_EQ (sent.count (p), 0, "A receiver got the sender's packet");
+      received.insert (p);
+    }
+  NS_TEST_ASSERT_MSG_EQ (received.size (), recorder.m_receptions.size (), "Receivers share a packet");
+  Simulator::Destroy ();
+}
+
+/////////////////////////////////////////////////////////////
+
+//
+// An event that does nothing, kept alive across runs like the channel's
+// pooled receive events.
+//
+class LearnNoopEvent : public EventImpl
+{
+protected:
+  virtual void Notify (void)
+  {
+  }
+};
+
+static void
+Noop (void)
+{
+}
+
+class LearnAllocationBudgetTestCase : public TestCase
+{
+public:
+  LearnAllocationBudgetTestCase ();
+
+private:
+  virtual void DoRun (void);
+  //allocations to send and deliver nPackets broadcasts among nDevices
+  uint64_t CountAllocations (uint32_t nDevices, uint32_t nPackets);
+  //allocations of the ns-3 calls a transmission and a delivery cannot do without
+  void CountBudgets (uint64_t &transmission, uint64_t &delivery);
+};
+
+LearnAllocationBudgetTestCase::LearnAllocationBudgetTestCase ()
+  : TestCase ("Allocations per packet stay within budget")
+{
+}
+
+uint64_t
+LearnAllocationBudgetTestCase::CountAllocations (uint32_t nDevices, uint32_t nPackets)
+{
+  std::vector<double> xs;
+  std::vector<double> ys;
+  for (uint32_t i = 0; i < nDevices; ++i)
+    {
+      xs.push_back (i);
+      ys.push_back (0);
+    }
+  NodeContainer nodes;
+  NetDeviceContainer devices = CreateDevices (nodes, xs, ys);
+  LearnReceiveRecorder recorder;
+  recorder.Connect (devices);
+  recorder.m_receptions.reserve (nDevices * nPackets);
+
+  uint64_t allocations = g_allocations;
+  for (uint32_t k = 0; k < nPackets; ++k)
+    {
+      devices.Get (0)->Send (Create<Packet> (100), devices.Get (0)->GetBroadcast (), 0x0800);
+    }
+  Simulator::Run ();
+  allocations = g_allocations - allocations;
+  //
+  // At most two transmissions have receptions in flight at once: the one
+  // ending and the next one starting.
+  //
+  Ptr<LearnChannel> channel = DynamicCast<LearnChannel> (devices.Get (0)->GetChannel ());
+  NS_TEST_EXPECT_MSG_LT_OR_EQ (channel->GetNRxEvents (), 2 * (nDevices - 1), "Receive event pool grew with the load");
+  Simulator::Destroy ();
+  return allocations;
+}
+
+//
+// The budgets are what the paths must allocate through ns-3 itself, counted
+// here rather than written down so that they are exact for the ns-3 the
+// suite is built against. A transmission creates and tags the packet, passes
+// it through the device queue and schedules the end of the transmission. A
+// delivery copies the packet for the receiver, schedules the pooled receive
+// event, takes the MAC tag off and copies the packet for the trace sinks.
+// Anything the learn code allocates on top of that is over budget.
+//
+void
+LearnAllocationBudgetTestCase::CountBudgets (uint64_t &transmission, uint64_t &delivery)
+{
+  std::vector<double> xs (1, 0);
+  std::vector<double> ys (1, 0);
+  NodeContainer nodes;
+  NetDeviceContainer devices = CreateDevices (nodes, xs, ys);
+  Ptr<Queue<Packet> > queue = devices.Get (0)->GetObject<LearnNetDevice> ()->GetQueue ();
+  Ptr<LearnNoopEvent> event = Create<LearnNoopEvent> ();
+  LearnMacTag tag;
+  tag.SetDestination (Mac48Address::GetBroadcast ());
+
+  //
+  // The first round grows the scheduler and the free lists, the second is
+  // counted.
+  //
+  for (uint32_t round = 0; round < 2; ++round)
+    {
+      uint64_t start = g_allocations;
+      Ptr<Packet> p = Create<Packet> (100);
+      p->AddPacketTag (tag);
+      queue->Enqueue (p);
+      p = queue->Dequeue ();
+      Simulator::Schedule (MicroSeconds (1), &Noop);
+      Simulator::Run ();
+      transmission = g_allocations - start;
+
+      start = g_allocations;
+      Ptr<Packet> copy = p->Copy ();
+      event->Ref ();
+      Simulator::ScheduleWithContext (0, MicroSeconds (1), PeekPointer (event));
+      Simulator::Run ();
+      copy->RemovePacketTag (tag);
+      Ptr<Packet> original = copy->Copy ();
+      delivery = g_allocations - start;
+    }
+  Simulator::Destroy ();
+}
+
+void
+LearnAllocationBudgetTestCase::DoRun (void)
+{
+  //
+  // The difference between two runs leaves out the allocations made once per
+  // run, such as the first growth of the scheduler and of the trace lists.
+  //
+  const uint32_t nDevices = 10;
+  uint64_t transmission = 0;
+  uint64_t delivery = 0;
+  g_countAllocations = true;
+  CountBudgets (transmission, delivery);
+  uint64_t few = CountAllocations (nDevices, 10);
+  uint64_t many = CountAllocations (nDevices, 20);
+  g_countAllocations = false;
+  NS_TEST_ASSERT_MSG_GT (delivery, 0, "Allocations not counted");
+  uint64_t budget = 10 * (transmission + (nDevices - 1) * delivery);
+  NS_TEST_ASSERT_MSG_LT_OR_EQ (many - few, budget, "Allocations per packet over budget");
+}
+
+/////////////////////////////////////////////////////////////
+
+class LearnCompactTestCase : public TestCase
+{
+public:
+  LearnCompactTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LearnCompactTestCase::LearnCompactTestCase ()
+  : TestCase ("Compact devices count receptions with one event each")
+{
+}
+
+void
+LearnCompactTestCase::DoRun (void)
+{
+  const uint32_t nCompact = 50;
+  LearnHelper learn;
+  learn.SetDeviceAttribute ("DataRate", StringValue ("8Mbps"));
+  learn.SetChannelAttribute ("DelayFac", TimeValue (MicroSeconds (1)));
+  for (uint32_t i = 0; i <= nCompact; ++i)
+    {
+      learn.AddPosition (i, 0);
+    }
+  Ptr<LearnChannel> channel = learn.InstallCompact (nCompact + 1);
+  NodeContainer nodes;
+  nodes.Create (1);
+  Ptr<LearnNetDevice> sender = learn.Materialize (channel, 0, nodes.Get (0));
+  NS_TEST_ASSERT_MSG_EQ (channel->IsCompact (0), false, "Materialized device still compact");
+
+  uint64_t events = Simulator::GetEventCount ();
+  sender->Send (Create<Packet> (100), sender->GetBroadcast (), 0x0800);
+  Simulator::Run ();
+  events = Simulator::GetEventCount () - events;
+
+  NS_TEST_ASSERT_MSG_EQ (events, nCompact + 1, "Events per transmission changed");
+  for (uint32_t i = 1; i <= nCompact; ++i)
+    {
+      NS_TEST_ASSERT_MSG_EQ (channel->GetRxCount (i), 1, "Compact device " << i << " missed the packet");
+    }
+  Simulator::Destroy ();
+}
+
+//
+// A sender with a narrow beam reaches a receiver beyond MaxRange in front of
+// it, but not one within range behind it, and turning the beam swaps them.
+//
+class LearnAntennaTestCase : public TestCase
+{
+public:
+  LearnAntennaTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LearnAntennaTestCase::LearnAntennaTestCase ()
+  : TestCase ("Antenna gains extend or cut the range along the beam")
+{
+}
+
+void
+LearnAntennaTestCase::DoRun (void)
+{
+  LearnHelper learn;
+  learn.SetChannelAttribute ("MaxRange", DoubleValue (100));
+  learn.AddPosition (0, 0);
+  learn.AddPosition (150, 0);
+  learn.AddPosition (-50, 0);
+  Ptr<LearnChannel> channel = learn.InstallCompact (3);
+  NodeContainer nodes;
+  nodes.Create (1);
+  Ptr<LearnNetDevice> sender = learn.Materialize (channel, 0, nodes.Get (0));
+  double gains[] = {-20, 12, -20};
+  sender->SetAntenna (Create<LearnAntennaPattern> (3, 1, std::vector<double> (gains, gains + 3)));
+
+  sender->Send (Create<Packet> (100), sender->GetBroadcast (), 0x0800);
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (channel->GetRxCount (1), 1, "Receiver on the beam missed the packet");
+  NS_TEST_ASSERT_MSG_EQ (channel->GetRxCount (2), 0, "Receiver behind the beam got the packet");
+
+  sender->SetOrientation (180, 0);
+  sender->Send (Create<Packet> (100), sender->GetBroadcast (), 0x0800);
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (channel->GetRxCount (1), 1, "Receiver behind the turned beam got the packet");
+  NS_TEST_ASSERT_MSG_EQ (channel->GetRxCount (2), 1, "Receiver on the turned beam missed the packet");
+  Simulator::Destroy ();
+}
+
+//
+// A wall between the sender and one receiver blocks that link only, until
+// the receiver moves out of its shadow.
+//
+class LearnObstacleTestCase : public TestCase
+{
+public:
+  LearnObstacleTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LearnObstacleTestCase::LearnObstacleTestCase ()
+  : TestCase ("Obstacles block the links that cross them")
+{
+}
+
+void
+LearnObstacleTestCase::DoRun (void)
+{
+  LearnHelper learn;
+  learn.AddPosition (0, 0);
+  learn.AddPosition (50, 0);
+  learn.AddPosition (0, 50);
+  Ptr<LearnChannel> channel = learn.InstallCompact (3);
+  NodeContainer nodes;
+  nodes.Create (2);
+  Ptr<LearnNetDevice> sender = learn.Materialize (channel, 0, nodes.Get (0));
+  Ptr<LearnNetDevice> shadowed = learn.Materialize (channel, 1, nodes.Get (1));
+  Ptr<LearnObstacleMap> obstacles = Create<LearnObstacleMap> ();
+  LearnObstacleMap::Footprint wall;
+  wall.push_back (std::make_pair (20.0, -10.0));
+  wall.push_back (std::make_pair (30.0, -10.0));
+  wall.push_back (std::make_pair (30.0, 10.0));
+  wall.push_back (std::make_pair (20.0, 10.0));
+  obstacles->AddObstacle (wall, 10);
+  channel->SetObstacles (obstacles);
+
+  NS_TEST_ASSERT_MSG_EQ (channel->IsLineOfSight (0, 1), false, "Link through the wall is line of sight");
+  NS_TEST_ASSERT_MSG_EQ (channel->IsLineOfSight (0, 2), true, "Clear link is blocked");
+  sender->Send (Create<Packet> (100), sender->GetBroadcast (), 0x0800);
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (channel->GetRxCount (2), 1, "Receiver in sight missed the packet");
+
+  shadowed->SetZ (30);
+  NS_TEST_ASSERT_MSG_EQ (channel->IsLineOfSight (0, 1), false, "Link over the wall half way up is line of sight");
+  shadowed->SetXY (50, 50);
+  NS_TEST_ASSERT_MSG_EQ (channel->IsLineOfSight (0, 1), true, "Moved receiver still shadowed");
+  Simulator::Destroy ();
+}
+
+//
+// With a log distance loss model only the receiver above the sensitivity
+// hears the packet, and the memoized power follows the receiver's moves.
+//
+class LearnPropagationTestCase : public TestCase
+{
+public:
+  LearnPropagationTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LearnPropagationTestCase::LearnPropagationTestCase ()
+  : TestCase ("Propagation loss models decide who hears a packet")
+{
+}
+
+void
+LearnPropagationTestCase::DoRun (void)
+{
+  LearnHelper learn;
+  learn.SetChannelAttribute ("PropagationLossModel", PointerValue (CreateObject<LogDistancePropagationLossModel> ()));
+  learn.SetChannelAttribute ("PropagationDelayModel",
+                             PointerValue (CreateObject<ConstantSpeedPropagationDelayModel> ()));
+  learn.AddPosition (0, 0);
+  learn.AddPosition (100, 0);
+  learn.AddPosition (500, 0);
+  Ptr<LearnChannel> channel = learn.InstallCompact (3);
+  NodeContainer nodes;
+  nodes.Create (2);
+  Ptr<LearnNetDevice> sender = learn.Materialize (channel, 0, nodes.Get (0));
+  Ptr<LearnNetDevice> near = learn.Materialize (channel, 1, nodes.Get (1));
+
+  sender->Send (Create<Packet> (100), sender->GetBroadcast (), 0x0800);
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (channel->GetRxCount (2), 0, "Receiver below the sensitivity got the packet");
+
+  double before = channel->GetRxPower (0, 1);
+  near->SetXY (200, 0);
+  NS_TEST_ASSERT_MSG_EQ_TOL (before - channel->GetRxPower (0, 1), 30 * std::log10 (2.0), 1e-9,
+                             "Memoized power did not follow the move");
+  Simulator::Destroy ();
+}
+
+/////////////////////////////////////////////////////////////
+
+class LearnSlottedTestCase : public TestCase
+{
+public:
+  LearnSlottedTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LearnSlottedTestCase::LearnSlottedTestCase ()
+  : TestCase ("Slotted mode spends one event per slot and receiving node")
+{
+}
+
+void
+LearnSlottedTestCase::DoRun (void)
+{
+  const uint32_t nDevices = 10;
+  const uint32_t nPackets = 5;
+  LearnHelper learn;
+  learn.SetDeviceAttribute ("DataRate", StringValue ("8Mbps"));
+  learn.SetChannelAttribute ("DelayFac", TimeValue (MicroSeconds (1)));
+  learn.SetChannelAttribute ("SlotTime", TimeValue (MilliSeconds (1)));
+  learn.SetChannelAttribute ("GrantsPerSlot", UintegerValue (nDevices));
+  for (uint32_t i = 0; i < nDevices; ++i)
+    {
+      learn.AddPosition (i, 0);
+    }
+  NodeContainer nodes;
+  nodes.Create (nDevices);
+  NetDeviceContainer devices = learn.Install (nodes);
+  Ptr<LearnChannel> channel = devices.Get (0)->GetChannel ()->GetObject<LearnChannel> ();
+  LearnReceiveRecorder recorder;
+  recorder.Connect (devices);
+
+  for (uint32_t i = 0; i < nDevices; ++i)
+    {
+      for (uint32_t k = 0; k < nPackets; ++k)
+        {
+          devices.Get (i)->Send (Create<Packet> (100), devices.Get (i)->GetBroadcast (), 0x0800);
+        }
+    }
+  uint64_t events = Simulator::GetEventCount ();
+  Simulator::Run ();
+  events = Simulator::GetEventCount () - events;
+
+  // Every device sends once per slot, the last slot only delivers. Each
+  // slot but the first delivers to every node in one event per node, not
+  // one per packet.
+  NS_TEST_ASSERT_MSG_EQ (channel->GetNSlots (), nPackets + 1, "Wrong number of slots");
+  NS_TEST_ASSERT_MSG_EQ (events, channel->GetNSlots () + nPackets * nDevices, "Events do not follow the slots");
+  NS_TEST_ASSERT_MSG_EQ (recorder.m_receptions.size (), nDevices * nPackets * (nDevices - 1),
+                         "Wrong number of receptions");
+  for (std::size_t k = 0; k < recorder.m_receptions.size (); ++k)
+    {
+      int64_t ms = recorder.m_receptions[k].time.GetMilliSeconds ();
+      NS_TEST_ASSERT_MSG_EQ (recorder.m_receptions[k].time, MilliSeconds (ms), "Reception between two slots");
+      NS_TEST_ASSERT_MSG_GT (ms, 0, "Reception in the slot of its transmission");
+    }
+  Simulator::Destroy ();
+}
+
+/////////////////////////////////////////////////////////////
+
+class LearnFanOutTestCase : public TestCase
+{
+public:
+  LearnFanOutTestCase ();
+
+private:
+  virtual void DoRun (void);
+  //reception times of one broadcast from device 0 among raised devices
+  std::vector<Time> Broadcast (bool specialized);
+};
+
+LearnFanOutTestCase::LearnFanOutTestCase ()
+  : TestCase ("The specialized fan-out delivers like the generic one")
+{
+}
+
+std::vector<Time>
+LearnFanOutTestCase::Broadcast (bool specialized)
+{
+  std::vector<double> xs;
+  std::vector<double> ys;
+  for (uint32_t i = 0; i < 5; ++i)
+    {
+      xs.push_back (10 * i);
+      ys.push_back (i % 2);
+    }
+  NodeContainer nodes;
+  LearnHelper learn;
+  learn.SetDeviceAttribute ("DataRate", StringValue ("8Mbps"));
+  learn.SetChannelAttribute ("DelayFac", TimeValue (MicroSeconds (1)));
+  learn.SetChannelAttribute ("MaxRange", DoubleValue (35));
+  learn.SetChannelAttribute ("SpecializedFanOut", BooleanValue (specialized));
+  for (std::size_t i = 0; i < xs.size (); ++i)
+    {
+      learn.AddPosition (xs[i], ys[i]);
+    }
+  nodes.Create (xs.size ());
+  NetDeviceContainer devices = learn.Install (nodes);
+  devices.Get (2)->GetObject<LearnNetDevice> ()->SetZ (30);
+  LearnReceiveRecorder recorder;
+  recorder.Connect (devices);
+
+  devices.Get (0)->Send (Create<Packet> (1000), devices.Get (0)->GetBroadcast (), 0x0800);
+  Simulator::Run ();
+  std::vector<Time> times;
+  for (std::size_t k = 0; k < recorder.m_receptions.size (); ++k)
+    {
+      times.push_back (recorder.m_receptions[k].time);
+    }
+  Simulator::Destroy ();
+  return times;
+}
+
+void
+LearnFanOutTestCase::DoRun (void)
+{
+  std::vector<Time> specialized = Broadcast (true);
+  std::vector<Time> generic = Broadcast (false);
+  NS_TEST_ASSERT_MSG_EQ (specialized.size (), 2, "Range or height ignored");
+  NS_TEST_ASSERT_MSG_EQ (generic.size (), specialized.size (), "Fan-outs reach different receivers");
+  for (std::size_t k = 0; k < generic.size (); ++k)
+    {
+      NS_TEST_ASSERT_MSG_EQ (specialized[k], generic[k], "Fan-outs deliver at different times");
+    }
+}
+
+/////////////////////////////////////////////////////////////
+
+class LearnMobilityTraceTestCase : public TestCase
+{
+public:
+  LearnMobilityTraceTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LearnMobilityTraceTestCase::LearnMobilityTraceTestCase ()
+  : TestCase ("A mobility trace moves devices between its waypoints")
+{
+}
+
+void
+LearnMobilityTraceTestCase::DoRun (void)
+{
+  std::string csv = CreateTempDirFilename ("mobility.csv");
+  std::string trace = CreateTempDirFilename ("mobility.bin");
+  std::ofstream os (csv.c_str ());
+  os << "# time,node,x,y" << std::endl;
+  os << "2,0,10,0" << std::endl;
+  os << "0,0,0,0" << std::endl;
+  os << "0,1,3,4" << std::endl;
+  os.close ();
+  LearnMobilityTrace::ConvertCsv (csv, trace);
+
+  std::vector<double> xs (2, 0);
+  std::vector<double> ys (2, 0);
+  NodeContainer nodes;
+  NetDeviceContainer devices = CreateDevices (nodes, xs, ys);
+  Ptr<LearnMobilityTracePlayer> player = CreateObject<LearnMobilityTracePlayer> ();
+  player->SetAttribute ("Interval", TimeValue (MilliSeconds (500)));
+  player->SetTrace (Create<LearnMobilityTrace> (trace));
+  player->Add (devices);
+  player->Start ();
+  Simulator::Stop (MilliSeconds (1200));
+  Simulator::Run ();
+
+  Ptr<LearnChannel> channel = devices.Get (0)->GetChannel ()->GetObject<LearnChannel> ();
+  NS_TEST_ASSERT_MSG_EQ_TOL (channel->GetX (0), 5, 1e-9, "Not halfway at 1 s");
+  NS_TEST_ASSERT_MSG_EQ_TOL (channel->GetDist (0, 1), std::sqrt (20.0), 1e-9, "Parked device not placed");
+  // The parked device moves once, the other at 0.5 s and 1 s.
+  NS_TEST_ASSERT_MSG_EQ (player->GetNMoves (), 3, "Devices that did not move were notified");
+  player->Dispose ();
+  Simulator::Destroy ();
+}
+
+/////////////////////////////////////////////////////////////
+
+class LearnMulticastTestCase : public TestCase
+{
+public:
+  LearnMulticastTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LearnMulticastTestCase::LearnMulticastTestCase ()
+  : TestCase ("Multicast frames reach the members of their group only")
+{
+}
+
+void
+LearnMulticastTestCase::DoRun (void)
+{
+  const uint32_t nDevices = 5;
+  std::vector<double> xs;
+  std::vector<double> ys;
+  for (uint32_t i = 0; i < nDevices; ++i)
+    {
+      xs.push_back (i);
+      ys.push_back (0);
+    }
+  NodeContainer nodes;
+  NetDeviceContainer devices = CreateDevices (nodes, xs, ys);
+  Ptr<LearnChannel> channel = devices.Get (0)->GetChannel ()->GetObject<LearnChannel> ();
+  LearnReceiveRecorder recorder;
+  recorder.Connect (devices);
+
+  Mac48Address group = Mac48Address::ConvertFrom (devices.Get (0)->GetMulticast (Ipv4Address ("239.1.2.3")));
+  NS_TEST_ASSERT_MSG_EQ (group.IsGroup (), true, "Not a group address");
+  devices.Get (1)->GetObject<LearnNetDevice> ()->JoinGroup (group);
+  devices.Get (3)->GetObject<LearnNetDevice> ()->JoinGroup (group);
+  devices.Get (3)->GetObject<LearnNetDevice> ()->JoinGroup (group);
+  NS_TEST_ASSERT_MSG_EQ (channel->GetNGroupMembers (group), 2, "Joining twice counts twice");
+
+  devices.Get (0)->Send (Create<Packet> (100), group, 0x0800);
+  uint64_t events = Simulator::GetEventCount ();
+  Simulator::Run ();
+  events = Simulator::GetEventCount () - events;
+  NS_TEST_ASSERT_MSG_EQ (recorder.m_receptions.size (), 2, "Wrong number of receptions");
+  NS_TEST_ASSERT_MSG_EQ (events, 3, "Not one event per member plus one");
+  for (std::size_t k = 0; k < recorder.m_receptions.size (); ++k)
+    {
+      Ptr<NetDevice> device = recorder.m_receptions[k].device;
+      NS_TEST_ASSERT_MSG_EQ ((device == devices.Get (1) || device == devices.Get (3)), true, "A non member received");
+    }
+
+  recorder.m_receptions.clear ();
+  devices.Get (3)->GetObject<LearnNetDevice> ()->LeaveGroup (group);
+  devices.Get (1)->GetObject<LearnNetDevice> ()->LeaveGroup (group);
+  NS_TEST_ASSERT_MSG_EQ (channel->GetNGroupMembers (group), 0, "Members left behind");
+  devices.Get (0)->Send (Create<Packet> (100), group, 0x0800);
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (recorder.m_receptions.size (), 0, "A group without members was heard");
+  Simulator::Destroy ();
+}
+
+/////////////////////////////////////////////////////////////
+
+class LearnSendBatchTestCase : public TestCase
+{
+public:
+  LearnSendBatchTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
 
-// An essential include is test.h
-#include "ns3/test.h"
+LearnSendBatchTestCase::LearnSendBatchTestCase ()
+  : TestCase ("A batch is delivered like the same packets sent one by one")
+{
+}
 
-// Do not put your test classes in namespace ns3.  You may find it useful
-// to use the using directive to access the ns3 namespace directly
-using namespace ns3;
+void
+LearnSendBatchTestCase::DoRun (void)
+{
+  const uint32_t nDevices = 10;
+  const uint32_t nPackets = 5;
+  std::vector<double> xs;
+  std::vector<double> ys;
+  for (uint32_t i = 0; i < nDevices; ++i)
+    {
+      xs.push_back (i);
+      ys.push_back (0);
+    }
+  NodeContainer nodes;
+  NetDeviceContainer devices = CreateDevices (nodes, xs, ys);
+  LearnReceiveRecorder recorder;
+  recorder.Connect (devices);
+
+  std::vector<Ptr<Packet> > batch;
+  for (uint32_t k = 0; k < nPackets; ++k)
+    {
+      batch.push_back (Create<Packet> (100));
+    }
+  Ptr<LearnNetDevice> sender = devices.Get (0)->GetObject<LearnNetDevice> ();
+  NS_TEST_ASSERT_MSG_EQ (sender->SendBatch (batch, sender->GetBroadcast (), 0x0800), nPackets, "Packets refused");
+  uint64_t events = Simulator::GetEventCount ();
+  Simulator::Run ();
+  events = Simulator::GetEventCount () - events;
+
+  NS_TEST_ASSERT_MSG_EQ (events, nPackets * nDevices, "Events per transmission changed");
+  NS_TEST_ASSERT_MSG_EQ (recorder.m_receptions.size (), nPackets * (nDevices - 1), "Wrong number of receptions");
+  for (std::size_t k = 0; k < recorder.m_receptions.size (); ++k)
+    {
+      NS_TEST_ASSERT_MSG_EQ (recorder.m_receptions[k].protocol, 0x0800, "Wrong protocol");
+      NS_TEST_ASSERT_MSG_EQ (recorder.m_receptions[k].from, sender->GetAddress (), "Wrong source address");
+    }
+  Simulator::Destroy ();
+}
+
+/////////////////////////////////////////////////////////////
+
+//
+// An event of another module, logged among the receptions with no device.
+//
+static void
+RecordMarker (LearnReceiveRecorder *recorder)
+{
+  LearnReceiveRecorder::Reception r;
+  r.protocol = 0;
+  r.time = Simulator::Now ();
+  recorder->m_receptions.push_back (r);
+}
+
+//
+// Every reception schedules a marker 7 us later, when other receptions are
+// due, so that the markers land between receptions of equal time.
+//
+static void
+ScheduleMarker (LearnReceiveRecorder *recorder, Ptr<const Packet> packet)
+{
+  Simulator::Schedule (MicroSeconds (7), &RecordMarker, recorder);
+}
+
+class LearnTimingWheelTestCase : public TestCase
+{
+public:
+  LearnTimingWheelTestCase ();
+
+private:
+  virtual void DoRun (void);
+  //receptions and markers of nDevices sending nPackets each, with or without the arrival wheel, as time and
+  //receiver's node, nDevices for a marker
+  std::vector<std::pair<Time, uint32_t> > Run (bool wheel, uint32_t nDevices, uint32_t nPackets);
+};
+
+LearnTimingWheelTestCase::LearnTimingWheelTestCase ()
+  : TestCase ("The arrival wheel delivers in the simulator's order")
+{
+}
+
+std::vector<std::pair<Time, uint32_t> >
+LearnTimingWheelTestCase::Run (bool wheel, uint32_t nDevices, uint32_t nPackets)
+{
+  LearnHelper learn;
+  learn.SetDeviceAttribute ("DataRate", StringValue ("8Mbps"));
+  learn.SetChannelAttribute ("DelayFac", TimeValue (MicroSeconds (1)));
+  learn.SetChannelAttribute ("ArrivalWheel", BooleanValue (wheel));
+  for (uint32_t i = 0; i < nDevices; ++i)
+    {
+      learn.AddPosition (7 * (i % 4), 300 * (i / 4));
+    }
+  NodeContainer nodes;
+  nodes.Create (nDevices);
+  NetDeviceContainer devices = learn.Install (nodes);
+  LearnReceiveRecorder recorder;
+  recorder.Connect (devices);
+  for (uint32_t i = 0; i < nDevices; ++i)
+    {
+      devices.Get (i)->TraceConnectWithoutContext ("MacRx", MakeBoundCallback (&ScheduleMarker, &recorder));
+      for (uint32_t k = 0; k < nPackets; ++k)
+        {
+          Simulator::Schedule (MicroSeconds (37 * k + 5 * i), &NetDevice::Send, devices.Get (i),
+                               Create<Packet> (10 + 100 * ((i + k) % 3)), devices.Get (i)->GetBroadcast (), 0x0800);
+        }
+    }
+  Simulator::Run ();
+  std::vector<std::pair<Time, uint32_t> > receptions;
+  for (std::size_t k = 0; k < recorder.m_receptions.size (); ++k)
+    {
+      Ptr<NetDevice> device = recorder.m_receptions[k].device;
+      receptions.push_back (std::make_pair (recorder.m_receptions[k].time,
+                                            device == 0 ? nDevices : device->GetNode ()->GetId () % nDevices));
+    }
+  Simulator::Destroy ();
+  return receptions;
+}
+
+void
+LearnTimingWheelTestCase::DoRun (void)
+{
+  //
+  // The wheel alone: arrivals near and far, past the overflow, come out by
+  // time then insertion order.
+  //
+  LearnTimingWheel wheel (1000);
+  std::vector<std::pair<int64_t, uint64_t> > expected;
+  int64_t now = 0;
+  uint64_t seq = 0;
+  for (uint32_t k = 0; k < 5000; ++k)
+    {
+      if (k % 3 == 2)
+        {
+          LearnArrival arrival;
+          wheel.Pop (arrival);
+          std::vector<std::pair<int64_t, uint64_t> >::iterator first =
+            std::min_element (expected.begin (), expected.end ());
+          NS_TEST_ASSERT_MSG_EQ (arrival.time, first->first, "Arrival out of time order");
+          NS_TEST_ASSERT_MSG_EQ (arrival.seq, first->second, "Arrivals of equal time out of order");
+          now = arrival.time;
+          expected.erase (first);
+          continue;
+        }
+      int64_t delays[] = {0, 999, 1000, 123456, 300000000, int64_t (1) << 45};
+      LearnArrival arrival;
+      arrival.time = now + delays[(k * 7) % 6] + k % 5;
+      arrival.dst = 0;
+      arrival.src = 0;
+      arrival.context = 0;
+      wheel.Insert (arrival);
+      expected.push_back (std::make_pair (arrival.time, seq++));
+    }
+  NS_TEST_ASSERT_MSG_EQ (wheel.GetSize (), expected.size (), "Arrivals lost");
+
+  //
+  // On a channel: the same receptions at the same times in the same order,
+  // also relative to the markers scheduled between them.
+  //
+  std::vector<std::pair<Time, uint32_t> > events = Run (false, 8, 20);
+  std::vector<std::pair<Time, uint32_t> > wheeled = Run (true, 8, 20);
+  NS_TEST_ASSERT_MSG_EQ (wheeled.size (), events.size (), "Wrong number of receptions");
+  for (std::size_t k = 0; k < events.size (); ++k)
+    {
+      NS_TEST_ASSERT_MSG_EQ (wheeled[k].first, events[k].first, "Reception at another time at " << k);
+      NS_TEST_ASSERT_MSG_EQ (wheeled[k].second, events[k].second, "Wrong receiver or order at " << k);
+    }
+}
+
+/////////////////////////////////////////////////////////////
+
+class LearnCheckpointTestCase : public TestCase
+{
+public:
+  LearnCheckpointTestCase ();
+
+private:
+  virtual void DoRun (void);
+  //four relaying devices 100 m apart with a range of 150 m
+  NetDeviceContainer Install (NodeContainer &nodes);
+  //receptions from first on, as "time receiver protocol from size" sorted, times taken from start
+  std::vector<std::string> Describe (const LearnReceiveRecorder &recorder, NetDeviceContainer devices,
+                                     std::size_t first, Time start);
+};
+
+LearnCheckpointTestCase::LearnCheckpointTestCase ()
+  : TestCase ("A restored checkpoint makes the same receptions as the run it was taken from")
+{
+}
+
+NetDeviceContainer
+LearnCheckpointTestCase::Install (NodeContainer &nodes)
+{
+  LearnHelper learn;
+  learn.SetDeviceAttribute ("DataRate", StringValue ("8Mbps"));
+  learn.SetDeviceAttribute ("L2Forwarding", BooleanValue (true));
+  learn.SetDeviceAttribute ("LatencyStats", EnumValue (LearnNetDevice::STATS_DEVICE));
+  learn.SetChannelAttribute ("DelayFac", TimeValue (MicroSeconds (1)));
+  learn.SetChannelAttribute ("MaxRange", DoubleValue (150));
+  learn.SetChannelAttribute ("TrackInFlight", BooleanValue (true));
+  for (uint32_t i = 0; i < 4; ++i)
+    {
+      learn.AddPosition (100 * i, 0);
+    }
+  nodes.Create (4);
+  return learn.Install (nodes);
+}
+
+std::vector<std::string>
+LearnCheckpointTestCase::Describe (const LearnReceiveRecorder &recorder, NetDeviceContainer devices,
+                                   std::size_t first, Time start)
+{
+  std::vector<std::string> receptions;
+  for (std::size_t k = first; k < recorder.m_receptions.size (); ++k)
+    {
+      const LearnReceiveRecorder::Reception &r = recorder.m_receptions[k];
+      uint32_t receiver = 0;
+      while (devices.Get (receiver) != r.device)
+        {
+          ++receiver;
+        }
+      std::ostringstream os;
+      os << (r.time - start).GetTimeStep () << " " << receiver << " " << r.protocol << " "
+         << Mac48Address::ConvertFrom (r.from) << " " << r.packet->GetSize ();
+      receptions.push_back (os.str ());
+    }
+  std::sort (receptions.begin (), receptions.end ());
+  return receptions;
+}
+
+void
+LearnCheckpointTestCase::DoRun (void)
+{
+  //
+  // At 2.05 ms the first device sends its third frame with the fourth
+  // queued, the second relays the first one, the second frame is on its way
+  // to the relay and a broadcast is on its way from the last device.
+  //
+  const Time checkpointTime = MicroSeconds (2050);
+  NodeContainer nodes;
+  NetDeviceContainer devices = Install (nodes);
+  Ptr<LearnChannel> channel = devices.Get (0)->GetChannel ()->GetObject<LearnChannel> ();
+  LearnReceiveRecorder recorder;
+  recorder.Connect (devices);
+  for (uint32_t k = 0; k < 4; ++k)
+    {
+      devices.Get (0)->Send (Create<Packet> (1000), devices.Get (3)->GetAddress (), 0x86dd);
+    }
+  Simulator::Schedule (MicroSeconds (1500), &NetDevice::Send, devices.Get (3), Create<Packet> (500),
+                       devices.Get (3)->GetBroadcast (), 0x0806);
+  Simulator::Stop (checkpointTime);
+  Simulator::Run ();
+  std::stringstream checkpoint;
+  channel->SaveCheckpoint (checkpoint);
+  std::vector<Time> busy;
+  for (std::size_t i = 0; i < channel->GetNDevices (); ++i)
+    {
+      busy.push_back (Max (channel->GetBusyUntil (i) - checkpointTime, Seconds (0)));
+    }
+  std::size_t before = recorder.m_receptions.size ();
+  Simulator::Run ();
+  std::vector<std::string> expected = Describe (recorder, devices, before, checkpointTime);
+  const LearnHistogram &expectedLatency =
+    devices.Get (3)->GetObject<LearnNetDevice> ()->GetLatencyStats ().total;
+  uint64_t expectedCount = expectedLatency.GetCount ();
+  Time expectedMean = expectedLatency.GetMean ();
+  std::vector<Address> addresses;
+  for (uint32_t i = 0; i < devices.GetN (); ++i)
+    {
+      addresses.push_back (devices.Get (i)->GetAddress ());
+    }
+  Simulator::Destroy ();
+
+  NodeContainer restoredNodes;
+  NetDeviceContainer restored = Install (restoredNodes);
+  for (uint32_t i = 0; i < restored.GetN (); ++i)
+    {
+      restored.Get (i)->SetAddress (addresses[i]);
+    }
+  LearnReceiveRecorder restoredRecorder;
+  restoredRecorder.Connect (restored);
+  Ptr<LearnChannel> restoredChannel = restored.Get (0)->GetChannel ()->GetObject<LearnChannel> ();
+  restoredChannel->RestoreCheckpoint (checkpoint);
+  for (std::size_t i = 0; i < busy.size (); ++i)
+    {
+      NS_TEST_ASSERT_MSG_EQ (restoredChannel->GetBusyUntil (i), busy[i], "Carrier sense not restored relative to now");
+    }
+  Simulator::Run ();
+  std::vector<std::string> actual = Describe (restoredRecorder, restored, 0, Seconds (0));
+
+  std::ostringstream relayed;
+  relayed << " 3 " << 0x86dd << " " << Mac48Address::ConvertFrom (addresses[0]) << " 1000";
+  uint32_t nRelayed = 0;
+  for (std::size_t k = 0; k < expected.size (); ++k)
+    {
+      nRelayed += expected[k].find (relayed.str ()) != std::string::npos;
+    }
+  NS_TEST_ASSERT_MSG_EQ (nRelayed, 4, "Scenario does not relay every frame end to end");
+  NS_TEST_ASSERT_MSG_EQ (actual.size (), expected.size (), "Wrong number of receptions after restore");
+  for (std::size_t k = 0; k < std::min (actual.size (), expected.size ()); ++k)
+    {
+      NS_TEST_ASSERT_MSG_EQ (actual[k], expected[k], "Reception differs after restore");
+    }
+  const LearnHistogram &latency = restored.Get (3)->GetObject<LearnNetDevice> ()->GetLatencyStats ().total;
+  NS_TEST_ASSERT_MSG_EQ (latency.GetCount (), expectedCount, "Time stamps lost");
+  NS_TEST_ASSERT_MSG_EQ (latency.GetMean (), expectedMean, "Time stamps not restored relative to now");
+  Simulator::Destroy ();
+}
+
+/////////////////////////////////////////////////////////////
+
+class LearnLinkLossTestCase : public TestCase
+{
+public:
+  LearnLinkLossTestCase ();
+
+private:
+  virtual void DoRun (void);
+  //times the third device hears the first one over a link of loss 0.5, with the second sending in between or not
+  std::vector<Time> Run (bool otherSender);
+};
+
+LearnLinkLossTestCase::LearnLinkLossTestCase ()
+  : TestCase ("Lossy links drop their share of packets, other senders draw no random numbers")
+{
+}
+
+std::vector<Time>
+LearnLinkLossTestCase::Run (bool otherSender)
+{
+  const uint32_t nPackets = 100;
+  std::vector<double> xs;
+  std::vector<double> ys (3, 0);
+  xs.push_back (0);
+  xs.push_back (10);
+  xs.push_back (20);
+  NodeContainer nodes;
+  NetDeviceContainer devices = CreateDevices (nodes, xs, ys);
+  Ptr<LearnChannel> channel = devices.Get (0)->GetChannel ()->GetObject<LearnChannel> ();
+  channel->SetLinkLoss (0, 1, 1.0);
+  channel->SetLinkLoss (0, 2, 0.5);
+  channel->AssignStreams (1);
+  uint32_t losses = 0;
+  channel->TraceConnectWithoutContext ("LinkLoss", MakeBoundCallback (&CountLinkLoss, &losses));
+  LearnReceiveRecorder recorder;
+  recorder.Connect (devices);
+  for (uint32_t k = 0; k < nPackets; ++k)
+    {
+      Simulator::Schedule (MicroSeconds (500 * k), &NetDevice::Send, devices.Get (0), Create<Packet> (100),
+                           devices.Get (0)->GetBroadcast (), 0x0800);
+      if (otherSender)
+        {
+          Simulator::Schedule (MicroSeconds (500 * k + 200), &NetDevice::Send, devices.Get (1), Create<Packet> (100),
+                               devices.Get (1)->GetBroadcast (), 0x0800);
+        }
+    }
+  Simulator::Run ();
+
+  std::vector<Time> heard;
+  uint32_t fromOther = 0;
+  for (std::size_t k = 0; k < recorder.m_receptions.size (); ++k)
+    {
+      const LearnReceiveRecorder::Reception &r = recorder.m_receptions[k];
+      if (r.from == devices.Get (0)->GetAddress ())
+        {
+          NS_TEST_EXPECT_MSG_EQ (r.device, devices.Get (2), "A packet crossed a link of loss 1");
+          heard.push_back (r.time);
+        }
+      else
+        {
+          ++fromOther;
+        }
+    }
+  NS_TEST_EXPECT_MSG_EQ (fromOther, otherSender ? 2 * nPackets : 0, "A link without loss lost packets");
+  NS_TEST_EXPECT_MSG_EQ (losses, 2 * nPackets - heard.size (), "LinkLoss trace missed losses");
+  NS_TEST_EXPECT_MSG_EQ (channel->GetLinkLoss (1, 0), 0.0, "Loss set on the reverse link");
+
+  //
+  // A loss of 0 removes the entry and the link delivers again.
+  //
+  channel->SetLinkLoss (0, 1, 0.0);
+  NS_TEST_EXPECT_MSG_EQ (channel->GetLinkLoss (0, 1), 0.0, "Loss entry not removed");
+  std::size_t before = recorder.m_receptions.size ();
+  devices.Get (0)->Send (Create<Packet> (100), devices.Get (0)->GetBroadcast (), 0x0800);
+  Simulator::Run ();
+  bool reached = false;
+  for (std::size_t k = before; k < recorder.m_receptions.size (); ++k)
+    {
+      reached = reached || recorder.m_receptions[k].device == devices.Get (1);
+    }
+  NS_TEST_EXPECT_MSG_EQ (reached, true, "Removed loss still drops packets");
+  Simulator::Destroy ();
+  return heard;
+}
+
+void
+LearnLinkLossTestCase::DoRun (void)
+{
+  std::vector<Time> alone = Run (false);
+  std::vector<Time> shared = Run (true);
+  NS_TEST_ASSERT_MSG_GT (alone.size (), 30, "Link of loss 0.5 lost too many packets");
+  NS_TEST_ASSERT_MSG_LT (alone.size (), 70, "Link of loss 0.5 lost too few packets");
+  //
+  // The second device has no lossy link, so its packets leave the loss
+  // stream alone and the first device's losses are the same.
+  //
+  NS_TEST_ASSERT_MSG_EQ (shared.size (), alone.size (), "A sender without lossy links drew random numbers");
+  for (std::size_t k = 0; k < std::min (alone.size (), shared.size ()); ++k)
+    {
+      NS_TEST_ASSERT_MSG_EQ (shared[k], alone[k], "A sender without lossy links drew random numbers");
+    }
+}
+
+/////////////////////////////////////////////////////////////
+
+class LearnRadioStateTestCase : public TestCase
+{
+public:
+  LearnRadioStateTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LearnRadioStateTestCase::LearnRadioStateTestCase ()
+  : TestCase ("Sleeping and transmitting devices receive nothing, time per radio state adds up")
+{
+}
+
+void
+LearnRadioStateTestCase::DoRun (void)
+{
+  std::vector<double> xs;
+  std::vector<double> ys (3, 0);
+  xs.push_back (0);
+  xs.push_back (10);
+  xs.push_back (20);
+  NodeContainer nodes;
+  NetDeviceContainer devices = CreateDevices (nodes, xs, ys);
+  Ptr<LearnChannel> channel = devices.Get (0)->GetChannel ()->GetObject<LearnChannel> ();
+  Ptr<LearnNetDevice> sender = devices.Get (0)->GetObject<LearnNetDevice> ();
+  Ptr<LearnNetDevice> sleeper = devices.Get (1)->GetObject<LearnNetDevice> ();
+  Ptr<LearnNetDevice> other = devices.Get (2)->GetObject<LearnNetDevice> ();
+  LearnReceiveRecorder recorder;
+  recorder.Connect (devices);
+
+  //
+  // The second device sleeps for the first broadcast and listens from 2 ms.
+  // At 5.5 ms the third device sends while the first is still sending.
+  //
+  sleeper->SetRadioState (LearnNetDevice::SLEEP);
+  NS_TEST_ASSERT_MSG_EQ (channel->GetNListeners (), 2, "Sleeping device still listening");
+  sender->Send (Create<Packet> (1000), sender->GetBroadcast (), 0x0800);
+  NS_TEST_ASSERT_MSG_EQ (sender->GetRadioState (), LearnNetDevice::TRANSMIT, "Sender not transmitting");
+  NS_TEST_ASSERT_MSG_EQ (channel->GetNListeners (), 1, "Transmitting device still listening");
+  Simulator::Schedule (MilliSeconds (2), &LearnNetDevice::SetRadioState, sleeper, LearnNetDevice::LISTEN);
+  Simulator::Schedule (MilliSeconds (5), &NetDevice::Send, sender, Create<Packet> (1000), sender->GetBroadcast (),
+                       0x0800);
+  Simulator::Schedule (MicroSeconds (5500), &NetDevice::Send, other, Create<Packet> (1000), other->GetBroadcast (),
+                       0x0800);
+  Simulator::Stop (MilliSeconds (10));
+  Simulator::Run ();
+
+  uint32_t bySender = 0;
+  uint32_t bySleeper = 0;
+  for (std::size_t k = 0; k < recorder.m_receptions.size (); ++k)
+    {
+      const LearnReceiveRecorder::Reception &r = recorder.m_receptions[k];
+      if (r.device == sleeper)
+        {
+          NS_TEST_ASSERT_MSG_GT (r.time, MilliSeconds (2), "Sleeping device received");
+          ++bySleeper;
+        }
+      bySender += r.device == sender;
+    }
+  NS_TEST_ASSERT_MSG_EQ (bySleeper, 2, "Listening device missed packets");
+  NS_TEST_ASSERT_MSG_EQ (bySender, 0, "Device received a frame that started while it was transmitting");
+
+  NS_TEST_ASSERT_MSG_EQ (sender->GetRadioStateTime (LearnNetDevice::TRANSMIT), MilliSeconds (2), "Wrong transmit time");
+  NS_TEST_ASSERT_MSG_EQ (sender->GetRadioStateTime (LearnNetDevice::LISTEN), MilliSeconds (8), "Wrong listen time");
+  NS_TEST_ASSERT_MSG_EQ (sleeper->GetRadioStateTime (LearnNetDevice::SLEEP), MilliSeconds (2), "Wrong sleep time");
+  NS_TEST_ASSERT_MSG_EQ (sleeper->GetRadioStateTime (LearnNetDevice::LISTEN), MilliSeconds (8), "Wrong listen time");
+  NS_TEST_ASSERT_MSG_EQ (other->GetRadioStateTime (LearnNetDevice::TRANSMIT), MilliSeconds (1), "Wrong transmit time");
+  NS_TEST_ASSERT_MSG_EQ (channel->GetNListeners (), 3, "Devices not listening again");
+  Simulator::Destroy ();
+}
+
+/////////////////////////////////////////////////////////////
+
+class LearnFluidTestCase : public TestCase
+{
+public:
+  LearnFluidTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LearnFluidTestCase::LearnFluidTestCase ()
+  : TestCase ("Fluid waits average to the Pollaczek-Khinchine wait and follow rate changes")
+{
+}
+
+void
+LearnFluidTestCase::DoRun (void)
+{
+  std::vector<double> xs (2, 0);
+  std::vector<double> ys (2, 0);
+  xs[1] = 10;
+  NodeContainer nodes;
+  NetDeviceContainer devices = CreateDevices (nodes, xs, ys);
+  Ptr<LearnChannel> channel = devices.Get (0)->GetChannel ()->GetObject<LearnChannel> ();
+  Ptr<LearnNetDevice> source = devices.Get (0)->GetObject<LearnNetDevice> ();
+  channel->AssignStreams (1);
+  NS_TEST_ASSERT_MSG_EQ (channel->DrawFluidWait (), Seconds (0), "Wait without background flows");
+
+  //
+  // 250 packets per second of 1 ms: load 0.25 and a mean wait of
+  // 250 * (1 ms)^2 / (2 * 0.75).
+  //
+  channel->AddFluidFlow (source, DataRate ("2Mbps"), 1000);
+  NS_TEST_ASSERT_MSG_EQ_TOL (channel->GetFluidLoad (), 0.25, 1e-12, "Wrong load");
+  double wait = 250 * 1e-6 / 1.5;
+  NS_TEST_ASSERT_MSG_EQ_TOL (channel->GetFluidWait ().GetSeconds (), wait, 1e-9, "Wrong mean wait");
+
+  //
+  // Draws are 0 when the medium is found free, with probability 0.75, and
+  // average to the mean wait.
+  //
+  const uint32_t nDraws = 20000;
+  double sum = 0;
+  uint32_t idle = 0;
+  for (uint32_t k = 0; k < nDraws; ++k)
+    {
+      Time t = channel->DrawFluidWait ();
+      NS_TEST_ASSERT_MSG_GT_OR_EQ (t, Seconds (0), "Negative wait");
+      sum += t.GetSeconds ();
+      idle += t.IsZero ();
+    }
+  NS_TEST_ASSERT_MSG_EQ_TOL (sum / nDraws, wait, 0.06 * wait, "Draws do not average to the mean wait");
+  NS_TEST_ASSERT_MSG_EQ_TOL (double (idle) / nDraws, 0.75, 0.02, "Medium not found free at 1 - load");
+
+  //
+  // At twice the rate the packets take half the airtime.
+  //
+  source->SetDataRate (DataRate ("16Mbps"));
+  NS_TEST_ASSERT_MSG_EQ_TOL (channel->GetFluidLoad (), 0.125, 1e-12, "Load does not follow the rate");
+  NS_TEST_ASSERT_MSG_EQ_TOL (channel->GetFluidWait ().GetSeconds (), 250 * 0.25e-6 / 1.75, 1e-9,
+                             "Wait does not follow the rate");
+  channel->ClearFluidFlows ();
+  NS_TEST_ASSERT_MSG_EQ (channel->GetFluidLoad (), 0.0, "Flows not cleared");
+  Simulator::Destroy ();
+}
+
+/////////////////////////////////////////////////////////////
+
+class LearnLatencyStatsTestCase : public TestCase
+{
+public:
+  LearnLatencyStatsTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
 
-// This is an example TestCase.
-class LearnTestCase1 : public TestCase
+LearnLatencyStatsTestCase::LearnLatencyStatsTestCase ()
+  : TestCase ("Latency statistics split queueing, airtime and propagation per device and link")
+{
+}
+
+void
+LearnLatencyStatsTestCase::DoRun (void)
+{
+  LearnHelper learn;
+  learn.SetDeviceAttribute ("DataRate", StringValue ("8Mbps"));
+  learn.SetDeviceAttribute ("LatencyStats", EnumValue (LearnNetDevice::STATS_LINK));
+  learn.SetChannelAttribute ("DelayFac", TimeValue (MicroSeconds (1)));
+  learn.AddPosition (0, 0);
+  learn.AddPosition (50, 0);
+  learn.AddPosition (100, 0);
+  NodeContainer nodes;
+  nodes.Create (3);
+  NetDeviceContainer devices = learn.Install (nodes);
+  Ptr<LearnNetDevice> receiver = devices.Get (2)->GetObject<LearnNetDevice> ();
+
+  //
+  // Two frames from the first device, the second queued behind the first,
+  // then one from the second device.
+  //
+  devices.Get (0)->Send (Create<Packet> (1000), receiver->GetAddress (), 0x0800);
+  devices.Get (0)->Send (Create<Packet> (1000), receiver->GetAddress (), 0x0800);
+  Simulator::Schedule (MilliSeconds (5), &NetDevice::Send, devices.Get (1), Create<Packet> (1000),
+                       receiver->GetAddress (), 0x0800);
+  Simulator::Run ();
+
+  const LearnLatencyStats &all = receiver->GetLatencyStats ();
+  NS_TEST_ASSERT_MSG_EQ (all.total.GetCount (), 3, "Packets not counted");
+  NS_TEST_ASSERT_MSG_EQ (all.total.GetMin (), MicroSeconds (1050), "Wrong shortest latency");
+  NS_TEST_ASSERT_MSG_EQ (all.total.GetMax (), MicroSeconds (2100), "Wrong longest latency");
+  NS_TEST_ASSERT_MSG_EQ (all.airtime.GetMean (), MilliSeconds (1), "Wrong airtime");
+  NS_TEST_ASSERT_MSG_EQ_TOL (all.total.GetPercentile (0.5).GetSeconds (), 1100e-6, 0.125 * 1100e-6,
+                             "Median outside of its bucket");
+
+  const LearnLatencyStats &far = receiver->GetLinkLatencyStats (0);
+  NS_TEST_ASSERT_MSG_EQ (far.total.GetCount (), 2, "Link statistics mixed up");
+  NS_TEST_ASSERT_MSG_EQ (far.total.GetMean (), MicroSeconds (1600), "Wrong mean latency");
+  NS_TEST_ASSERT_MSG_EQ (far.queueing.GetMin (), Seconds (0), "Wrong queueing of the first frame");
+  NS_TEST_ASSERT_MSG_EQ (far.queueing.GetMax (), MilliSeconds (1), "Wrong queueing of the second frame");
+  NS_TEST_ASSERT_MSG_EQ (far.propagation.GetMean (), MicroSeconds (100), "Wrong propagation");
+
+  const LearnLatencyStats &near = receiver->GetLinkLatencyStats (1);
+  NS_TEST_ASSERT_MSG_EQ (near.total.GetCount (), 1, "Link statistics mixed up");
+  NS_TEST_ASSERT_MSG_EQ (near.propagation.GetMean (), MicroSeconds (50), "Wrong propagation");
+  Simulator::Destroy ();
+}
+
+/////////////////////////////////////////////////////////////
+
+class LearnCarrierSenseTestCase : public TestCase
+{
+public:
+  LearnCarrierSenseTestCase ();
+
+private:
+  virtual void DoRun (void);
+  //start and end of every transmission of three devices sending at once, with carrier sense or not
+  void Run (bool carrierSense, std::vector<Time> &begins, std::vector<Time> &ends);
+};
+
+LearnCarrierSenseTestCase::LearnCarrierSenseTestCase ()
+  : TestCase ("Carrier sense defers transmissions until the medium is idle, then backs off")
+{
+}
+
+void
+LearnCarrierSenseTestCase::Run (bool carrierSense, std::vector<Time> &begins, std::vector<Time> &ends)
+{
+  LearnHelper learn;
+  learn.SetDeviceAttribute ("DataRate", StringValue ("8Mbps"));
+  learn.SetDeviceAttribute ("CarrierSense", BooleanValue (carrierSense));
+  learn.SetChannelAttribute ("DelayFac", TimeValue (MicroSeconds (1)));
+  for (uint32_t i = 0; i < 3; ++i)
+    {
+      learn.AddPosition (i, 0);
+    }
+  NodeContainer nodes;
+  nodes.Create (3);
+  NetDeviceContainer devices = learn.Install (nodes);
+  Ptr<LearnChannel> channel = devices.Get (0)->GetChannel ()->GetObject<LearnChannel> ();
+  for (uint32_t i = 0; i < 3; ++i)
+    {
+      devices.Get (i)->TraceConnectWithoutContext ("PhyTxBegin", MakeBoundCallback (&RecordTime, &begins));
+      devices.Get (i)->TraceConnectWithoutContext ("PhyTxEnd", MakeBoundCallback (&RecordTime, &ends));
+    }
+
+  //
+  // The first frame keeps the others busy until its end reaches them.
+  //
+  devices.Get (0)->Send (Create<Packet> (1000), devices.Get (0)->GetBroadcast (), 0x0800);
+  NS_TEST_EXPECT_MSG_EQ (channel->GetBusyUntil (1), MicroSeconds (1001), "Busy until the end of the signal");
+  NS_TEST_EXPECT_MSG_EQ (channel->GetBusyUntil (2), MicroSeconds (1002), "Busy until the end of the signal");
+  for (uint32_t i = 1; i < 3; ++i)
+    {
+      Simulator::Schedule (MicroSeconds (100), &NetDevice::Send, devices.Get (i), Create<Packet> (1000),
+                           devices.Get (i)->GetBroadcast (), 0x0800);
+    }
+  Simulator::Run ();
+  Simulator::Destroy ();
+}
+
+void
+LearnCarrierSenseTestCase::DoRun (void)
+{
+  std::vector<Time> begins;
+  std::vector<Time> ends;
+  Run (false, begins, ends);
+  NS_TEST_ASSERT_MSG_EQ (begins.size (), 3, "Transmissions lost");
+  NS_TEST_ASSERT_MSG_EQ (begins[1], MicroSeconds (100), "Sent at once without carrier sense");
+
+  begins.clear ();
+  ends.clear ();
+  Run (true, begins, ends);
+  NS_TEST_ASSERT_MSG_EQ (begins.size (), 3, "Transmissions lost");
+  NS_TEST_ASSERT_MSG_EQ (ends.size (), 3, "Transmissions lost");
+  //
+  // The deferred devices wait for the medium, then at most CwMin slots of
+  // 20 us, and never overlap: their propagation delay is shorter than a slot.
+  //
+  std::sort (begins.begin (), begins.end ());
+  std::sort (ends.begin (), ends.end ());
+  NS_TEST_ASSERT_MSG_GT_OR_EQ (begins[1], MicroSeconds (1001), "Sent while the medium was busy");
+  NS_TEST_ASSERT_MSG_LT_OR_EQ (begins[1], MicroSeconds (1002 + 15 * 20), "Backoff longer than the window");
+  for (std::size_t k = 1; k < begins.size (); ++k)
+    {
+      NS_TEST_ASSERT_MSG_GT_OR_EQ (begins[k], ends[k - 1], "Transmissions overlap");
+    }
+}
+
+/////////////////////////////////////////////////////////////
+
+//
+// Frames of 1000 bytes to the first tx queue, smaller ones to the second.
+//
+static std::size_t
+SelectBySize (Ptr<const Packet> packet)
+{
+  return packet->GetSize () < 1000 ? 1 : 0;
+}
+
+class LearnTxSchedulerTestCase : public TestCase
+{
+public:
+  LearnTxSchedulerTestCase ();
+
+private:
+  virtual void DoRun (void);
+  //sizes received, in order, of four frames queued in each of two tx queues
+  std::vector<uint32_t> Run (std::string scheduler);
+};
+
+LearnTxSchedulerTestCase::LearnTxSchedulerTestCase ()
+  : TestCase ("Strict priority drains the first tx queue first, deficit round robin alternates")
+{
+}
+
+std::vector<uint32_t>
+LearnTxSchedulerTestCase::Run (std::string scheduler)
+{
+  LearnHelper learn;
+  learn.SetDeviceAttribute ("DataRate", StringValue ("8Mbps"));
+  learn.SetDeviceAttribute ("TxScheduler", StringValue (scheduler));
+  learn.SetDeviceAttribute ("DrrQuantum", UintegerValue (1000));
+  learn.SetChannelAttribute ("DelayFac", TimeValue (MicroSeconds (1)));
+  learn.SetTxQueuesN (2);
+  learn.AddPosition (0, 0);
+  learn.AddPosition (10, 0);
+  NodeContainer nodes;
+  nodes.Create (2);
+  NetDeviceContainer devices = learn.Install (nodes);
+  Ptr<LearnNetDevice> sender = devices.Get (0)->GetObject<LearnNetDevice> ();
+  sender->SetQueueSelector (MakeCallback (&SelectBySize));
+  LearnReceiveRecorder recorder;
+  recorder.Connect (devices);
+  for (uint32_t k = 0; k < 4; ++k)
+    {
+      sender->Send (Create<Packet> (1000), sender->GetBroadcast (), 0x0800);
+    }
+  for (uint32_t k = 0; k < 4; ++k)
+    {
+      sender->Send (Create<Packet> (900), sender->GetBroadcast (), 0x0800);
+    }
+  Simulator::Run ();
+  std::vector<uint32_t> sizes;
+  for (std::size_t k = 0; k < recorder.m_receptions.size (); ++k)
+    {
+      sizes.push_back (recorder.m_receptions[k].packet->GetSize ());
+    }
+  Simulator::Destroy ();
+  return sizes;
+}
+
+void
+LearnTxSchedulerTestCase::DoRun (void)
+{
+  std::vector<uint32_t> strict = Run ("StrictPriority");
+  std::vector<uint32_t> drr = Run ("DeficitRoundRobin");
+  NS_TEST_ASSERT_MSG_EQ (strict.size (), 8, "Frames lost");
+  NS_TEST_ASSERT_MSG_EQ (drr.size (), 8, "Frames lost");
+  for (std::size_t k = 0; k < 8; ++k)
+    {
+      NS_TEST_ASSERT_MSG_EQ (strict[k], k < 4 ? 1000 : 900, "Strict priority out of order at frame " << k);
+      //
+      // A quantum of 1000 bytes sends one frame of each queue per round.
+      //
+      NS_TEST_ASSERT_MSG_EQ (drr[k], k % 2 == 0 ? 1000 : 900, "Deficit round robin out of order at frame " << k);
+    }
+}
+
+/////////////////////////////////////////////////////////////
+
+class LearnRateTableTestCase : public TestCase
+{
+public:
+  LearnRateTableTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LearnRateTableTestCase::LearnRateTableTestCase ()
+  : TestCase ("The rate table picks the rate of a link by distance, broadcasts by policy")
+{
+}
+
+void
+LearnRateTableTestCase::DoRun (void)
+{
+  std::vector<double> xs;
+  std::vector<double> ys (4, 0);
+  xs.push_back (0);
+  xs.push_back (40);
+  xs.push_back (100);
+  xs.push_back (300);
+  NodeContainer nodes;
+  NetDeviceContainer devices = CreateDevices (nodes, xs, ys);
+  Ptr<LearnNetDevice> sender = devices.Get (0)->GetObject<LearnNetDevice> ();
+  sender->SetAttribute ("RateTable", StringValue ("50:8Mbps,150:2Mbps,250:1Mbps"));
+  LearnReceiveRecorder recorder;
+  recorder.Connect (devices);
+
+  NS_TEST_ASSERT_MSG_EQ (sender->GetLinkRate (1), DataRate ("8Mbps"), "Wrong rate of a near link");
+  NS_TEST_ASSERT_MSG_EQ (sender->GetLinkRate (2), DataRate ("2Mbps"), "Wrong rate of a middle link");
+  NS_TEST_ASSERT_MSG_EQ (sender->GetLinkRate (3), DataRate ("1Mbps"), "Beyond the table is not the lowest rate");
+  NS_TEST_ASSERT_MSG_EQ (sender->GetBroadcastRate (), DataRate ("8Mbps"), "Basic broadcasts not at the data rate");
+  sender->SetAttribute ("BroadcastRate", EnumValue (LearnNetDevice::BROADCAST_LOWEST_COMMON));
+  NS_TEST_ASSERT_MSG_EQ (sender->GetBroadcastRate (), DataRate ("1Mbps"), "Not the lowest rate of the listeners");
+  devices.Get (3)->GetObject<LearnNetDevice> ()->SetRadioState (LearnNetDevice::SLEEP);
+  NS_TEST_ASSERT_MSG_EQ (sender->GetBroadcastRate (), DataRate ("2Mbps"), "Sleeping device lowers the rate");
+
+  //
+  // 1000 bytes at 2 Mbps take 4 ms, then 100 us to travel.
+  //
+  sender->Send (Create<Packet> (1000), devices.Get (2)->GetAddress (), 0x0800);
+  Simulator::Run ();
+  bool found = false;
+  for (std::size_t k = 0; k < recorder.m_receptions.size (); ++k)
+    {
+      if (recorder.m_receptions[k].device == devices.Get (2))
+        {
+          NS_TEST_ASSERT_MSG_EQ (recorder.m_receptions[k].time, MicroSeconds (4100), "Unicast not at the link rate");
+          found = true;
+        }
+    }
+  NS_TEST_ASSERT_MSG_EQ (found, true, "Unicast lost");
+
+  //
+  // Moving a device changes the rate of its links.
+  //
+  devices.Get (2)->GetObject<LearnNetDevice> ()->SetX (30);
+  NS_TEST_ASSERT_MSG_EQ (sender->GetLinkRate (2), DataRate ("8Mbps"), "Link rate kept after a move");
+  Simulator::Destroy ();
+}
+
+/////////////////////////////////////////////////////////////
+
+class LearnRelayTestCase : public TestCase
+{
+public:
+  LearnRelayTestCase ();
+
+private:
+  virtual void DoRun (void);
+  //four relaying devices 100 m apart with a range of 150 m, frames may take maxHops hops
+  NetDeviceContainer Install (NodeContainer &nodes, uint32_t maxHops);
+};
+
+LearnRelayTestCase::LearnRelayTestCase ()
+  : TestCase ("Unicast frames are relayed hop by hop from their source, up to MaxHops")
+{
+}
+
+NetDeviceContainer
+LearnRelayTestCase::Install (NodeContainer &nodes, uint32_t maxHops)
+{
+  LearnHelper learn;
+  learn.SetDeviceAttribute ("DataRate", StringValue ("8Mbps"));
+  learn.SetDeviceAttribute ("L2Forwarding", BooleanValue (true));
+  learn.SetDeviceAttribute ("MaxHops", UintegerValue (maxHops));
+  learn.SetChannelAttribute ("DelayFac", TimeValue (MicroSeconds (1)));
+  learn.SetChannelAttribute ("MaxRange", DoubleValue (150));
+  for (uint32_t i = 0; i < 4; ++i)
+    {
+      learn.AddPosition (100 * i, 0);
+    }
+  nodes.Create (4);
+  return learn.Install (nodes);
+}
+
+void
+LearnRelayTestCase::DoRun (void)
+{
+  NodeContainer nodes;
+  NetDeviceContainer devices = Install (nodes, 16);
+  LearnReceiveRecorder recorder;
+  recorder.Connect (devices);
+  uint32_t forwards = 0;
+  uint32_t overheard = 0;
+  for (uint32_t i = 0; i < devices.GetN (); ++i)
+    {
+      devices.Get (i)->TraceConnectWithoutContext ("MacForward", MakeBoundCallback (&CountPacket, &forwards));
+      devices.Get (i)->TraceConnectWithoutContext ("MacRxDrop", MakeBoundCallback (&CountPacket, &overheard));
+    }
+  Ptr<LearnChannel> channel = devices.Get (0)->GetChannel ()->GetObject<LearnChannel> ();
+  Mac48Address source ("00:00:00:00:00:42");
+  NS_TEST_ASSERT_MSG_EQ (devices.Get (0)->SupportsSendFrom (), true, "SendFrom not supported");
+  devices.Get (0)->SendFrom (Create<Packet> (1000), source, devices.Get (3)->GetAddress (), 0x86dd);
+  Simulator::Run ();
+
+  //
+  // Three hops of 1 ms plus 100 us, the relays pass the frame on without
+  // handing it up.
+  //
+  NS_TEST_ASSERT_MSG_EQ (recorder.m_receptions.size (), 1, "Relays handed the frame up");
+  NS_TEST_ASSERT_MSG_EQ (forwards, 2, "Wrong number of relays");
+  const LearnReceiveRecorder::Reception &r = recorder.m_receptions[0];
+  NS_TEST_ASSERT_MSG_EQ (r.device, devices.Get (3), "Frame reached the wrong device");
+  NS_TEST_ASSERT_MSG_EQ (r.time, MicroSeconds (3300), "Frame not relayed along the shortest path");
+  NS_TEST_ASSERT_MSG_EQ (r.from, Address (source), "Source address of SendFrom lost on the way");
+  NS_TEST_ASSERT_MSG_EQ (r.protocol, 0x86dd, "Protocol lost on the way");
+  //
+  // Each relay is overheard by the device behind it.
+  //
+  NS_TEST_ASSERT_MSG_EQ (overheard, 2, "Overheard relayed frames not traced");
+
+  //
+  // Moves update the next hops: within range nothing changes, a lost link
+  // cuts the path, a new link shortens it.
+  //
+  NS_TEST_ASSERT_MSG_EQ (channel->GetNextHop (0, 3), 1, "Wrong next hop");
+  NS_TEST_ASSERT_MSG_EQ (channel->GetNextHop (0, 2), 1, "Wrong next hop");
+  devices.Get (3)->GetObject<LearnNetDevice> ()->SetX (310);
+  NS_TEST_ASSERT_MSG_EQ (channel->GetNextHop (0, 3), 1, "Next hop changed by a move within range");
+  NS_TEST_ASSERT_MSG_EQ (channel->GetNextHop (2, 3), 3, "Next hop changed by a move within range");
+  devices.Get (3)->GetObject<LearnNetDevice> ()->SetX (360);
+  NS_TEST_ASSERT_MSG_EQ (channel->GetNextHop (0, 3), LearnChannel::NO_DEVICE, "Path kept over a lost link");
+  devices.Get (2)->GetObject<LearnNetDevice> ()->SetX (140);
+  NS_TEST_ASSERT_MSG_EQ (channel->GetNextHop (0, 2), 2, "New link not used");
+  devices.Get (3)->GetObject<LearnNetDevice> ()->SetX (290);
+  NS_TEST_ASSERT_MSG_EQ (channel->GetNextHop (0, 3), 2, "Path not found again");
+  Simulator::Destroy ();
+
+  //
+  // With two hops allowed the second relay drops the frame.
+  //
+  NodeContainer shortNodes;
+  NetDeviceContainer shortDevices = Install (shortNodes, 2);
+  LearnReceiveRecorder shortRecorder;
+  shortRecorder.Connect (shortDevices);
+  uint32_t drops = 0;
+  shortDevices.Get (2)->TraceConnectWithoutContext ("MacTxDrop", MakeBoundCallback (&CountPacket, &drops));
+  shortDevices.Get (0)->Send (Create<Packet> (1000), shortDevices.Get (3)->GetAddress (), 0x86dd);
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (shortRecorder.m_receptions.size (), 0, "Frame went past MaxHops");
+  NS_TEST_ASSERT_MSG_EQ (drops, 1, "Frame out of hops not dropped by the last relay");
+  Simulator::Destroy ();
+}
+
+/////////////////////////////////////////////////////////////
+
+class LearnTopologyTestCase : public TestCase
 {
 public:
-  LearnTestCase1 ();
-  virtual ~LearnTestCase1 ();
+  LearnTopologyTestCase ();
 
 private:
   virtual void DoRun (void);
 };
 
-// Add some help text to this case to describe what it is intended to test
-LearnTestCase1::LearnTestCase1 ()
-  : TestCase ("Learn test case (does nothing)")
+LearnTopologyTestCase::LearnTopologyTestCase ()
+  : TestCase ("A topology file places devices in groups with their rates and link losses")
+{
+}
+
+void
+LearnTopologyTestCase::DoRun (void)
 {
+  std::string devicesCsv = CreateTempDirFilename ("devices.csv");
+  std::string linksCsv = CreateTempDirFilename ("links.csv");
+  std::string topologyFile = CreateTempDirFilename ("topology.bin");
+  std::ofstream devicesOs (devicesCsv.c_str ());
+  devicesOs << "# x,y,rate,group" << std::endl;
+  devicesOs << "0,0,8000000,0" << std::endl;
+  devicesOs << "100,0,1000000" << std::endl;
+  devicesOs << "50,0,0,1" << std::endl;
+  devicesOs << "0,10" << std::endl;
+  devicesOs.close ();
+  std::ofstream linksOs (linksCsv.c_str ());
+  linksOs << "0,1,1" << std::endl;
+  linksOs << "1,0,0.25" << std::endl;
+  linksOs << "0,3,0.5" << std::endl;
+  linksOs.close ();
+  LearnTopology::ConvertCsv (devicesCsv, linksCsv, topologyFile);
+
+  Ptr<LearnTopology> topology = Create<LearnTopology> (topologyFile);
+  NS_TEST_ASSERT_MSG_EQ (topology->GetNDevices (), 4, "Devices lost");
+  NS_TEST_ASSERT_MSG_EQ (topology->GetNLinks (), 3, "Links lost");
+  NS_TEST_ASSERT_MSG_EQ (topology->GetDevice (2).group, 1, "Wrong group");
+
+  LearnHelper learn;
+  NodeContainer nodes;
+  nodes.Create (4);
+  NetDeviceContainer devices = learn.Install (nodes, topology);
+  std::vector<Ptr<LearnNetDevice> > d;
+  for (uint32_t i = 0; i < devices.GetN (); ++i)
+    {
+      d.push_back (devices.Get (i)->GetObject<LearnNetDevice> ());
+    }
+  Ptr<LearnChannel> channel = d[0]->GetChannel ()->GetObject<LearnChannel> ();
+  NS_TEST_ASSERT_MSG_EQ (channel->GetNDevices (), 3, "Group 0 not on one channel");
+  NS_TEST_ASSERT_MSG_EQ (d[1]->GetChannel (), d[0]->GetChannel (), "Group 0 not on one channel");
+  NS_TEST_ASSERT_MSG_NE (d[2]->GetChannel (), d[0]->GetChannel (), "Group 1 shares the channel of group 0");
+  NS_TEST_ASSERT_MSG_EQ (d[1]->GetDataRate (), DataRate ("1Mbps"), "Rate of the file not set");
+  NS_TEST_ASSERT_MSG_EQ_TOL (d[3]->GetY (), 10, 1e-12, "Wrong position");
+  NS_TEST_ASSERT_MSG_EQ (channel->GetLinkLoss (d[0]->GetChannelIndex (), d[1]->GetChannelIndex ()), 1.0,
+                         "Link loss not set");
+  NS_TEST_ASSERT_MSG_EQ (channel->GetLinkLoss (d[1]->GetChannelIndex (), d[0]->GetChannelIndex ()), 0.25,
+                         "Link loss not set");
+  NS_TEST_ASSERT_MSG_EQ (channel->GetLinkLoss (d[0]->GetChannelIndex (), d[3]->GetChannelIndex ()), 0.5,
+                         "Link loss not set");
+  Simulator::Destroy ();
+
+  //
+  // Compact devices of group 0, in file order, with the same links.
+  //
+  Ptr<LearnChannel> compact = learn.InstallCompact (topology, 0);
+  NS_TEST_ASSERT_MSG_EQ (compact->GetNDevices (), 3, "Wrong number of compact devices");
+  NS_TEST_ASSERT_MSG_EQ_TOL (compact->GetY (2), 10, 1e-12, "Compact devices out of file order");
+  NS_TEST_ASSERT_MSG_EQ (compact->GetLinkLoss (0, 1), 1.0, "Compact link loss not set");
+  NS_TEST_ASSERT_MSG_EQ (compact->GetLinkLoss (0, 2), 0.5, "Compact link loss not set");
+  Ptr<LearnChannel> other = learn.InstallCompact (topology, 1);
+  NS_TEST_ASSERT_MSG_EQ (other->GetNDevices (), 1, "Wrong number of compact devices");
+  NS_TEST_ASSERT_MSG_EQ_TOL (other->GetX (0), 50, 1e-12, "Wrong compact position");
+  Simulator::Destroy ();
 }
 
-// This destructor does nothing but we include it as a reminder that
-// the test case should clean up after itself
-LearnTestCase1::~LearnTestCase1 ()
+/////////////////////////////////////////////////////////////
+
+//
+// Counters known from the index: index itself, the same a billion higher,
+// a sum of two additions, and one set only in odd replications.
+//
+static void
+ReplicationScenario (uint32_t index, LearnReplicationResult *result)
 {
+  result->SetCounter ("index", index);
+  result->SetCounter ("offset", 1e9 + index);
+  result->AddCounter ("sum", 1);
+  result->AddCounter ("sum", index);
+  if (index % 2 == 1)
+    {
+      result->SetCounter ("odd", index);
+    }
+  result->GetHistogram ("delay").Add (MilliSeconds (index + 1));
 }
 
 //
-// This method is the pure virtual method from class TestCase that every
-// TestCase must implement
+// Replications run in this process so far, left behind by earlier ones in
+// the same process.
+//
+static uint32_t g_replicationsRun = 0;
+
+//
+// Records what a replication inherits: the replications run before it in
+// its process, and a draw from a variable with an automatically assigned
+// stream, which depends on the variables created before it.
 //
+static void
+InheritingScenario (uint32_t index, LearnReplicationResult *result)
+{
+  result->SetCounter ("before", g_replicationsRun++);
+  Ptr<UniformRandomVariable> rng = CreateObject<UniformRandomVariable> ();
+  result->SetCounter ("draw", rng->GetValue ());
+}
+
+class LearnReplicationTestCase : public TestCase
+{
+public:
+  LearnReplicationTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LearnReplicationTestCase::LearnReplicationTestCase ()
+  : TestCase ("Replications merge counters, statistics and histograms")
+{
+}
+
 void
-LearnTestCase1::DoRun (void)
+LearnReplicationTestCase::DoRun (void)
 {
-  // A wide variety of test macros are available in src/core/test.h
-  NS_TEST_ASSERT_MSG_EQ (true, true, "true doesn't equal true for some reason");
-  // Use this one for floating point comparisons
-  NS_TEST_ASSERT_MSG_EQ_TOL (0.01, 0.01, 0.001, "Numbers are not equal within tolerance");
+  LearnReplicationRunner runner;
+  runner.SetWorkers (2);
+  runner.SetProgress (false);
+  runner.Run (5, MakeCallback (&ReplicationScenario));
+  NS_TEST_ASSERT_MSG_EQ (runner.GetNReplications (), 5, "Replications lost");
+
+  //
+  // Indices 0 to 4: mean 2, sample variance 2.5, and for four degrees of
+  // freedom the 97.5% Student quantile is 2.776445.
+  //
+  NS_TEST_ASSERT_MSG_EQ_TOL (runner.GetMean ("index"), 2.0, 1e-12, "Wrong mean");
+  NS_TEST_ASSERT_MSG_EQ_TOL (runner.GetStdDev ("index"), std::sqrt (2.5), 1e-12, "Wrong standard deviation");
+  double halfWidth = 2.776445 * std::sqrt (2.5) / std::sqrt (5.0);
+  NS_TEST_ASSERT_MSG_EQ_TOL (runner.GetHalfWidth ("index"), halfWidth, halfWidth * 0.01, "Wrong confidence interval");
+  runner.SetConfidence (0.5);
+  NS_TEST_ASSERT_MSG_LT (runner.GetHalfWidth ("index"), halfWidth / 2, "Interval does not follow the confidence level");
+
+  //
+  // A sum of squares would lose the spread next to a mean of 1e9, Welford's
+  // update keeps it.
+  //
+  NS_TEST_ASSERT_MSG_EQ_TOL (runner.GetMean ("offset"), 1e9 + 2, 1e-6, "Wrong mean of large counter");
+  NS_TEST_ASSERT_MSG_EQ_TOL (runner.GetStdDev ("offset"), std::sqrt (2.5), 1e-6, "Spread of large counter lost");
+
+  NS_TEST_ASSERT_MSG_EQ_TOL (runner.GetMean ("sum"), 3.0, 1e-12, "Additions to a counter not summed");
+  NS_TEST_ASSERT_MSG_EQ_TOL (runner.GetMean ("odd"), 2.0, 1e-12, "Counter averaged over replications without it");
+  NS_TEST_ASSERT_MSG_EQ_TOL (runner.GetStdDev ("odd"), std::sqrt (2.0), 1e-12, "Counter averaged over replications without it");
+
+  const LearnHistogram &delay = runner.GetHistogram ("delay");
+  NS_TEST_ASSERT_MSG_EQ (delay.GetCount (), 5, "Histograms not merged");
+  NS_TEST_ASSERT_MSG_EQ (delay.GetMin (), MilliSeconds (1), "Histograms not merged");
+  NS_TEST_ASSERT_MSG_EQ (delay.GetMax (), MilliSeconds (5), "Histograms not merged");
+
+  //
+  // Two and three replications: the quantiles for one and two degrees of
+  // freedom are 12.706205 and 4.302653.
+  //
+  runner.SetConfidence (0.95);
+  runner.Run (2, MakeCallback (&ReplicationScenario));
+  halfWidth = 12.706205 * std::sqrt (0.5) / std::sqrt (2.0);
+  NS_TEST_ASSERT_MSG_EQ_TOL (runner.GetHalfWidth ("index"), halfWidth, halfWidth * 1e-4, "Wrong interval for one degree of freedom");
+  runner.Run (3, MakeCallback (&ReplicationScenario));
+  halfWidth = 4.302653 / std::sqrt (3.0);
+  NS_TEST_ASSERT_MSG_EQ_TOL (runner.GetHalfWidth ("index"), halfWidth, halfWidth * 1e-4, "Wrong interval for two degrees of freedom");
+
+  //
+  // Every replication starts from the runner's state, so nothing is left
+  // behind by the one before and the draws do not depend on how the
+  // replications are spread over the workers.
+  //
+  runner.SetWorkers (1);
+  runner.Run (4, MakeCallback (&InheritingScenario));
+  NS_TEST_ASSERT_MSG_EQ (runner.GetMean ("before"), 0, "Replication saw state left by another");
+  double mean = runner.GetMean ("draw");
+  double stdDev = runner.GetStdDev ("draw");
+  runner.SetWorkers (4);
+  runner.Run (4, MakeCallback (&InheritingScenario));
+  NS_TEST_ASSERT_MSG_EQ (runner.GetMean ("before"), 0, "Replication saw state left by another");
+  NS_TEST_ASSERT_MSG_EQ_TOL (runner.GetMean ("draw"), mean, 1e-12, "Draws depend on the workers");
+  NS_TEST_ASSERT_MSG_EQ_TOL (runner.GetStdDev ("draw"), stdDev, 1e-12, "Draws depend on the workers");
+  NS_TEST_ASSERT_MSG_GT (stdDev, 0, "Replications share an RNG run");
 }
 
 // The TestSuite class names the TestSuite, identifies what type of TestSuite,
@@ -60,9 +1998,31 @@ LearnTestSuite::LearnTestSuite ()
   : TestSuite ("learn", UNIT)
 {
   // TestDuration for TestCase can be QUICK, EXTENSIVE or TAKES_FOREVER
-  AddTestCase (new LearnTestCase1, TestCase::QUICK);
+  AddTestCase (new LearnDeliveryTestCase, TestCase::QUICK);
+  AddTestCase (new LearnEventBudgetTestCase, TestCase::QUICK);
+  AddTestCase (new LearnAllocationBudgetTestCase, TestCase::QUICK);
+  AddTestCase (new LearnCompactTestCase, TestCase::QUICK);
+  AddTestCase (new LearnAntennaTestCase, TestCase::QUICK);
+  AddTestCase (new LearnObstacleTestCase, TestCase::QUICK);
+  AddTestCase (new LearnPropagationTestCase, TestCase::QUICK);
+  AddTestCase (new LearnSlottedTestCase, TestCase::QUICK);
+  AddTestCase (new LearnFanOutTestCase, TestCase::QUICK);
+  AddTestCase (new LearnMobilityTraceTestCase, TestCase::QUICK);
+  AddTestCase (new LearnMulticastTestCase, TestCase::QUICK);
+  AddTestCase (new LearnSendBatchTestCase, TestCase::QUICK);
+  AddTestCase (new LearnTimingWheelTestCase, TestCase::QUICK);
+  AddTestCase (new LearnCheckpointTestCase, TestCase::QUICK);
+  AddTestCase (new LearnLinkLossTestCase, TestCase::QUICK);
+  AddTestCase (new LearnRadioStateTestCase, TestCase::QUICK);
+  AddTestCase (new LearnFluidTestCase, TestCase::QUICK);
+  AddTestCase (new LearnLatencyStatsTestCase, TestCase::QUICK);
+  AddTestCase (new LearnCarrierSenseTestCase, TestCase::QUICK);
+  AddTestCase (new LearnTxSchedulerTestCase, TestCase::QUICK);
+  AddTestCase (new LearnRateTableTestCase, TestCase::QUICK);
+  AddTestCase (new LearnRelayTestCase, TestCase::QUICK);
+  AddTestCase (new LearnTopologyTestCase, TestCase::QUICK);
+  AddTestCase (new LearnReplicationTestCase, TestCase::QUICK);
 }
 
 // Do not forget to allocate an instance of this TestSuite
 static LearnTestSuite learnTestSuite;
-